@@ -0,0 +1,199 @@
+// iblog.h - binary sample log format shared by ibmon (writer) and ibmon-decode.
+//
+// File layout (all fixed-width integers little-endian):
+//
+//   header  "IBMONLOG" | u16 version | u16 ncounters | u16 nports | u16 reserved
+//           ncounters x { u8 len | name }                 counter schema
+//           nports    x { u8 len | device | u16 port | u8 flags | u32 rate_mbps }
+//           u32 crc32 of everything above
+//   blocks  "IBLB" | u32 payload_len | u32 nsamples | u32 crc32(payload) | payload
+//
+// A block payload starts with varint realtime_ns and varint monotonic_ns of its
+// first sample; every later sample starts with varint(mono delta ns). Each
+// sample then holds, per port and counter, zigzag varint(value - previous
+// value), where "previous" is 0 at the start of a block. Blocks are therefore
+// decodable on their own and a damaged block only loses its own samples.
+// Counter values are stored exactly as read from sysfs (data counters in
+// 4-byte words when IBLOG_PORT_DATA_WORDS is set). rate_mbps is the link rate
+// when the log was opened; a later speed change is not recorded (ibmon's
+// --event-log has it), so replay and ibmon-summarize use the starting rate.
+#ifndef IBLOG_H
+#define IBLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IBLOG_MAGIC "IBMONLOG"
+#define IBLOG_BLOCK_MAGIC "IBLB"
+#define IBLOG_VERSION 1
+#define IBLOG_BLOCK_HDR 16
+#define IBLOG_MAX_PORTS 4096
+#define IBLOG_MAX_COUNTERS 64
+
+#define IBLOG_PORT_DATA_WORDS 0x01
+
+static inline void iblog_put16(uint8_t *p, uint16_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+static inline void iblog_put32(uint8_t *p, uint32_t v) { for (int i = 0; i < 4; ++i) p[i] = (uint8_t)(v >> (8 * i)); }
+static inline uint16_t iblog_get16(const uint8_t *p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static inline uint32_t iblog_get32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t iblog_zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+static inline int64_t iblog_unzigzag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+// Append an LEB128 varint; returns bytes written (at most 10).
+static inline size_t iblog_put_varint(uint8_t *p, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) { p[n++] = (uint8_t)(v | 0x80); v >>= 7; }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+// Read a varint from [*p, end); returns 0 on truncated or overlong input.
+static inline int iblog_get_varint(const uint8_t **p, const uint8_t *end, uint64_t *out) {
+    const uint8_t *q = *p;
+    if (end - q >= 10 || (q < end && !(q[0] & 0x80))) {
+        // fast path: no bounds check needed within the maximum varint length
+        uint64_t v = q[0] & 0x7f;
+        if (!(q[0] & 0x80)) { *p = q + 1; *out = v; return 1; }
+        for (int i = 1; i < 10; ++i) {
+            v |= (uint64_t)(q[i] & 0x7f) << (7 * i);
+            if (!(q[i] & 0x80)) { *p = q + i + 1; *out = v; return 1; }
+        }
+        return 0;
+    }
+    uint64_t v = 0;
+    for (int shift = 0; shift < 70 && *p < end; shift += 7) {
+        uint8_t b = *(*p)++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) { *out = v; return 1; }
+    }
+    return 0;
+}
+
+// CRC-32 (IEEE 802.3, reflected), slicing-by-8; tables built on first use.
+static inline uint32_t iblog_crc32(uint32_t crc, const void *buf, size_t n) {
+    static uint32_t table[8][256];
+    static int ready;
+    if (!ready) {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[0][i] = c;
+        }
+        for (int t = 1; t < 8; ++t)
+            for (int i = 0; i < 256; ++i) table[t][i] = (table[t - 1][i] >> 8) ^ table[0][table[t - 1][i] & 0xff];
+        ready = 1;
+    }
+    const uint8_t *p = (const uint8_t *)buf;
+    crc = ~crc;
+    for (; n >= 8; n -= 8, p += 8) {
+        uint32_t lo = iblog_get32(p) ^ crc, hi = iblog_get32(p + 4);
+        crc = table[7][lo & 0xff] ^ table[6][(lo >> 8) & 0xff] ^ table[5][(lo >> 16) & 0xff] ^ table[4][lo >> 24] ^
+              table[3][hi & 0xff] ^ table[2][(hi >> 8) & 0xff] ^ table[1][(hi >> 16) & 0xff] ^ table[0][hi >> 24];
+    }
+    while (n--) crc = table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+/* Reading. iblog_read_header() parses and checks the file header;
+ * iblog_next_block() walks the blocks, skipping (and counting) damaged ones;
+ * iblog_read_sample() decodes one sample of a block into absolute values. */
+typedef struct {
+    char name[256];
+    int port;
+    uint8_t flags;
+    uint32_t rate_mbps;
+} iblog_port_t;
+
+typedef struct {
+    int ncounters, nports;
+    char counters[IBLOG_MAX_COUNTERS][256];
+    iblog_port_t *ports;    // malloc'd, free() when done
+    size_t size;            // header bytes, i.e. offset of the first block
+} iblog_header_t;
+
+// Returns NULL on success or a message describing the problem.
+static inline const char *iblog_read_header(const uint8_t *buf, size_t len, iblog_header_t *h) {
+    memset(h, 0, sizeof(*h));
+    if (len < 16 || memcmp(buf, IBLOG_MAGIC, 8) != 0) return "not an ibmon binary log";
+    if (iblog_get16(buf + 8) != IBLOG_VERSION) return "unsupported log version";
+    h->ncounters = iblog_get16(buf + 10);
+    h->nports = iblog_get16(buf + 12);
+    if (h->ncounters > IBLOG_MAX_COUNTERS || h->nports > IBLOG_MAX_PORTS) return "corrupt header";
+    size_t o = 16;
+    for (int c = 0; c < h->ncounters; ++c) {
+        if (o >= len || o + 1 + buf[o] > len) return "truncated header";
+        size_t l = buf[o++];
+        memcpy(h->counters[c], buf + o, l); h->counters[c][l] = '\0'; o += l;
+    }
+    h->ports = (iblog_port_t *)calloc((size_t)h->nports + 1, sizeof(iblog_port_t));
+    if (!h->ports) return "out of memory";
+    for (int i = 0; i < h->nports; ++i) {
+        if (o >= len || o + 1 + buf[o] + 7 > len) { free(h->ports); h->ports = NULL; return "truncated header"; }
+        size_t l = buf[o++];
+        memcpy(h->ports[i].name, buf + o, l); h->ports[i].name[l] = '\0'; o += l;
+        h->ports[i].port = iblog_get16(buf + o); o += 2;
+        h->ports[i].flags = buf[o++];
+        h->ports[i].rate_mbps = iblog_get32(buf + o); o += 4;
+    }
+    if (o + 4 > len || iblog_crc32(0, buf, o) != iblog_get32(buf + o)) { free(h->ports); h->ports = NULL; return "header checksum mismatch"; }
+    h->size = o + 4;
+    return NULL;
+}
+
+// Index of a counter in the schema, -1 if absent.
+static inline int iblog_counter_index(const iblog_header_t *h, const char *name) {
+    for (int c = 0; c < h->ncounters; ++c) if (strcmp(h->counters[c], name) == 0) return c;
+    return -1;
+}
+
+// Advance *off to the next intact block. Returns 1 with its payload, 0 at the
+// end of the data. Damaged blocks and a truncated tail are added to *bad.
+static inline int iblog_next_block(const uint8_t *buf, size_t len, size_t *off, const uint8_t **payload,
+                                   uint32_t *plen, uint32_t *nsamples, uint64_t *bad) {
+    while (*off + IBLOG_BLOCK_HDR <= len) {
+        const uint8_t *b = buf + *off;
+        uint32_t pl = iblog_get32(b + 4);
+        if (memcmp(b, IBLOG_BLOCK_MAGIC, 4) == 0 && pl <= len - *off - IBLOG_BLOCK_HDR &&
+            iblog_crc32(0, b + IBLOG_BLOCK_HDR, pl) == iblog_get32(b + 12)) {
+            *payload = b + IBLOG_BLOCK_HDR; *plen = pl; *nsamples = iblog_get32(b + 8);
+            *off += IBLOG_BLOCK_HDR + pl;
+            return 1;
+        }
+        // resynchronise on the next block magic
+        (*bad)++;
+        const uint8_t *nx = NULL;
+        for (size_t i = *off + 1; i + 4 <= len && !nx; ++i)
+            if (memcmp(buf + i, IBLOG_BLOCK_MAGIC, 4) == 0) nx = buf + i;
+        if (!nx) { *off = len; return 0; }
+        *off = (size_t)(nx - buf);
+    }
+    if (*off < len) { (*bad)++; *off = len; }
+    return 0;
+}
+
+// Decode sample `index` of a block (samples must be read in order). vals
+// holds nvals = nports * ncounters running values and is reset at index 0.
+// Returns 0 on malformed input.
+static inline int iblog_read_sample(const uint8_t **p, const uint8_t *end, uint32_t index, uint64_t *real_ns,
+                                    uint64_t *mono_ns, uint64_t *vals, size_t nvals) {
+    uint64_t v;
+    if (index == 0) {
+        if (!iblog_get_varint(p, end, real_ns) || !iblog_get_varint(p, end, mono_ns)) return 0;
+        memset(vals, 0, nvals * sizeof(uint64_t));
+    } else {
+        if (!iblog_get_varint(p, end, &v)) return 0;
+        *mono_ns += v;
+    }
+    for (size_t j = 0; j < nvals; ++j) {
+        if (!iblog_get_varint(p, end, &v)) return 0;
+        vals[j] += (uint64_t)iblog_unzigzag(v);
+    }
+    return 1;
+}
+
+#endif
@@ -0,0 +1,163 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "iblog.h"
+
+// Convert an ibmon --binlog file to CSV or NDJSON.
+
+static bool read_file(const char *path, uint8_t **out, size_t *len) {
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!f) { fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno)); return false; }
+    size_t cap = 1 << 20, n = 0;
+    uint8_t *buf = malloc(cap);
+    while (buf) {
+        if (n == cap) {
+            uint8_t *nb = realloc(buf, cap * 2);
+            if (!nb) { free(buf); buf = NULL; break; }
+            buf = nb; cap *= 2;
+        }
+        size_t r = fread(buf + n, 1, cap - n, f);
+        if (r == 0) break;
+        n += r;
+    }
+    if (f != stdin) fclose(f);
+    if (!buf) { fprintf(stderr, "Out of memory\n"); return false; }
+    *out = buf; *len = n;
+    return true;
+}
+
+static void print_json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; ++s) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') { fputc('\\', out); fputc(c, out); }
+        else if (c < 0x20) fprintf(out, "\\u%04x", c);
+        else fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [--format csv|ndjson] [-o OUT] LOG\n"
+        "Decode an ibmon --binlog file. Each row holds one port at one sample: raw\n"
+        "counters, deltas since the previous sample (data counters in bytes) and\n"
+        "per-second rates. The first sample of a log only sets the baseline.\n",
+        prog);
+}
+
+int main(int argc, char **argv) {
+    bool ndjson = false;
+    const char *out_path = NULL;
+    static struct option long_opts[] = {
+        {"format", required_argument, 0, 'f'},
+        {"output", required_argument, 0, 'o'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "f:o:h", long_opts, NULL)) != -1) {
+        switch (c) {
+            case 'f':
+                if (strcasecmp(optarg, "csv") == 0) ndjson = false;
+                else if (strcasecmp(optarg, "ndjson") == 0) ndjson = true;
+                else { fprintf(stderr, "Invalid --format: %s (use csv|ndjson)\n", optarg); return 2; }
+                break;
+            case 'o': out_path = optarg; break;
+            case 'h': usage(argv[0]); return 0;
+            default: usage(argv[0]); return 2;
+        }
+    }
+    if (optind != argc - 1) { usage(argv[0]); return 2; }
+
+    uint8_t *buf; size_t len;
+    if (!read_file(argv[optind], &buf, &len)) return 1;
+    iblog_header_t h;
+    const char *err = iblog_read_header(buf, len, &h);
+    if (err) { fprintf(stderr, "%s: %s\n", argv[optind], err); free(buf); return 1; }
+    FILE *out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out) { fprintf(stderr, "Failed to open %s: %s\n", out_path, strerror(errno)); free(buf); return 1; }
+
+    int nc = h.ncounters, np = h.nports;
+    size_t nv = (size_t)np * nc;
+    uint64_t *cur = calloc(nv + 1, sizeof(uint64_t));
+    uint64_t *last = calloc(nv + 1, sizeof(uint64_t));
+    // data counters of ports flagged IBLOG_PORT_DATA_WORDS are in 4-byte words
+    uint64_t *scale = calloc(nv + 1, sizeof(uint64_t));
+    if (!cur || !last || !scale) { fprintf(stderr, "Out of memory\n"); return 1; }
+    for (int i = 0; i < np; ++i)
+        for (int k = 0; k < nc; ++k) {
+            size_t l = strlen(h.counters[k]);
+            bool data = l >= 5 && strcmp(h.counters[k] + l - 5, "_data") == 0;
+            scale[(size_t)i * nc + k] = (data && (h.ports[i].flags & IBLOG_PORT_DATA_WORDS)) ? 4 : 1;
+        }
+
+    if (!ndjson) {
+        fprintf(out, "time_s,mono_s,dt_s,device,port");
+        for (int k = 0; k < nc; ++k) fprintf(out, ",%s", h.counters[k]);
+        for (int k = 0; k < nc; ++k) fprintf(out, ",d_%s", h.counters[k]);
+        for (int k = 0; k < nc; ++k) fprintf(out, ",%s_per_s", h.counters[k]);
+        fputc('\n', out);
+    }
+
+    bool have_last = false;
+    uint64_t last_mono = 0;
+    uint64_t samples = 0, blocks = 0, bad_blocks = 0;
+    size_t o = h.size;
+    const uint8_t *payload; uint32_t plen, ns;
+    while (iblog_next_block(buf, len, &o, &payload, &plen, &ns, &bad_blocks)) {
+        blocks++;
+        const uint8_t *p = payload, *end = payload + plen;
+        uint64_t real_ns = 0, mono0 = 0, mono = 0;
+        for (uint32_t s = 0; s < ns; ++s) {
+            if (!iblog_read_sample(&p, end, s, &real_ns, &mono, cur, nv)) {
+                bad_blocks++;
+                fprintf(stderr, "Warning: malformed block ending at offset %zu\n", o);
+                break;
+            }
+            if (s == 0) mono0 = mono;
+            if (have_last && mono > last_mono) {
+                double t = (double)(real_ns + (mono - mono0)) / 1e9;
+                double dt = (double)(mono - last_mono) / 1e9;
+                for (int i = 0; i < np; ++i) {
+                    const uint64_t *cv = cur + (size_t)i * nc, *lv = last + (size_t)i * nc;
+                    const uint64_t *sc = scale + (size_t)i * nc;
+                    uint64_t d[IBLOG_MAX_COUNTERS];
+                    for (int k = 0; k < nc; ++k) d[k] = (cv[k] - lv[k]) * sc[k]; // unsigned wrap-safe
+                    if (ndjson) {
+                        fprintf(out, "{\"t\":%.6f,\"mono\":%.6f,\"dt\":%.6f,\"device\":", t, (double)mono / 1e9, dt);
+                        print_json_string(out, h.ports[i].name);
+                        fprintf(out, ",\"port\":%d", h.ports[i].port);
+                        for (int k = 0; k < nc; ++k) fprintf(out, ",\"%s\":%" PRIu64, h.counters[k], cv[k]);
+                        for (int k = 0; k < nc; ++k) fprintf(out, ",\"d_%s\":%" PRIu64, h.counters[k], d[k]);
+                        for (int k = 0; k < nc; ++k) fprintf(out, ",\"%s_per_s\":%.1f", h.counters[k], (double)d[k] / dt);
+                        fputs("}\n", out);
+                    } else {
+                        fprintf(out, "%.6f,%.6f,%.6f,%s,%d", t, (double)mono / 1e9, dt, h.ports[i].name, h.ports[i].port);
+                        for (int k = 0; k < nc; ++k) fprintf(out, ",%" PRIu64, cv[k]);
+                        for (int k = 0; k < nc; ++k) fprintf(out, ",%" PRIu64, d[k]);
+                        for (int k = 0; k < nc; ++k) fprintf(out, ",%.1f", (double)d[k] / dt);
+                        fputc('\n', out);
+                    }
+                }
+            }
+            memcpy(last, cur, nv * sizeof(uint64_t));
+            last_mono = mono;
+            have_last = true;
+            samples++;
+        }
+    }
+    if (bad_blocks) fprintf(stderr, "Warning: skipped %" PRIu64 " damaged or truncated block(s)\n", bad_blocks);
+    fprintf(stderr, "%d port(s), %" PRIu64 " sample(s) in %" PRIu64 " block(s)\n", np, samples, blocks);
+    if (out != stdout) fclose(out);
+    free(cur); free(last); free(scale); free(h.ports); free(buf);
+    return 0;
+}
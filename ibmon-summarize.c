@@ -0,0 +1,623 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "iblog.h"
+
+// Summarize an ibmon --binlog or --csv file: per port and direction the
+// totals, mean, p50/p99/max rate, time spent above a fraction of the link
+// rate and the number of microbursts. The log is mmap'd and decoded a block
+// at a time into columns (one array of interval lengths plus one array per
+// port and counter); the rate reductions then run over whole columns with
+// 128-bit vectors (SSE2 / NEON, no special flags needed).
+
+#define PCTL_SUB_BITS 5        // same buckets as ibmon's live percentiles (~1.6% error)
+#define PCTL_BUCKETS (64 << PCTL_SUB_BITS)
+#define WIN_MAX (1 << 20)      // (power of two) intervals a burst window may span, as ibmon's TWIN_MAX
+#define CSV_BATCH 4096         // CSV ticks per column batch
+
+typedef double v2d __attribute__((vector_size(16)));
+typedef int64_t v2i __attribute__((vector_size(16)));
+
+// Accumulated statistics of one port and direction.
+typedef struct {
+    uint64_t bytes, pkts;
+    uint64_t n;                // intervals
+    double dur, max, above_s;
+    uint32_t hist[PCTL_BUCKETS];
+    // microburst detector (see burst_update() in ibmon.c): the intervals
+    // before the current batch that the longest window still needs, newest
+    // at head - 1, in a ring grown on demand up to WIN_MAX
+    double *win_dt, *win_b;
+    unsigned head, len, cap;
+    double win_sum;            // of win_dt
+    bool active;
+    uint64_t bursts;
+} dir_acc_t;
+
+typedef struct {
+    char name[256];
+    int port;
+    double link_Bps;           // 0 = unknown
+    dir_acc_t dir[2];          // RX, TX
+} port_acc_t;
+
+static struct {
+    double above;              // fraction of the link rate for above_s
+    double burst_frac, burst_avg_frac, burst_short, burst_long;
+    double link_gbps;          // for logs without a link rate (CSV)
+} g_cfg = { 0.8, 0.8, 0.3, 0.0, 10.0, 0.0 };
+static bool g_win_capped;      // a burst window reached WIN_MAX and was cut short
+
+static int pctl_index(uint64_t v) {
+    if (v < (1ULL << PCTL_SUB_BITS)) return (int)v;
+    int e = 63 - __builtin_clzll(v);
+    int sub = (int)((v >> (e - PCTL_SUB_BITS)) & ((1ULL << PCTL_SUB_BITS) - 1));
+    return ((e - PCTL_SUB_BITS + 1) << PCTL_SUB_BITS) + sub;
+}
+
+static double pctl_value(int idx) {
+    if (idx < (1 << PCTL_SUB_BITS)) return (double)idx;
+    int e = (idx >> PCTL_SUB_BITS) + PCTL_SUB_BITS - 1;
+    int sub = idx & ((1 << PCTL_SUB_BITS) - 1);
+    double lo = ldexp((double)((1 << PCTL_SUB_BITS) + sub), e - PCTL_SUB_BITS);
+    return lo + ldexp(0.5, e - PCTL_SUB_BITS);
+}
+
+static double pctl_get(const dir_acc_t *a, double q) {
+    if (!a->n) return 0.0;
+    uint64_t seen = 0;
+    for (int i = 0; i < PCTL_BUCKETS; ++i) {
+        seen += a->hist[i];
+        if ((double)seen >= q * (double)a->n) { double v = pctl_value(i); return v < a->max ? v : a->max; }
+    }
+    return a->max;
+}
+
+static inline v2d v2_load(const double *p) { v2d v; memcpy(&v, p, sizeof(v)); return v; }
+
+/* Average rate of the intervals before interval i of the batch: the shortest
+ * run of them (at most WIN_MAX) covering span, as ibmon's time windows keep
+ * it. Only needed when a hot interval could start a burst (or for the short
+ * window), so it is computed on demand instead of being maintained per sample. */
+static double window_rate(const dir_acc_t *a, const double *dt, const double *b, size_t i, double span) {
+    double sdt = 0, sb = 0;
+    unsigned cnt = 0;
+    while (i > 0 && cnt < WIN_MAX && sdt < span) { --i; sdt += dt[i]; sb += b[i]; cnt++; }
+    for (unsigned j = 1; j <= a->len && cnt < WIN_MAX && sdt < span; ++j, ++cnt) {
+        unsigned k = (a->head - j) & (a->cap - 1);
+        sdt += a->win_dt[k]; sb += a->win_b[k];
+    }
+    return sdt > 0 ? sb / sdt : 0.0;
+}
+
+// Keep one more interval for the windows of the next batch, dropping the
+// oldest ones the longer window no longer needs.
+static void win_push(dir_acc_t *a, double dt, double b, double span) {
+    if (a->len == a->cap) {
+        unsigned cap = a->cap ? a->cap * 2 : 16;
+        double *ndt = cap <= WIN_MAX ? malloc(cap * sizeof(double)) : NULL;
+        double *nb = ndt ? malloc(cap * sizeof(double)) : NULL;
+        if (nb) {
+            for (unsigned j = 0; j < a->len; ++j) {
+                unsigned k = (a->head - a->len + j) & (a->cap - 1);
+                ndt[j] = a->win_dt[k]; nb[j] = a->win_b[k];
+            }
+            free(a->win_dt); free(a->win_b);
+            a->win_dt = ndt; a->win_b = nb; a->cap = cap; a->head = a->len;
+        } else {
+            free(ndt);
+            if (!a->cap) return;
+            a->win_sum -= a->win_dt[(a->head - a->len) & (a->cap - 1)];
+            a->len--;
+            g_win_capped = true;
+        }
+    }
+    a->win_dt[a->head] = dt; a->win_b[a->head] = b;
+    a->head = (a->head + 1) & (a->cap - 1);
+    a->len++;
+    a->win_sum += dt;
+    // a little slack, so rounding in the running sum never drops one too many
+    for (unsigned k; a->len > 1 && a->win_sum - a->win_dt[k = (a->head - a->len) & (a->cap - 1)] >= span + 1e-6; a->len--)
+        a->win_sum -= a->win_dt[k];
+}
+
+/* Fold n intervals of one port/direction into a: dt[] interval lengths,
+ * b[] bytes per interval. r[] receives the rates. The vector loop covers the
+ * rate, max, time-above and duration reductions; the histogram and the burst
+ * detector need per-sample state and run as scalar passes over r[]. */
+static void reduce_dir(dir_acc_t *a, double link_Bps, const double *dt, const double *b, double *r, size_t n) {
+    const double thr = link_Bps > 0 ? g_cfg.above * link_Bps : INFINITY;
+    v2d vmax = { 0, 0 }, vabove = vmax, vdur = vmax, vthr = { thr, thr };
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        v2d d = v2_load(dt + i), rate = v2_load(b + i) / d;
+        memcpy(r + i, &rate, sizeof(rate));
+        v2i gt = rate > vmax;
+        vmax = (v2d)(((v2i)rate & gt) | ((v2i)vmax & ~gt));
+        vabove += (v2d)((v2i)d & (rate >= vthr));
+        vdur += d;
+    }
+    double mx = 0, above = 0, dur = 0;
+    for (int k = 0; k < 2; ++k) { if (vmax[k] > mx) mx = vmax[k]; above += vabove[k]; dur += vdur[k]; }
+    for (; i < n; ++i) {
+        r[i] = b[i] / dt[i];
+        if (r[i] > mx) mx = r[i];
+        if (r[i] >= thr) above += dt[i];
+        dur += dt[i];
+    }
+    if (mx > a->max) a->max = mx;
+    a->above_s += above; a->dur += dur; a->n += n;
+    for (i = 0; i < n; ++i) a->hist[pctl_index((uint64_t)(r[i] < 1.8e19 ? r[i] + 0.5 : 1.8e19))]++;
+
+    if (g_cfg.burst_frac <= 0 || link_Bps <= 0) return;
+    const double hot = g_cfg.burst_frac * link_Bps, calm = g_cfg.burst_avg_frac * link_Bps;
+    if (g_cfg.burst_short > 0) {
+        // hot test on the short-window rate, current interval included
+        for (mx = 0, i = 0; i < n; ++i) {
+            r[i] = window_rate(a, dt, b, i + 1, g_cfg.burst_short);
+            if (r[i] > mx) mx = r[i];
+        }
+    }
+    // A burst counts when it ends, where ibmon emits it; one still open at the
+    // end of the log is counted by bursts_finish(), as ibmon emits it at exit.
+    if (mx < hot) {
+        if (a->active) a->bursts++; // nothing hot in this batch
+        a->active = false;
+    } else {
+        for (i = 0; i < n; ++i) {
+            if (r[i] < hot) { if (a->active) a->bursts++; a->active = false; }
+            else if (!a->active && window_rate(a, dt, b, i, g_cfg.burst_long) < calm) a->active = true;
+        }
+    }
+    const double span = g_cfg.burst_long > g_cfg.burst_short ? g_cfg.burst_long : g_cfg.burst_short;
+    for (i = 0; i < n; ++i) win_push(a, dt[i], b[i], span);
+}
+
+// Count the bursts still open after the last batch.
+static void ports_free(port_acc_t *ports, int nports) {
+    for (int i = 0; i < nports; ++i)
+        for (int d = 0; d < 2; ++d) { free(ports[i].dir[d].win_dt); free(ports[i].dir[d].win_b); }
+    free(ports);
+}
+
+static void bursts_finish(port_acc_t *ports, int nports) {
+    for (int i = 0; i < nports; ++i)
+        for (int d = 0; d < 2; ++d)
+            if (ports[i].dir[d].active) { ports[i].dir[d].bursts++; ports[i].dir[d].active = false; }
+}
+
+/* Column batch: dt[s] and, per port, bytes and packets per direction:
+ * col[(port * 4 + k) * cap + s] with k = rx_B, tx_B, rx_pkts, tx_pkts. */
+typedef struct {
+    size_t cap, n;
+    double *dt, *col, *rate;
+} batch_t;
+
+static bool batch_reserve(batch_t *bt, int nports, size_t cap) {
+    if (cap <= bt->cap) return true;
+    double *dt = realloc(bt->dt, cap * sizeof(double));
+    if (dt) bt->dt = dt;
+    double *rate = realloc(bt->rate, cap * sizeof(double));
+    if (rate) bt->rate = rate;
+    free(bt->col);
+    bt->col = malloc(cap * (size_t)nports * 4 * sizeof(double));
+    if (!dt || !rate || !bt->col) return false;
+    bt->cap = cap;
+    return true;
+}
+
+static void batch_reduce(batch_t *bt, port_acc_t *ports, int nports) {
+    for (int i = 0; i < nports; ++i)
+        for (int d = 0; d < 2; ++d)
+            reduce_dir(&ports[i].dir[d], ports[i].link_Bps, bt->dt, bt->col + ((size_t)i * 4 + d) * bt->cap, bt->rate, bt->n);
+    bt->n = 0;
+}
+
+static const char *summarize_binlog(const uint8_t *buf, size_t len, port_acc_t **out, int *nout,
+                                    double *t0, double *t1, uint64_t *bad) {
+    iblog_header_t h;
+    const char *err = iblog_read_header(buf, len, &h);
+    if (err) return err;
+    static const char *names[4] = { "port_rcv_data", "port_xmit_data", "port_rcv_packets", "port_xmit_packets" };
+    int idx[4];
+    for (int k = 0; k < 4; ++k)
+        if ((idx[k] = iblog_counter_index(&h, names[k])) < 0) { free(h.ports); return "log lacks the data/packet counters"; }
+    int np = h.nports, nc = h.ncounters;
+    size_t nv = (size_t)np * nc;
+    port_acc_t *ports = calloc((size_t)np + 1, sizeof(port_acc_t));
+    uint64_t *cur = calloc(nv + 1, sizeof(uint64_t)), *prev = calloc((size_t)np * 4 + 1, sizeof(uint64_t));
+    uint64_t *tot = calloc((size_t)np * 4 + 1, sizeof(uint64_t)), *scale = calloc((size_t)np * 4 + 1, sizeof(uint64_t));
+    if (!ports || !cur || !prev || !tot || !scale) {
+        free(ports); free(cur); free(prev); free(tot); free(scale); free(h.ports);
+        return "out of memory";
+    }
+    for (int i = 0; i < np; ++i) {
+        // data counters of ports flagged IBLOG_PORT_DATA_WORDS are in 4-byte words
+        for (int k = 0; k < 4; ++k) scale[i * 4 + k] = (k < 2 && (h.ports[i].flags & IBLOG_PORT_DATA_WORDS)) ? 4 : 1;
+        snprintf(ports[i].name, sizeof(ports[i].name), "%s", h.ports[i].name);
+        ports[i].port = h.ports[i].port;
+        double gbps = h.ports[i].rate_mbps ? h.ports[i].rate_mbps / 1000.0 : g_cfg.link_gbps;
+        ports[i].link_Bps = gbps * 1e9 / 8.0;
+    }
+    batch_t bt = {0};
+    bool have_prev = false;
+    uint64_t prev_mono = 0;
+    size_t o = h.size;
+    const uint8_t *payload; uint32_t plen, ns;
+    while (!err && iblog_next_block(buf, len, &o, &payload, &plen, &ns, bad)) {
+        if (!batch_reserve(&bt, np, ns)) { err = "out of memory"; break; }
+        const uint8_t *p = payload, *end = payload + plen;
+        uint64_t real_ns = 0, mono0 = 0, mono = 0;
+        for (uint32_t s = 0; s < ns; ++s) {
+            if (!iblog_read_sample(&p, end, s, &real_ns, &mono, cur, nv)) { (*bad)++; break; }
+            if (s == 0) mono0 = mono;
+            double t = (double)(real_ns + (mono - mono0)) / 1e9;
+            if (*t0 == 0) *t0 = t;
+            *t1 = t;
+            if (have_prev && mono <= prev_mono) continue;
+            // transpose into the columns: one entry per port and counter
+            size_t c = bt.n;
+            double *col = bt.col + c;
+            for (int i = 0; i < np; ++i) {
+                const uint64_t *cv = cur + (size_t)i * nc;
+                uint64_t *pv = prev + (size_t)i * 4, *tv = tot + (size_t)i * 4;
+                for (int k = 0; k < 4; ++k, col += bt.cap) {
+                    uint64_t v = cv[idx[k]], d = (v - pv[k]) * scale[i * 4 + k]; // unsigned wrap-safe
+                    pv[k] = v;
+                    *col = (double)d;
+                    tv[k] += have_prev ? d : 0;
+                }
+            }
+            if (have_prev) { bt.dt[c] = (double)(mono - prev_mono) / 1e9; bt.n++; }
+            prev_mono = mono;
+            have_prev = true;
+        }
+        if (bt.n) batch_reduce(&bt, ports, np);
+    }
+    for (int i = 0; i < np; ++i)
+        for (int d = 0; d < 2; ++d) { ports[i].dir[d].bytes = tot[i * 4 + d]; ports[i].dir[d].pkts = tot[i * 4 + 2 + d]; }
+    free(bt.dt); free(bt.col); free(bt.rate);
+    free(cur); free(prev); free(tot); free(scale); free(h.ports);
+    if (err) { ports_free(ports, np); return err; }
+    *out = ports; *nout = np;
+    return NULL;
+}
+
+// Decimal number at *p (as ibmon writes them); advances past it.
+static double parse_num(const char **p, const char *end) {
+    const char *s = *p;
+    bool neg = false;
+    if (s < end && (*s == '-' || *s == '+')) neg = (*s++ == '-');
+    double v = 0;
+    while (s < end && *s >= '0' && *s <= '9') v = v * 10 + (*s++ - '0');
+    if (s < end && *s == '.') {
+        double f = 0.1;
+        for (++s; s < end && *s >= '0' && *s <= '9'; ++s, f *= 0.1) v += (*s - '0') * f;
+    }
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        char tmp[16]; size_t n = 0;
+        while (s < end && n < sizeof(tmp) - 1 && *s != ',' && *s != '\n' && *s != '\r') tmp[n++] = *s++;
+        tmp[n] = '\0';
+        v *= pow(10.0, atof(tmp + 1));
+    }
+    *p = s;
+    return neg ? -v : v;
+}
+
+// Field f (0-based) of the line [s, e) into [*fs, *fe); false if missing.
+static bool csv_field(const char *s, const char *e, int f, const char **fs, const char **fe) {
+    for (; f > 0; --f) {
+        const char *c = memchr(s, ',', (size_t)(e - s));
+        if (!c) return false;
+        s = c + 1;
+    }
+    const char *c = memchr(s, ',', (size_t)(e - s));
+    *fs = s; *fe = c ? c : e;
+    return true;
+}
+
+static bool add_port(port_acc_t **ports, int *np, const char *name, size_t nlen, int port) {
+    port_acc_t *n = realloc(*ports, (size_t)(*np + 1) * sizeof(port_acc_t));
+    if (!n) return false;
+    *ports = n;
+    memset(&n[*np], 0, sizeof(n[*np]));
+    if (nlen >= sizeof(n[*np].name)) nlen = sizeof(n[*np].name) - 1;
+    memcpy(n[*np].name, name, nlen);
+    n[*np].port = port;
+    n[*np].link_Bps = g_cfg.link_gbps * 1e9 / 8.0;
+    (*np)++;
+    return true;
+}
+
+/* CSV in any ibmon layout: single (time_s,rx_Bps,tx_Bps,rx_pps,tx_pps),
+ * long (time_s,device,port,...) or wide (time_s,DEV:PORT:rx_Bps,...). Each
+ * row holds the rates of the interval ending at time_s; the first tick only
+ * sets the start time. */
+static const char *summarize_csv(const char *buf, size_t len, const char *path, port_acc_t **out, int *nout,
+                                 double *t0, double *t1) {
+    const char *end = buf + len, *le = memchr(buf, '\n', len);
+    if (!le) le = end;
+    if (len < 7 || memcmp(buf, "time_s,", 7) != 0) return "not an ibmon log";
+    port_acc_t *ports = NULL; int np = 0;
+    bool lng = false;
+    const char *f1s, *f1e;
+    csv_field(buf, le, 1, &f1s, &f1e);
+    if ((size_t)(f1e - f1s) == 6 && memcmp(f1s, "device", 6) == 0) {
+        lng = true;
+    } else if ((size_t)(f1e - f1s) == 6 && memcmp(f1s, "rx_Bps", 6) == 0) {
+        const char *b = strrchr(path, '/'); b = b ? b + 1 : path;
+        const char *dot = strrchr(b, '.');
+        if (!add_port(&ports, &np, b, dot && dot != b ? (size_t)(dot - b) : strlen(b), 1)) return "out of memory";
+    } else {
+        // wide: DEV:PORT:rx_Bps,DEV:PORT:tx_Bps,...
+        for (int f = 1; csv_field(buf, le, f, &f1s, &f1e); f += 4) {
+            const char *c2 = f1e;
+            while (c2 > f1s && c2[-1] != ':') --c2;
+            const char *c1 = c2 - 1;
+            while (c1 > f1s && c1[-1] != ':') --c1;
+            if (c2 <= f1s || c1 <= f1s) { free(ports); return "unrecognized CSV header"; }
+            if (!add_port(&ports, &np, f1s, (size_t)(c1 - 1 - f1s), atoi(c1))) { free(ports); return "out of memory"; }
+        }
+        if (!np) return "unrecognized CSV header";
+    }
+
+    batch_t bt = {0};
+    const char *err = NULL;
+    double t_prev = 0, t_cur = 0;
+    bool have_prev = false, first_tick = true;
+    int last = -1;
+    for (const char *s = le + 1; s < end && !err; ) {
+        const char *e = memchr(s, '\n', (size_t)(end - s));
+        if (!e) e = end;
+        const char *line = s; s = e + 1;
+        if (e - line < 5 || *line == 't') continue; // blank line or repeated header
+        const char *p = line;
+        double t = parse_num(&p, e);
+        int i = 0, f = 1;
+        if (lng) {
+            const char *ds, *de, *ps, *pe;
+            if (!csv_field(line, e, 1, &ds, &de) || !csv_field(line, e, 2, &ps, &pe)) continue;
+            int port = atoi(ps);
+            size_t dl = (size_t)(de - ds);
+            // rows come in port order, so the next port is tried first
+            i = np ? (last + 1) % np : 0;
+            if (!np || ports[i].port != port || strlen(ports[i].name) != dl || memcmp(ports[i].name, ds, dl) != 0)
+                for (i = 0; i < np && (ports[i].port != port || strlen(ports[i].name) != dl || memcmp(ports[i].name, ds, dl) != 0); ++i) {}
+            if (first_tick && (!have_prev || t == t_prev)) {
+                if (i == np && !add_port(&ports, &np, ds, dl, port)) err = "out of memory";
+                t_prev = t_cur = t; have_prev = true; last = i;
+                continue;
+            }
+            first_tick = false;
+            if (i == np) continue; // port not in the first tick
+            last = i; f = 3;
+        }
+        if (!have_prev) { t_prev = t_cur = t; have_prev = true; *t0 = t; continue; }
+        if (t < t_cur || (t == t_cur && !lng)) continue;
+        if (*t0 == 0) *t0 = t_prev;
+        if (t > t_cur) {
+            // new tick: start a column entry with every port idle
+            if (!batch_reserve(&bt, np, CSV_BATCH)) { err = "out of memory"; break; }
+            if (bt.n == bt.cap) batch_reduce(&bt, ports, np);
+            t_prev = t_cur; t_cur = t;
+            bt.dt[bt.n] = t_cur - t_prev;
+            for (int j = 0; j < np * 4; ++j) bt.col[(size_t)j * bt.cap + bt.n] = 0;
+            bt.n++;
+        }
+        size_t c = bt.n - 1;
+        double dt = bt.dt[c];
+        int j0 = lng ? i : 0, j1 = lng ? i + 1 : np;
+        const char *fs, *fe = p;
+        if (!csv_field(line, e, f, &fs, &fe)) continue;
+        p = fs;
+        for (int j = j0; j < j1; ++j)
+            for (int k = 0; k < 4; ++k) {
+                double r = parse_num(&p, e);
+                if (p < e && *p == ',') ++p;
+                uint64_t d = r > 0 ? (uint64_t)llround(r * dt) : 0;
+                bt.col[((size_t)j * 4 + k) * bt.cap + c] = (double)d;
+                if (k < 2) ports[j].dir[k].bytes += d;
+                else ports[j].dir[k - 2].pkts += d;
+            }
+        *t1 = t_cur;
+    }
+    if (!err && bt.n) batch_reduce(&bt, ports, np);
+    free(bt.dt); free(bt.col); free(bt.rate);
+    if (err) { ports_free(ports, np); return err; }
+    *out = ports; *nout = np;
+    return NULL;
+}
+
+static const char *human(double v, const char *unit, char *buf, size_t n) {
+    static const char *pre[] = { "", "K", "M", "G", "T", "P" };
+    int i = 0;
+    while (fabs(v) >= 1000.0 && i < 5) { v /= 1000.0; ++i; }
+    snprintf(buf, n, "%.2f %s%s", v, pre[i], unit);
+    return buf;
+}
+
+static double parse_duration(const char *s) {
+    char *end;
+    double v = strtod(s, &end);
+    if (end == s || v < 0) return -1;
+    switch (*end) {
+        case '\0': case 's': return v;
+        case 'm': return v * 60;
+        case 'h': return v * 3600;
+        case 'd': return v * 86400;
+        default: return -1;
+    }
+}
+
+static double parse_fraction(const char *s) {
+    char *end = NULL;
+    double v = strtod(s, &end);
+    if (end == s || *end != '\0' || !(v > 0 && v <= 1)) return -1.0;
+    return v;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [--format text|csv|ndjson] [-o OUT] [--above PCT] [--link-gbps G]\n"
+        "          [--burst-frac F] [--burst-avg-frac F] [--burst-short DURATION]\n"
+        "          [--burst-long DURATION] LOG\n"
+        "Summarize an ibmon --binlog or --csv file per port and direction: total bytes\n"
+        "and packets, mean, p50/p99/max rate, time above PCT%% of the link rate\n"
+        "(default 80) and microbursts (same rule as ibmon's detector). CSV logs carry\n"
+        "no link rate; pass --link-gbps for the link-relative figures.\n",
+        prog);
+}
+
+int main(int argc, char **argv) {
+    enum { FMT_TEXT, FMT_CSV, FMT_NDJSON } fmt = FMT_TEXT;
+    const char *out_path = NULL;
+    static struct option long_opts[] = {
+        {"format", required_argument, 0, 'f'},
+        {"output", required_argument, 0, 'o'},
+        {"above", required_argument, 0, 1000},
+        {"link-gbps", required_argument, 0, 1001},
+        {"burst-frac", required_argument, 0, 1002},
+        {"burst-avg-frac", required_argument, 0, 1003},
+        {"burst-long", required_argument, 0, 1004},
+        {"burst-short", required_argument, 0, 1005},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "f:o:h", long_opts, NULL)) != -1) {
+        switch (c) {
+            case 'f':
+                if (strcasecmp(optarg, "text") == 0) fmt = FMT_TEXT;
+                else if (strcasecmp(optarg, "csv") == 0) fmt = FMT_CSV;
+                else if (strcasecmp(optarg, "ndjson") == 0) fmt = FMT_NDJSON;
+                else { fprintf(stderr, "Invalid --format: %s (use text|csv|ndjson)\n", optarg); return 2; }
+                break;
+            case 'o': out_path = optarg; break;
+            case 1000:
+                g_cfg.above = atof(optarg) / 100.0;
+                if (!(g_cfg.above > 0)) { fprintf(stderr, "Invalid --above: %s\n", optarg); return 2; }
+                break;
+            case 1001: {
+                char *end = NULL;
+                g_cfg.link_gbps = strtod(optarg, &end);
+                if (end == optarg || *end != '\0' || !(g_cfg.link_gbps > 0 && isfinite(g_cfg.link_gbps))) {
+                    fprintf(stderr, "Invalid --link-gbps: %s\n", optarg); return 2;
+                }
+                break;
+            }
+            case 1002:
+                g_cfg.burst_frac = strcmp(optarg, "0") == 0 ? 0.0 : parse_fraction(optarg); // 0: detection off
+                if (g_cfg.burst_frac < 0) { fprintf(stderr, "Invalid --burst-frac: %s (use 0 < F <= 1, or 0 to disable)\n", optarg); return 2; }
+                break;
+            case 1003:
+                g_cfg.burst_avg_frac = parse_fraction(optarg);
+                if (g_cfg.burst_avg_frac <= 0) { fprintf(stderr, "Invalid --burst-avg-frac: %s (use 0 < F <= 1)\n", optarg); return 2; }
+                break;
+            case 1004:
+                g_cfg.burst_long = parse_duration(optarg);
+                if (g_cfg.burst_long <= 0) { fprintf(stderr, "Invalid --burst-long: %s\n", optarg); return 2; }
+                break;
+            case 1005:
+                g_cfg.burst_short = parse_duration(optarg);
+                if (g_cfg.burst_short < 0) { fprintf(stderr, "Invalid --burst-short: %s\n", optarg); return 2; }
+                break;
+            case 'h': usage(argv[0]); return 0;
+            default: usage(argv[0]); return 2;
+        }
+    }
+    if (optind != argc - 1) { usage(argv[0]); return 2; }
+    const char *path = argv[optind];
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno)); return 1; }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) { fprintf(stderr, "%s: empty or unreadable\n", path); close(fd); return 1; }
+    size_t len = (size_t)st.st_size;
+    void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) { fprintf(stderr, "Failed to map %s: %s\n", path, strerror(errno)); return 1; }
+    madvise(map, len, MADV_SEQUENTIAL);
+
+    port_acc_t *ports = NULL; int np = 0;
+    double t0 = 0, t1 = 0;
+    uint64_t bad = 0;
+    const char *err = (len >= 8 && memcmp(map, IBLOG_MAGIC, 8) == 0)
+        ? summarize_binlog(map, len, &ports, &np, &t0, &t1, &bad)
+        : summarize_csv(map, len, path, &ports, &np, &t0, &t1);
+    munmap(map, len);
+    if (err) { fprintf(stderr, "%s: %s\n", path, err); return 1; }
+    if (bad) fprintf(stderr, "Warning: skipped %" PRIu64 " damaged or truncated block(s)\n", bad);
+    if (g_win_capped) fprintf(stderr, "Warning: a burst window reached %d intervals and was cut short\n", WIN_MAX);
+    bursts_finish(ports, np);
+
+    FILE *out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out) { fprintf(stderr, "Failed to open %s: %s\n", out_path, strerror(errno)); ports_free(ports, np); return 1; }
+    int above_pct = (int)lround(g_cfg.above * 100);
+    if (fmt == FMT_TEXT) {
+        fprintf(out, "%s: %d port(s), %.0f s", path, np, t1 - t0);
+        if (t0 > 1e9) {
+            char a[32], b[32]; time_t ta = (time_t)t0, tb = (time_t)t1; struct tm lt;
+            strftime(a, sizeof(a), "%Y-%m-%d %H:%M:%S", localtime_r(&ta, &lt));
+            strftime(b, sizeof(b), "%Y-%m-%d %H:%M:%S", localtime_r(&tb, &lt));
+            fprintf(out, " (%s .. %s)", a, b);
+        }
+        fprintf(out, "\n%-16s %4s %3s %12s %12s %12s %12s %12s %12s %9s %7s\n", "DEVICE", "PORT", "DIR",
+                "TOTAL", "PACKETS", "MEAN", "P50", "P99", "MAX", "", "BURSTS");
+        fprintf(out, "%-16s %4s %3s %12s %12s %12s %12s %12s %12s %8s%% %7s\n", "", "", "", "", "", "", "", "", "",
+                ">link", "");
+    } else if (fmt == FMT_CSV) {
+        fprintf(out, "device,port,dir,duration_s,bytes,packets,mean_Bps,p50_Bps,p99_Bps,max_Bps,above_%d_pct_s,bursts\n", above_pct);
+    }
+    for (int i = 0; i < np; ++i)
+        for (int d = 0; d < 2; ++d) {
+            const dir_acc_t *a = &ports[i].dir[d];
+            double mean = a->dur > 0 ? (double)a->bytes / a->dur : 0.0;
+            double p50 = pctl_get(a, 0.50), p99 = pctl_get(a, 0.99);
+            bool link = ports[i].link_Bps > 0;
+            const char *dir = d ? "tx" : "rx";
+            if (fmt == FMT_TEXT) {
+                char b1[24], b2[24], b3[24], b4[24], b5[24], b6[24], ab[16] = "-", bu[16] = "-";
+                if (link) {
+                    snprintf(ab, sizeof(ab), "%.2f", a->dur > 0 ? 100.0 * a->above_s / a->dur : 0.0);
+                    if (g_cfg.burst_frac > 0) snprintf(bu, sizeof(bu), "%" PRIu64, a->bursts);
+                }
+                fprintf(out, "%-16s %4d %3s %12s %12s %12s %12s %12s %12s %9s %7s\n", ports[i].name, ports[i].port, dir,
+                        human((double)a->bytes, "B", b1, sizeof(b1)), human((double)a->pkts, "", b2, sizeof(b2)),
+                        human(mean * 8, "b/s", b3, sizeof(b3)), human(p50 * 8, "b/s", b4, sizeof(b4)),
+                        human(p99 * 8, "b/s", b5, sizeof(b5)), human(a->max * 8, "b/s", b6, sizeof(b6)), ab, bu);
+            } else if (fmt == FMT_CSV) {
+                fprintf(out, "%s,%d,%s,%.6f,%" PRIu64 ",%" PRIu64 ",%.0f,%.0f,%.0f,%.0f,", ports[i].name, ports[i].port, dir,
+                        a->dur, a->bytes, a->pkts, mean, p50, p99, a->max);
+                if (link) fprintf(out, "%.6f,%" PRIu64 "\n", a->above_s, a->bursts);
+                else fprintf(out, ",\n");
+            } else {
+                fprintf(out, "{\"device\":\"");
+                for (const char *s = ports[i].name; *s; ++s) {
+                    if (*s == '"' || *s == '\\') fputc('\\', out);
+                    if ((unsigned char)*s >= 0x20) fputc(*s, out);
+                }
+                fprintf(out, "\",\"port\":%d,\"dir\":\"%s\",\"duration_s\":%.6f,\"bytes\":%" PRIu64 ",\"packets\":%" PRIu64
+                        ",\"mean_Bps\":%.0f,\"p50_Bps\":%.0f,\"p99_Bps\":%.0f,\"max_Bps\":%.0f", ports[i].port, dir,
+                        a->dur, a->bytes, a->pkts, mean, p50, p99, a->max);
+                if (link) fprintf(out, ",\"above_pct\":%d,\"above_s\":%.6f,\"bursts\":%" PRIu64, above_pct, a->above_s, a->bursts);
+                fprintf(out, "}\n");
+            }
+        }
+    if (out != stdout) fclose(out);
+    ports_free(ports, np);
+    return 0;
+}
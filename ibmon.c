@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <time.h>
@@ -18,8 +19,37 @@
 #include <math.h>
 #include <inttypes.h>
 #include <dirent.h>
+#include <langinfo.h>
+#include <limits.h>
+#include <locale.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 
+#include "iblog.h"
+#include "ibmon_shm.h"
+
+#ifndef SYSFS_IB_BASE
 #define SYSFS_IB_BASE "/sys/class/infiniband"
+#endif
+
+#define HIST_CAP 4096          // live history ring (samples) per direction
+#define HS_CHANS 2             // compressed history channels: 0 = RX, 1 = TX
+#define HS_BLOCK_SAMPLES 1024  // samples per compressed history block
+#define COL_CAP 2048           // cached zoomed-out plot columns per port
+#define PCTL_SUB_BITS 5        // 32 sub-buckets per power of two (~1.6% error)
+#define PCTL_BUCKETS (64 << PCTL_SUB_BITS)
+#define TWIN_MAX (1 << 20)     // intervals a time window may hold (grown on demand)
+#define BURST_LOG_CAP 1024     // microburst events kept in memory
+#define EVENT_LOG_CAP 1024     // port events kept in memory
+#define EVENT_POLL_SECS 0.25   // state, rate and error counters are read at most this often
 
 typedef struct {
     char *tx_data;
@@ -50,21 +80,178 @@ typedef struct {
     char *ndev;
 } gid_entry_t;
 
-// Multi-device monitoring state
+// One block of the compressed long-term history. Timestamps (ms) are stored as
+// delta-of-delta and values as XOR against the previous value, Gorilla-style.
+typedef struct {
+    uint8_t *bits;          // MSB-first bit stream; trimmed to size when sealed
+    size_t nbits, cap;      // cap in bytes
+    uint32_t n;             // samples in this block
+    uint64_t seq0;          // sequence number of the first sample
+    int64_t t0_ms, t_last_ms;
+} hs_block_t;
+
+typedef struct {
+    hs_block_t *blk; int nblk, blk_cap;
+    uint64_t seq_next;      // sequence number of the next sample to append
+    int64_t retention_ms;   // blocks entirely older than this are dropped
+    // encoder state for the open (last) block
+    int64_t t_prev, d_prev;
+    uint64_t v_prev[HS_CHANS];
+    int lead_prev[HS_CHANS], trail_prev[HS_CHANS];
+} hstore_t;
+
+// Sliding-window maximum over the last `win` samples: a monotonic deque whose
+// values decrease from front to back, so the front is always the maximum.
+typedef struct {
+    uint64_t seq[HIST_CAP];
+    double val[HIST_CAP];
+    int head, len;
+    int win;                // window length in samples, 0 = not yet sized
+    uint64_t next;          // sequence number of the next pushed sample
+} wmax_t;
+
+// Aggregate of the samples that fall into one zoomed-out plot column
+typedef struct {
+    double max[HS_CHANS], sum[HS_CHANS];
+    uint32_t n;
+} colagg_t;
+
+// Ring of zoom-aligned columns: column c covers sample sequence numbers
+// [c*zoom, (c+1)*zoom). The newest column may still be filling.
+typedef struct {
+    colagg_t col[COL_CAP];
+    int head, len;
+    int zoom;               // 0 = not built yet
+    uint64_t col0;          // column index of col[head]
+} colcache_t;
+
+// Log-linear (HDR-style) histogram of rates in bytes/s; O(1) per sample.
+typedef struct {
+    uint32_t cnt[PCTL_BUCKETS];
+    uint64_t total;
+    double sum, max;
+    double t_start;         // realtime start of the current window
+    uint64_t cached_total;  // percentiles below are valid for this total
+    double p50, p99, p999;
+} pctl_t;
+
+// Rate metric used for display and export
+typedef enum { METRIC_RAW, METRIC_EWMA, METRIC_WINDOW } metric_t;
+
+// Time window over the last span of sampled intervals with running sums, so
+// its mean is time-weighted (total counted / total time) and updates are O(1).
+// Tracks up to four counters; which ones is up to the owner.
+typedef struct {
+    int64_t *dt;            // interval lengths, ns
+    uint64_t (*d)[4];       // counter deltas per interval
+    int cap, head, len;
+    int64_t sum_dt;
+    uint64_t sum[4];
+} twin_t;
+
+// Smoothed rates for rx_B, tx_B, rx_pkts, tx_pkts (in that order).
+typedef struct {
+    double ewma[4];
+    bool ewma_init;
+    twin_t win;
+} smooth_t;
+
+// Microburst detector state per direction (0 = RX, 1 = TX)
+typedef struct {
+    twin_t lng, shrt;       // long/short windows over rx_B, tx_B
+    bool active[2];
+    double t0[2], t_last[2]; // monotonic start and last hot sample
+    double peak[2];
+    uint64_t bytes[2];
+} burst_t;
+
+typedef struct {
+    char dev[128];
+    int port;
+    int dir;                // 0 = RX, 1 = TX
+    double start;           // realtime seconds
+    double duration;        // seconds
+    double peak_Bps;
+    uint64_t bytes;
+} burst_ev_t;
+
+// Discrete port events: state or rate string changes and error counter increments
+typedef enum { PEV_STATE, PEV_RATE, PEV_LINK_DOWNED, PEV_SYMBOL_ERROR, PEV_BUF_OVERRUN, PEV_KINDS } port_ev_kind_t;
+
+typedef struct {
+    char dev[128];
+    int port;
+    port_ev_kind_t kind;
+    double mono, real;      // when the change was seen
+    char from[64], to[64];  // old and new state/rate string or counter value
+} port_ev_t;
+
+// Last seen values of the event sources of one port
+typedef struct {
+    bool primed;
+    double next_poll;       // monotonic
+    char str[2][64];        // state, rate
+    uint64_t ctr[3];        // link_downed, symbol_error, excessive_buffer_overrun_errors
+    bool have_ctr[3];
+    double err_ps;          // symbol and buffer overrun errors per second between the last two polls
+} port_watch_t;
+
+// What a plot window currently shows, so the next live frame can scroll it
+// instead of redrawing every cell
+typedef struct {
+    bool valid;
+    int h, w;               // window size
+    double maxv;            // vertical scale
+    uint64_t end;           // sample or column number after the newest drawn one
+    int zoom;
+    int units;
+    bool use_colors, light;
+} chart_t;
+
+// Plot-only state of a port, about 340 KB: allocated while the port is drawn
+// as a plot (mon_dev_plot) and rebuilt from the compressed store when it comes
+// back into view, so a table of a thousand ports does not carry one each.
+typedef struct {
+    int hist_len, hist_off;    // live ring: the last hist_len values start at hist_off
+    double rx_hist[2 * HIST_CAP];
+    double tx_hist[2 * HIST_CAP];
+    wmax_t rx_max, tx_max;  // autoscale maxima over the visible chart width
+    colcache_t cols;        // per-column max/mean at the current zoom
+} plot_state_t;
+
+// Per-port monitoring state (single- and multi-device modes)
 typedef struct {
     char name[128];
+    int port;
     counters_t ctrs;
     double rate_gbps;
     uint64_t prev_tx_data, prev_rx_data, prev_tx_pkts, prev_rx_pkts;
+    double prev_t;
+    double dt;              // length of the last sampled interval
+    uint64_t delta[4];      // its rx_B, tx_B, rx_pkts, tx_pkts deltas (bytes, not words)
     double tx_Bps, rx_Bps, tx_pps, rx_pps;
-    int hist_len;
-    double rx_hist[4096];
-    double tx_hist[4096];
-    WINDOW *win;
+    plot_state_t *plot;     // NULL unless drawn as a plot
+    hstore_t hs;            // compressed full-retention history
+    pctl_t rx_pct, tx_pct;  // rate distribution for the current window
+    smooth_t sm;            // EWMA and windowed rates next to the raw ones
+    burst_t burst;
+    port_watch_t watch;
+    chart_t chart[2];       // RX, TX plot contents
 } mon_dev_t;
 
+// History viewport: offset (samples back from newest) and samples per column
+typedef struct {
+    uint64_t offset;
+    int zoom;
+    int zoom0;              // zoom of the live view ('l'): samples per frame with --fps
+} hview_t;
+
 typedef enum { UNITS_BITS, UNITS_BYTES } units_t;
 
+typedef enum { PLOT_ASCII, PLOT_BLOCK, PLOT_BRAILLE } plot_style_t; // --plot
+
+typedef enum { CSV_LONG = 0, CSV_WIDE = 1, CSV_SINGLE = 2 } csv_layout_t; // SINGLE: one-device TUI only
+
 typedef struct {
     const char *device;
     int port;
@@ -75,12 +262,54 @@ typedef struct {
     bool csv_headers;
     double duration; // seconds, 0 = infinite
     int bg_mode; // 0 = black, 1 = terminal default (-1)
+    double retention; // seconds of compressed history to keep
+    const char *summary_path; // per-window percentile summary (.json/.ndjson or CSV)
+    double pctl_window; // seconds per percentile window, 0 = whole run
+    metric_t csv_metric; // rate metric written to the CSV log
+    const char *burst_log_path; // CSV of detected microbursts
+    const char *event_log_path; // port state/rate changes and error counter increments
+    double csv_rotate_secs;  // start a new CSV file after this long (0: never)
+    uint64_t csv_rotate_bytes; // ... or once it would exceed this size
+    bool csv_sync;           // pace CSV writeback with sync_file_range
+    csv_layout_t csv_layout; // multi-port CSV: one row per port or per tick
+    const char *binlog_path; // binary raw-counter log (iblog.h)
+    const char *listen;      // HOST:PORT for the Prometheus exporter
+    const char *shm_name;    // POSIX shared-memory snapshot (ibmon_shm.h)
+    const char *statsd_addr; // HOST:PORT of a StatsD agent
+    const char *statsd_prefix;
+    bool statsd_tags;        // DogStatsD tags instead of names per port
+    size_t statsd_mtu;       // max datagram payload
+    bool headless; // no TUI; stream records to stdout in `format`
+    const char *format;
+    const char *replay_path; // play back a --binlog or --csv file instead of sysfs
+    double replay_speed;     // recorded seconds per wall-clock second
+    const char *serve_path;  // ibmond: serve ports, history and counters on this Unix socket
+    const char *connect_path; // view the ports of a running ibmond
+    const char *arrow_path;  // Arrow IPC stream of every tick
+    int arrow_batch;         // ticks per Arrow record batch
+    const char *influx_dest; // line protocol to a file, "-", tcp://HOST:PORT or unix:PATH
+    const char *influx_measurement;
+    double fps;              // TUI frame cap, 0 = a frame per sample
 } opts_t;
 
 static volatile sig_atomic_t g_stop = 0;
 static void on_sigint(int sig) { (void)sig; g_stop = 1; }
 static volatile sig_atomic_t g_resized = 0;
 static void on_sigwinch(int sig) { (void)sig; g_resized = 1; }
+static hview_t g_view = { 0, 1, 1 };
+static plot_style_t g_plot = PLOT_ASCII;
+// Smoothing parameters and the metric shown/exported (set from the command line)
+static struct { metric_t metric; double ewma_tau; double window_s; } g_smooth = { METRIC_RAW, 1.0, 5.0 };
+// Microburst detection: short-window rate >= frac of link while the long-window
+// average is below avg_frac of link. short_s == 0 uses the single sample.
+static struct { double frac, avg_frac, short_s, long_s; } g_burst = { 0.8, 0.3, 0.0, 10.0 };
+static burst_ev_t g_bursts[BURST_LOG_CAP];
+static uint64_t g_burst_count;  // events ever logged; newest is at (count-1) % cap
+static bool g_twin_capped;      // a time window hit TWIN_MAX and was cut short
+static port_ev_t g_events[EVENT_LOG_CAP];
+static uint64_t g_event_count;  // same scheme as the burst log
+// Replay: wall-clock minus monotonic time of the recording (0 when live or unknown).
+static double g_replay_real_offset;
 
 /* removed unused path_join3 */
 
@@ -260,371 +489,4454 @@ static void fetch_gid_list(const char *dev, int port, gid_entry_t **out_list, in
         arr[cnt].idx = i; arr[cnt].gid = gid; arr[cnt].type = type ? type : strdup(""); arr[cnt].ndev = ndev ? ndev : strdup("");
         cnt++;
     }
-    *out_list = arr;
-    *out_count = cnt;
+    *out_list = arr;
+    *out_count = cnt;
+}
+
+static double now_monotonic(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static double now_realtime(void) {
+    struct timespec ts; clock_gettime(CLOCK_REALTIME, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static const char *human_rate(double Bps, units_t units, char *buf, size_t buflen) {
+    static const char *u[] = { " ", "K", "M", "G", "T", "P" };
+    double v = Bps;
+    if (units == UNITS_BITS) v *= 8.0;
+    int i = 0;
+    while (fabs(v) >= 1000.0 && i < 5) { v /= 1000.0; i++; }
+    snprintf(buf, buflen, "%6.2f %s%s", v, u[i], units == UNITS_BITS ? "b/s" : "B/s");
+    return buf;
+}
+
+static const char *human_pps(double pps, char *buf, size_t buflen) {
+    static const char *u[] = { " ", "K", "M", "G", "T" };
+    double v = pps; int i = 0;
+    while (fabs(v) >= 1000.0 && i < 4) { v /= 1000.0; i++; }
+    snprintf(buf, buflen, "%6.2f %spps", v, u[i]);
+    return buf;
+}
+
+static double parse_rate_gbps(const char *rate) {
+    if (!rate) return 0.0;
+    // Expect leading number, e.g., "100 Gb/sec (4X EDR)"
+    char *end = NULL;
+    double v = strtod(rate, &end);
+    if (end == rate) return 0.0;
+    return v;
+}
+
+// Compact rate without the unit suffix, e.g. "12.3G", for panel titles.
+static const char *human_short(double Bps, units_t units, char *buf, size_t buflen) {
+    static const char *u[] = { "", "K", "M", "G", "T", "P" };
+    double v = Bps;
+    if (units == UNITS_BITS) v *= 8.0;
+    int i = 0;
+    while (fabs(v) >= 1000.0 && i < 5) { v /= 1000.0; i++; }
+    snprintf(buf, buflen, "%.*f%s", v < 10.0 ? 2 : (v < 100.0 ? 1 : 0), v, u[i]);
+    return buf;
+}
+
+static void format_scale_label(double v_disp_per_s, units_t units, char *buf, size_t buflen) {
+    // v_disp_per_s is already in chosen display units (bits or bytes per second)
+    const char *suffixes_bits[] = {"b/s","Kb/s","Mb/s","Gb/s","Tb/s","Pb/s"};
+    const char *suffixes_bytes[] = {"B/s","KB/s","MB/s","GB/s","TB/s","PB/s"};
+    double v = v_disp_per_s;
+    int idx = 0;
+    while (v >= 1000.0 && idx < 5) { v /= 1000.0; idx++; }
+    const char *suf = (units == UNITS_BITS) ? suffixes_bits[idx] : suffixes_bytes[idx];
+    snprintf(buf, buflen, "%6.2f %s", v, suf);
+}
+
+// Parse "90", "90s", "15m", "2h" or "7d" into seconds; returns < 0 on error.
+static double parse_duration(const char *s) {
+    if (!s) return -1.0;
+    char *end = NULL;
+    double v = strtod(s, &end);
+    if (end == s || v < 0) return -1.0;
+    switch (*end) {
+        case '\0': case 's': break;
+        case 'm': v *= 60.0; break;
+        case 'h': v *= 3600.0; break;
+        case 'd': v *= 86400.0; break;
+        default: return -1.0;
+    }
+    if (*end && end[1] != '\0') return -1.0;
+    return v;
+}
+
+// A fraction of the link rate, 0 < F <= 1; -1 if malformed or out of range.
+static double parse_fraction(const char *s) {
+    char *end = NULL;
+    double v = strtod(s, &end);
+    if (end == s || *end != '\0' || !(v > 0 && v <= 1)) return -1.0;
+    return v;
+}
+
+/* Compressed history store.
+ *
+ * Samples are (t, rx, tx) with values rounded to whole bytes/s, so the XOR of
+ * neighbouring doubles has long runs of trailing zeros. Each block starts with
+ * raw values; later samples use the Gorilla control codes. Blocks are decoded
+ * sequentially, so seeking costs at most one block (HS_BLOCK_SAMPLES). */
+
+// Make room for nbits more bits; the encoder reserves a whole sample up front
+// so that a failed allocation never leaves half a sample in the block.
+static bool hs_reserve(hs_block_t *b, size_t nbits) {
+    while (b->nbits + nbits > b->cap * 8) {
+        size_t nc = b->cap ? b->cap * 2 : 256;
+        uint8_t *nb = (uint8_t *)realloc(b->bits, nc);
+        if (!nb) return false;
+        memset(nb + b->cap, 0, nc - b->cap);
+        b->bits = nb; b->cap = nc;
+    }
+    return true;
+}
+
+static void hs_put(hs_block_t *b, uint64_t v, int n) {
+    while (n > 0) {
+        int off = (int)(b->nbits & 7);
+        int take = 8 - off; if (take > n) take = n;
+        uint8_t chunk = (uint8_t)((v >> (n - take)) & ((1u << take) - 1));
+        b->bits[b->nbits >> 3] |= (uint8_t)(chunk << (8 - off - take));
+        b->nbits += (size_t)take; n -= take;
+    }
+}
+
+static uint64_t hs_get(const uint8_t *bits, size_t *pos, int n) {
+    uint64_t v = 0;
+    while (n > 0) {
+        int off = (int)(*pos & 7);
+        int take = 8 - off; if (take > n) take = n;
+        uint8_t byte = bits[*pos >> 3];
+        v = (v << take) | (uint64_t)((byte >> (8 - off - take)) & ((1u << take) - 1));
+        *pos += (size_t)take; n -= take;
+    }
+    return v;
+}
+
+static void hs_put_dod(hs_block_t *b, int64_t dod) {
+    if (dod == 0) hs_put(b, 0, 1);
+    else if (dod >= -64 && dod <= 63) { hs_put(b, 0x2, 2); hs_put(b, (uint64_t)dod & 0x7f, 7); }
+    else if (dod >= -256 && dod <= 255) { hs_put(b, 0x6, 3); hs_put(b, (uint64_t)dod & 0x1ff, 9); }
+    else if (dod >= -2048 && dod <= 2047) { hs_put(b, 0xe, 4); hs_put(b, (uint64_t)dod & 0xfff, 12); }
+    else { hs_put(b, 0xf, 4); hs_put(b, (uint64_t)dod, 64); }
+}
+
+static int64_t hs_sext(uint64_t v, int n) {
+    uint64_t m = 1ULL << (n - 1);
+    return (int64_t)((v ^ m) - m);
+}
+
+static int64_t hs_get_dod(const uint8_t *bits, size_t *pos) {
+    if (!hs_get(bits, pos, 1)) return 0;
+    if (!hs_get(bits, pos, 1)) return hs_sext(hs_get(bits, pos, 7), 7);
+    if (!hs_get(bits, pos, 1)) return hs_sext(hs_get(bits, pos, 9), 9);
+    if (!hs_get(bits, pos, 1)) return hs_sext(hs_get(bits, pos, 12), 12);
+    return (int64_t)hs_get(bits, pos, 64);
+}
+
+static void hstore_init(hstore_t *hs, double retention_s) {
+    memset(hs, 0, sizeof(*hs));
+    hs->retention_ms = (int64_t)(retention_s * 1000.0);
+}
+
+static void hstore_free(hstore_t *hs) {
+    for (int i = 0; i < hs->nblk; ++i) free(hs->blk[i].bits);
+    free(hs->blk);
+    memset(hs, 0, sizeof(*hs));
+}
+
+static uint64_t hstore_first_seq(const hstore_t *hs) {
+    return hs->nblk ? hs->blk[0].seq0 : hs->seq_next;
+}
+
+// Returns false (and stores nothing) if the block could not grow.
+static bool hstore_append(hstore_t *hs, double t, const double *v) {
+    int64_t tm = (int64_t)llround(t * 1000.0);
+    hs_block_t *b = hs->nblk ? &hs->blk[hs->nblk - 1] : NULL;
+    if (!b || b->n >= HS_BLOCK_SAMPLES) {
+        if (b) { // seal: trim to the bytes actually used
+            size_t used = (b->nbits + 7) / 8;
+            uint8_t *nb = (uint8_t *)realloc(b->bits, used ? used : 1);
+            if (nb) { b->bits = nb; b->cap = used; }
+        }
+        if (hs->nblk == hs->blk_cap) {
+            int nc = hs->blk_cap ? hs->blk_cap * 2 : 16;
+            hs_block_t *na = (hs_block_t *)realloc(hs->blk, (size_t)nc * sizeof(*na));
+            if (!na) return false;
+            hs->blk = na; hs->blk_cap = nc;
+        }
+        b = &hs->blk[hs->nblk++];
+        memset(b, 0, sizeof(*b));
+        b->seq0 = hs->seq_next;
+        b->t0_ms = tm;
+    }
+    // worst case: a 68-bit timestamp and 77 bits per channel
+    if (!hs_reserve(b, 68 + 77 * HS_CHANS)) return false;
+    uint64_t bits[HS_CHANS];
+    for (int c = 0; c < HS_CHANS; ++c) { double r = round(v[c]); memcpy(&bits[c], &r, sizeof(r)); }
+    if (b->n == 0) {
+        for (int c = 0; c < HS_CHANS; ++c) {
+            hs_put(b, bits[c], 64);
+            hs->lead_prev[c] = 65; hs->trail_prev[c] = 0; // no reusable window yet
+        }
+        hs->d_prev = 0;
+    } else {
+        int64_t d = tm - hs->t_prev;
+        hs_put_dod(b, d - hs->d_prev);
+        hs->d_prev = d;
+        for (int c = 0; c < HS_CHANS; ++c) {
+            uint64_t x = bits[c] ^ hs->v_prev[c];
+            if (x == 0) { hs_put(b, 0, 1); continue; }
+            int lead = __builtin_clzll(x), trail = __builtin_ctzll(x);
+            if (lead > 31) lead = 31;
+            if (lead >= hs->lead_prev[c] && trail >= hs->trail_prev[c]) {
+                int len = 64 - hs->lead_prev[c] - hs->trail_prev[c];
+                hs_put(b, 0x2, 2);
+                hs_put(b, x >> hs->trail_prev[c], len);
+            } else {
+                int len = 64 - lead - trail;
+                hs_put(b, 0x3, 2);
+                hs_put(b, (uint64_t)lead, 5);
+                hs_put(b, (uint64_t)(len & 63), 6); // 64 is stored as 0
+                hs_put(b, x >> trail, len);
+                hs->lead_prev[c] = lead; hs->trail_prev[c] = trail;
+            }
+        }
+    }
+    memcpy(hs->v_prev, bits, sizeof(bits));
+    hs->t_prev = tm;
+    b->t_last_ms = tm;
+    b->n++;
+    hs->seq_next++;
+
+    // retention: drop whole blocks that ended before the window
+    int drop = 0;
+    while (drop < hs->nblk - 1 && hs->retention_ms > 0 && hs->blk[drop].t_last_ms < tm - hs->retention_ms) {
+        free(hs->blk[drop].bits);
+        drop++;
+    }
+    if (drop) {
+        memmove(hs->blk, hs->blk + drop, (size_t)(hs->nblk - drop) * sizeof(*hs->blk));
+        hs->nblk -= drop;
+    }
+    return true;
+}
+
+typedef struct {
+    const hs_block_t *b;
+    size_t pos;
+    uint32_t i;
+    int64_t t, d;
+    uint64_t v[HS_CHANS];
+    int lead[HS_CHANS], trail[HS_CHANS];
+} hs_iter_t;
+
+static void hs_iter_init(hs_iter_t *it, const hs_block_t *b) {
+    memset(it, 0, sizeof(*it));
+    it->b = b;
+}
+
+static bool hs_iter_next(hs_iter_t *it, int64_t *t_ms, double *v) {
+    const hs_block_t *b = it->b;
+    if (it->i >= b->n) return false;
+    if (it->i == 0) {
+        it->t = b->t0_ms; it->d = 0;
+        for (int c = 0; c < HS_CHANS; ++c) it->v[c] = hs_get(b->bits, &it->pos, 64);
+    } else {
+        it->d += hs_get_dod(b->bits, &it->pos);
+        it->t += it->d;
+        for (int c = 0; c < HS_CHANS; ++c) {
+            if (!hs_get(b->bits, &it->pos, 1)) continue;
+            if (hs_get(b->bits, &it->pos, 1)) {
+                it->lead[c] = (int)hs_get(b->bits, &it->pos, 5);
+                int len = (int)hs_get(b->bits, &it->pos, 6); if (len == 0) len = 64;
+                it->trail[c] = 64 - it->lead[c] - len;
+            }
+            int len = 64 - it->lead[c] - it->trail[c];
+            it->v[c] ^= hs_get(b->bits, &it->pos, len) << it->trail[c];
+        }
+    }
+    it->i++;
+    if (t_ms) *t_ms = it->t;
+    for (int c = 0; c < HS_CHANS; ++c) memcpy(&v[c], &it->v[c], sizeof(double));
+    return true;
+}
+
+static int hstore_find_block(const hstore_t *hs, uint64_t seq) {
+    int lo = 0, hi = hs->nblk - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (hs->blk[mid].seq0 <= seq) lo = mid; else hi = mid - 1;
+    }
+    return lo;
+}
+
+static void colagg_add(colagg_t *a, const double *v) {
+    for (int c = 0; c < HS_CHANS; ++c) {
+        if (a->n == 0 || v[c] > a->max[c]) a->max[c] = v[c];
+        a->sum[c] += v[c];
+    }
+    a->n++;
+}
+
+// Aggregate stored samples before seq_end into the zoom-aligned columns
+// [c0, c1). Returns the timestamp of the newest sample that was aggregated
+// (0 if none).
+static int64_t hstore_aggregate(const hstore_t *hs, int zoom, uint64_t c0, uint64_t c1, uint64_t seq_end, colagg_t *out) {
+    memset(out, 0, (size_t)(c1 - c0) * sizeof(*out));
+    uint64_t start = c0 * (uint64_t)zoom, end = c1 * (uint64_t)zoom;
+    if (start < hstore_first_seq(hs)) start = hstore_first_seq(hs);
+    if (end > seq_end) end = seq_end;
+    if (end > hs->seq_next) end = hs->seq_next;
+    int64_t t_last = 0;
+    if (start >= end) return t_last;
+    for (int bi = hstore_find_block(hs, start); bi < hs->nblk; ++bi) {
+        hs_iter_t it; hs_iter_init(&it, &hs->blk[bi]);
+        uint64_t seq = hs->blk[bi].seq0;
+        int64_t t; double v[HS_CHANS];
+        while (seq < end && hs_iter_next(&it, &t, v)) {
+            if (seq >= start) { colagg_add(&out[seq / (uint64_t)zoom - c0], v); t_last = t; }
+            seq++;
+        }
+        if (seq >= end) break;
+    }
+    return t_last;
+}
+
+static int64_t hstore_last_ms(const hstore_t *hs) {
+    return hs->nblk ? hs->blk[hs->nblk - 1].t_last_ms : 0;
+}
+
+// Fold one new sample into the newest column, opening a new one on a boundary.
+static void colcache_push(colcache_t *cc, uint64_t seq, const double *v) {
+    if (cc->zoom <= 0) return;
+    uint64_t c = seq / (uint64_t)cc->zoom;
+    if (cc->len == 0) { cc->head = 0; cc->col0 = c; }
+    while (cc->len == 0 || cc->col0 + (uint64_t)cc->len - 1 < c) {
+        if (cc->len == COL_CAP) { cc->head = (cc->head + 1) % COL_CAP; cc->col0++; cc->len--; }
+        memset(&cc->col[(cc->head + cc->len) % COL_CAP], 0, sizeof(colagg_t));
+        cc->len++;
+    }
+    colagg_add(&cc->col[(cc->head + cc->len - 1) % COL_CAP], v);
+}
+
+// Rebuild the newest ncols columns for a new zoom level from the store.
+static void colcache_rebuild(colcache_t *cc, const hstore_t *hs, int zoom, int ncols) {
+    uint64_t c1 = (hs->seq_next + (uint64_t)zoom - 1) / (uint64_t)zoom;
+    uint64_t cfirst = hstore_first_seq(hs) / (uint64_t)zoom;
+    uint64_t c0 = (c1 - cfirst > (uint64_t)ncols) ? c1 - (uint64_t)ncols : cfirst;
+    cc->zoom = zoom; cc->head = 0; cc->col0 = c0;
+    cc->len = (int)(c1 - c0);
+    hstore_aggregate(hs, zoom, c0, c1, hs->seq_next, cc->col);
+}
+
+static size_t hstore_bytes(const hstore_t *hs) {
+    size_t n = (size_t)hs->blk_cap * sizeof(hs_block_t);
+    for (int i = 0; i < hs->nblk; ++i) n += hs->blk[i].cap;
+    return n;
+}
+
+static void wmax_push(wmax_t *wm, double v) {
+    if (wm->win <= 0) return;
+    while (wm->len > 0 && wm->val[(wm->head + wm->len - 1) % HIST_CAP] <= v) wm->len--;
+    int tail = (wm->head + wm->len) % HIST_CAP;
+    wm->seq[tail] = wm->next; wm->val[tail] = v; wm->len++;
+    wm->next++;
+    while (wm->seq[wm->head] + (uint64_t)wm->win < wm->next) { wm->head = (wm->head + 1) % HIST_CAP; wm->len--; }
+}
+
+// Re-size the window and refill it from the newest samples of hist.
+static void wmax_reset(wmax_t *wm, int win, const double *hist, int hist_len) {
+    if (win > HIST_CAP) win = HIST_CAP;
+    wm->head = wm->len = 0; wm->next = 0; wm->win = win;
+    int start = hist_len > win ? hist_len - win : 0;
+    for (int i = start; i < hist_len; ++i) wmax_push(wm, hist[i]);
+}
+
+static double wmax_get(const wmax_t *wm) { return wm->len ? wm->val[wm->head] : 0.0; }
+
+static int pctl_index(uint64_t v) {
+    if (v < (1ULL << PCTL_SUB_BITS)) return (int)v;
+    int e = 63 - __builtin_clzll(v);
+    int sub = (int)((v >> (e - PCTL_SUB_BITS)) & ((1ULL << PCTL_SUB_BITS) - 1));
+    return ((e - PCTL_SUB_BITS + 1) << PCTL_SUB_BITS) + sub;
+}
+
+// Representative value (bucket midpoint) for a bucket index.
+static double pctl_value(int idx) {
+    if (idx < (1 << PCTL_SUB_BITS)) return (double)idx;
+    int e = (idx >> PCTL_SUB_BITS) + PCTL_SUB_BITS - 1;
+    int sub = idx & ((1 << PCTL_SUB_BITS) - 1);
+    double lo = ldexp((double)((1 << PCTL_SUB_BITS) + sub), e - PCTL_SUB_BITS);
+    return lo + ldexp(0.5, e - PCTL_SUB_BITS);
+}
+
+static void pctl_reset(pctl_t *pc, double t_start) {
+    memset(pc, 0, sizeof(*pc));
+    pc->t_start = t_start;
+}
+
+static void pctl_add(pctl_t *pc, double Bps) {
+    if (!(Bps >= 0)) return;
+    double r = Bps < 1.8e19 ? Bps : 1.8e19;
+    pc->cnt[pctl_index((uint64_t)llround(r))]++;
+    pc->total++;
+    pc->sum += Bps;
+    if (Bps > pc->max) pc->max = Bps;
+}
+
+// Refresh p50/p99/p99.9 in one pass over the buckets; cached until new samples arrive.
+static void pctl_update(pctl_t *pc) {
+    if (pc->cached_total == pc->total) return;
+    pc->cached_total = pc->total;
+    pc->p50 = pc->p99 = pc->p999 = 0.0;
+    if (!pc->total) return;
+    const double q[3] = { 0.50, 0.99, 0.999 };
+    double *out[3] = { &pc->p50, &pc->p99, &pc->p999 };
+    uint64_t seen = 0; int k = 0;
+    for (int i = 0; i < PCTL_BUCKETS && k < 3; ++i) {
+        seen += pc->cnt[i];
+        while (k < 3 && (double)seen >= q[k] * (double)pc->total) {
+            double v = pctl_value(i);
+            *out[k++] = v < pc->max ? v : pc->max;
+        }
+    }
+}
+
+static const char *pctl_label(pctl_t *pc, units_t units, char *buf, size_t buflen) {
+    char a[16], b[16], c[16];
+    pctl_update(pc);
+    if (!pc->total) { snprintf(buf, buflen, "%s", ""); return buf; }
+    snprintf(buf, buflen, "p50 %s p99 %s p99.9 %s",
+             human_short(pc->p50, units, a, sizeof(a)), human_short(pc->p99, units, b, sizeof(b)),
+             human_short(pc->p999, units, c, sizeof(c)));
+    return buf;
+}
+
+static FILE *summary_open(const char *path, bool *json) {
+    size_t n = strlen(path);
+    *json = (n >= 5 && strcmp(path + n - 5, ".json") == 0) || (n >= 7 && strcmp(path + n - 7, ".ndjson") == 0);
+    FILE *f = fopen(path, "w");
+    if (!f) { fprintf(stderr, "Failed to open summary path: %s\n", path); return NULL; }
+    if (!*json) fprintf(f, "start_s,end_s,device,port,dir,samples,mean_Bps,p50_Bps,p99_Bps,p999_Bps,max_Bps\n");
+    return f;
+}
+
+// Write one record per port and direction for the window ending at t_end
+// (realtime seconds), then start a new window.
+static void summary_window(FILE *f, bool json, mon_dev_t *md, int ndev, double t_end) {
+    for (int i = 0; i < ndev; ++i) {
+        for (int d = 0; d < 2; ++d) {
+            pctl_t *pc = d == 0 ? &md[i].rx_pct : &md[i].tx_pct;
+            pctl_update(pc);
+            double mean = pc->total ? pc->sum / (double)pc->total : 0.0;
+            if (f && json)
+                fprintf(f, "{\"type\":\"pctl\",\"start\":%.3f,\"end\":%.3f,\"device\":\"%s\",\"port\":%d,\"dir\":\"%s\","
+                           "\"samples\":%" PRIu64 ",\"mean_Bps\":%.0f,\"p50_Bps\":%.0f,\"p99_Bps\":%.0f,\"p999_Bps\":%.0f,\"max_Bps\":%.0f}\n",
+                        pc->t_start, t_end, md[i].name, md[i].port, d == 0 ? "rx" : "tx",
+                        pc->total, mean, pc->p50, pc->p99, pc->p999, pc->max);
+            else if (f)
+                fprintf(f, "%.3f,%.3f,%s,%d,%s,%" PRIu64 ",%.0f,%.0f,%.0f,%.0f,%.0f\n",
+                        pc->t_start, t_end, md[i].name, md[i].port, d == 0 ? "rx" : "tx",
+                        pc->total, mean, pc->p50, pc->p99, pc->p999, pc->max);
+            pctl_reset(pc, t_end);
+        }
+    }
+    if (f) fflush(f);
+}
+
+static const char *metric_name(metric_t m) {
+    return m == METRIC_EWMA ? "ewma" : (m == METRIC_WINDOW ? "window" : "raw");
+}
+
+static bool parse_metric(const char *s, metric_t *out) {
+    if (strcasecmp(s, "raw") == 0) *out = METRIC_RAW;
+    else if (strcasecmp(s, "ewma") == 0) *out = METRIC_EWMA;
+    else if (strcasecmp(s, "window") == 0) *out = METRIC_WINDOW;
+    else return false;
+    return true;
+}
+
+static void twin_pop(twin_t *w) {
+    w->sum_dt -= w->dt[w->head];
+    for (int k = 0; k < 4; ++k) w->sum[k] -= w->d[w->head][k];
+    w->head = (w->head + 1) % w->cap; w->len--;
+}
+
+// Double the ring (up to TWIN_MAX), oldest interval first. False if it can't.
+static bool twin_grow(twin_t *w) {
+    int cap = w->cap ? w->cap * 2 : 16;
+    if (cap > TWIN_MAX) return false;
+    int64_t *dt = malloc((size_t)cap * sizeof(*dt));
+    uint64_t (*d)[4] = malloc((size_t)cap * sizeof(*d));
+    if (!dt || !d) { free(dt); free(d); return false; }
+    for (int i = 0; i < w->len; ++i) {
+        int j = (w->head + i) % w->cap;
+        dt[i] = w->dt[j];
+        memcpy(d[i], w->d[j], sizeof(d[i]));
+    }
+    free(w->dt); free(w->d);
+    w->dt = dt; w->d = d; w->cap = cap; w->head = 0;
+    return true;
+}
+
+static void twin_free(twin_t *w) {
+    free(w->dt); free(w->d);
+    memset(w, 0, sizeof(*w));
+}
+
+// Append an interval, then drop the oldest ones the span no longer needs.
+// The ring grows to whatever the span takes; only at TWIN_MAX (or out of
+// memory) is the oldest interval dropped early, which g_twin_capped records.
+static void twin_push(twin_t *w, double span_s, double dt, const uint64_t *d) {
+    int64_t dt_ns = (int64_t)llround(dt * 1e9);
+    int64_t span_ns = (int64_t)llround(span_s * 1e9);
+    if (w->len == w->cap && !twin_grow(w)) {
+        if (!w->len) return;
+        twin_pop(w);
+        g_twin_capped = true;
+    }
+    int tail = (w->head + w->len) % w->cap;
+    w->dt[tail] = dt_ns; w->sum_dt += dt_ns;
+    for (int k = 0; k < 4; ++k) { w->d[tail][k] = d[k]; w->sum[k] += d[k]; }
+    w->len++;
+    while (w->len > 1 && w->sum_dt - w->dt[w->head] >= span_ns) twin_pop(w);
+}
+
+// Every time window takes about span / interval intervals. Settings that
+// would take more than TWIN_MAX are refused rather than cut short.
+static bool windows_fit(double interval) {
+    const struct { const char *opt; double span; bool used; } w[] = {
+        { "--avg-window", g_smooth.window_s, true },
+        { "--burst-long", g_burst.long_s, g_burst.frac > 0 },
+        { "--burst-short", g_burst.short_s, g_burst.frac > 0 },
+    };
+    for (size_t i = 0; i < sizeof(w) / sizeof(w[0]); ++i) {
+        if (!w[i].used || interval <= 0 || w[i].span / interval + 2 <= TWIN_MAX) continue;
+        fprintf(stderr, "%s %g s at a %g s interval takes more than %d intervals; use a shorter window or a longer interval\n",
+                w[i].opt, w[i].span, interval, TWIN_MAX);
+        return false;
+    }
+    return true;
+}
+
+// For the modes whose intervals come from elsewhere (a log, a daemon).
+static void windows_capped_warn(void) {
+    if (g_twin_capped)
+        fprintf(stderr, "Warning: a time window reached %d intervals and was cut short (--avg-window, --burst-long, --burst-short)\n", TWIN_MAX);
+}
+
+static double twin_rate(const twin_t *w, int k) {
+    return w->sum_dt > 0 ? (double)w->sum[k] * 1e9 / (double)w->sum_dt : 0.0;
+}
+
+static void smooth_update(smooth_t *sm, double dt, const uint64_t *d) {
+    // EWMA with a time constant, so irregular intervals weigh correctly
+    double alpha = g_smooth.ewma_tau > 0 ? 1.0 - exp(-dt / g_smooth.ewma_tau) : 1.0;
+    for (int k = 0; k < 4; ++k) {
+        double r = (double)d[k] / dt;
+        sm->ewma[k] = sm->ewma_init ? sm->ewma[k] + alpha * (r - sm->ewma[k]) : r;
+    }
+    sm->ewma_init = true;
+    twin_push(&sm->win, g_smooth.window_s, dt, d);
+}
+
+static void burst_emit(const mon_dev_t *md, int dir, double now) {
+    const burst_t *b = &md->burst;
+    burst_ev_t *ev = &g_bursts[g_burst_count % BURST_LOG_CAP];
+    snprintf(ev->dev, sizeof(ev->dev), "%s", md->name);
+    ev->port = md->port;
+    ev->dir = dir;
+    ev->start = g_replay_real_offset != 0.0 ? b->t0[dir] + g_replay_real_offset : now_realtime() - (now - b->t0[dir]);
+    ev->duration = b->t_last[dir] - b->t0[dir];
+    ev->peak_Bps = b->peak[dir];
+    ev->bytes = b->bytes[dir];
+    g_burst_count++;
+}
+
+// d = { rx_B, tx_B } for the interval [now - dt, now].
+static void burst_update(mon_dev_t *md, double now, double dt, const uint64_t *d) {
+    burst_t *b = &md->burst;
+    if (g_burst.frac <= 0 || md->rate_gbps <= 0) return;
+    double link_Bps = md->rate_gbps * 1e9 / 8.0;
+    // long average as it stood before this interval, so a burst can't mask itself
+    double avg[2] = { twin_rate(&b->lng, 0), twin_rate(&b->lng, 1) };
+    uint64_t dd[4] = { d[0], d[1], 0, 0 };
+    twin_push(&b->lng, g_burst.long_s, dt, dd);
+    if (g_burst.short_s > 0) twin_push(&b->shrt, g_burst.short_s, dt, dd);
+    for (int dir = 0; dir < 2; ++dir) {
+        double r = g_burst.short_s > 0 ? twin_rate(&b->shrt, dir) : (double)d[dir] / dt;
+        if (r >= g_burst.frac * link_Bps) {
+            if (!b->active[dir]) {
+                if (avg[dir] >= g_burst.avg_frac * link_Bps) continue; // sustained load, not a burst
+                b->active[dir] = true;
+                b->t0[dir] = now - dt; b->peak[dir] = r; b->bytes[dir] = 0;
+            }
+            if (r > b->peak[dir]) b->peak[dir] = r;
+            b->bytes[dir] += d[dir];
+            b->t_last[dir] = now;
+        } else if (b->active[dir]) {
+            burst_emit(md, dir, now);
+            b->active[dir] = false;
+        }
+    }
+}
+
+// Emit the bursts still in progress at shutdown, so they reach the logs.
+static void burst_finish(mon_dev_t *md, int n) {
+    double now = now_monotonic();
+    for (int i = 0; i < n; ++i)
+        for (int dir = 0; dir < 2; ++dir)
+            if (md[i].burst.active[dir]) { burst_emit(&md[i], dir, now); md[i].burst.active[dir] = false; }
+}
+
+// Append events logged since *written to a CSV burst log.
+static void burst_log_flush(FILE *f, uint64_t *written) {
+    if (*written + BURST_LOG_CAP < g_burst_count) *written = g_burst_count - BURST_LOG_CAP;
+    for (; *written < g_burst_count; ++*written) {
+        const burst_ev_t *ev = &g_bursts[*written % BURST_LOG_CAP];
+        if (f) fprintf(f, "%.6f,%s,%d,%s,%.6f,%.0f,%" PRIu64 "\n", ev->start, ev->dev, ev->port,
+                       ev->dir ? "tx" : "rx", ev->duration, ev->peak_Bps, ev->bytes);
+    }
+    if (f) fflush(f);
+}
+
+static FILE *burst_log_open(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) { fprintf(stderr, "Failed to open burst log path: %s\n", path); return NULL; }
+    fprintf(f, "start_s,device,port,dir,duration_s,peak_Bps,bytes\n");
+    return f;
+}
+
+static const char *port_ev_names[PEV_KINDS] = {
+    "state", "rate", "link_downed", "symbol_error", "excessive_buffer_overrun_errors"
+};
+
+static void port_ev_emit(const mon_dev_t *md, port_ev_kind_t kind, double now, double now_r, const char *from, const char *to) {
+    port_ev_t *ev = &g_events[g_event_count % EVENT_LOG_CAP];
+    snprintf(ev->dev, sizeof(ev->dev), "%s", md->name);
+    ev->port = md->port;
+    ev->kind = kind;
+    ev->mono = now; ev->real = now_r;
+    snprintf(ev->from, sizeof(ev->from), "%s", from);
+    snprintf(ev->to, sizeof(ev->to), "%s", to);
+    g_event_count++;
+}
+
+/* Compare the port's state, rate and error counters with the values seen at
+ * the previous poll and log a port_ev_t for each change. The first poll only
+ * records the baseline. A changed rate also updates the link rate used for
+ * utilization and burst detection. */
+static void mon_dev_watch(mon_dev_t *md, double now) {
+    port_watch_t *w = &md->watch;
+    if (w->primed && now < w->next_poll) return;
+    double since = now - (w->next_poll - EVENT_POLL_SECS); // time since the previous poll
+    w->next_poll = now + EVENT_POLL_SECS;
+    double now_r = now_realtime();
+    char path[PATH_MAX];
+    static const char *files[2] = { "state", "rate" };
+    for (int k = 0; k < 2; ++k) {
+        snprintf(path, sizeof(path), "%s/%s/ports/%d/%s", SYSFS_IB_BASE, md->name, md->port, files[k]);
+        char *v = read_str_file(path);
+        if (!v) continue;
+        if (w->primed && strcmp(v, w->str[k]) != 0) port_ev_emit(md, k == 0 ? PEV_STATE : PEV_RATE, now, now_r, w->str[k], v);
+        if (k == 1 && strcmp(v, w->str[k]) != 0) {
+            free(md->ctrs.rate);
+            md->ctrs.rate = strdup(v);
+            md->rate_gbps = parse_rate_gbps(v);
+        }
+        snprintf(w->str[k], sizeof(w->str[k]), "%s", v);
+        free(v);
+    }
+    const char *ctr[3] = { md->ctrs.link_downed, md->ctrs.symbol_error, md->ctrs.excessive_buf_overrun };
+    uint64_t nerr = 0;
+    for (int k = 0; k < 3; ++k) {
+        uint64_t v;
+        if (!ctr[k] || !read_u64_file(ctr[k], &v)) continue;
+        if (w->have_ctr[k] && v > w->ctr[k]) { // counters only grow; a reset is not an event
+            char a[24], b[24];
+            snprintf(a, sizeof(a), "%" PRIu64, w->ctr[k]); snprintf(b, sizeof(b), "%" PRIu64, v);
+            port_ev_emit(md, (port_ev_kind_t)(PEV_LINK_DOWNED + k), now, now_r, a, b);
+            if (k > 0) nerr += v - w->ctr[k];
+        }
+        w->ctr[k] = v; w->have_ctr[k] = true;
+    }
+    w->err_ps = (w->primed && since > 0) ? (double)nerr / since : 0.0;
+    w->primed = true;
+}
+
+// Rates for the selected metric: out = { rx_Bps, tx_Bps, rx_pps, tx_pps }.
+static void mon_dev_rates(const mon_dev_t *md, metric_t m, double *out) {
+    const smooth_t *sm = &md->sm;
+    if (m == METRIC_EWMA && sm->ewma_init) {
+        for (int k = 0; k < 4; ++k) out[k] = sm->ewma[k];
+    } else if (m == METRIC_WINDOW && sm->win.sum_dt > 0) {
+        for (int k = 0; k < 4; ++k) out[k] = twin_rate(&sm->win, k);
+    } else {
+        out[0] = md->rx_Bps; out[1] = md->tx_Bps; out[2] = md->rx_pps; out[3] = md->tx_pps;
+    }
+}
+
+/* Buffered output for machine-readable streams. Records are assembled from
+ * preformatted fragments and hand-rolled number formatting (no printf per
+ * field) and leave the process in one write() per flush. With fd < 0 the
+ * buffer only grows and is consumed by the caller. */
+typedef struct {
+    char *buf;
+    size_t len, cap;
+    int fd;
+    bool failed;            // a write failed (e.g. EPIPE); further output is dropped
+} obuf_t;
+
+static bool ob_init(obuf_t *ob, int fd, size_t cap) {
+    memset(ob, 0, sizeof(*ob));
+    ob->buf = (char *)malloc(cap);
+    ob->cap = cap; ob->fd = fd;
+    return ob->buf != NULL;
+}
+
+static void ob_flush(obuf_t *ob) {
+    size_t off = 0;
+    while (off < ob->len && !ob->failed) {
+        ssize_t w = write(ob->fd, ob->buf + off, ob->len - off);
+        if (w < 0) { if (errno == EINTR) continue; ob->failed = true; break; }
+        off += (size_t)w;
+    }
+    ob->len = 0;
+}
+
+static void ob_free(obuf_t *ob) {
+    ob_flush(ob);
+    free(ob->buf);
+    ob->buf = NULL;
+}
+
+static void ob_raw(obuf_t *ob, const char *s, size_t n) {
+    if (ob->len + n > ob->cap && ob->fd < 0) { // memory-only buffer: grow
+        size_t cap = ob->cap * 2 > ob->len + n ? ob->cap * 2 : ob->len + n;
+        char *nb = (char *)realloc(ob->buf, cap);
+        if (!nb) { ob->failed = true; return; }
+        ob->buf = nb; ob->cap = cap;
+    }
+    if (ob->len + n > ob->cap) ob_flush(ob);
+    if (n > ob->cap) { // oversized fragment: write through
+        ssize_t w = write(ob->fd, s, n);
+        if (w < 0) ob->failed = true;
+        return;
+    }
+    memcpy(ob->buf + ob->len, s, n);
+    ob->len += n;
+}
+
+static void ob_str(obuf_t *ob, const char *s) { ob_raw(ob, s, strlen(s)); }
+
+static void ob_u64(obuf_t *ob, uint64_t v) {
+    char tmp[24]; int i = (int)sizeof(tmp);
+    do { tmp[--i] = (char)('0' + v % 10); v /= 10; } while (v);
+    ob_raw(ob, tmp + i, sizeof(tmp) - (size_t)i);
+}
+
+// Fixed-point with `dec` decimals (0..9).
+static void ob_fix(obuf_t *ob, double v, int dec) {
+    static const double p10[] = { 1, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+    if (!isfinite(v)) { ob_str(ob, "0"); return; }
+    if (v < 0) { ob_raw(ob, "-", 1); v = -v; }
+    double scaled = v * p10[dec] + 0.5;
+    if (scaled >= 1.8e19) { char tmp[64]; int n = snprintf(tmp, sizeof(tmp), "%.*f", dec, v); ob_raw(ob, tmp, (size_t)n); return; }
+    uint64_t q = (uint64_t)scaled, ip = q / (uint64_t)p10[dec], fp = q % (uint64_t)p10[dec];
+    ob_u64(ob, ip);
+    if (dec > 0) {
+        char tmp[10]; tmp[0] = '.';
+        for (int i = dec; i > 0; --i) { tmp[i] = (char)('0' + fp % 10); fp /= 10; }
+        ob_raw(ob, tmp, (size_t)dec + 1);
+    }
+}
+
+// Quote and escape s as a JSON string into dst.
+static void json_quote(char *dst, size_t n, const char *s) {
+    size_t o = 0;
+    if (n < 3) { if (n) dst[0] = '\0'; return; }
+    dst[o++] = '"';
+    for (; *s && o + 8 < n; ++s) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') { dst[o++] = '\\'; dst[o++] = (char)c; }
+        else if (c < 0x20) o += (size_t)snprintf(dst + o, n - o, "\\u%04x", c);
+        else dst[o++] = (char)c;
+    }
+    dst[o++] = '"'; dst[o] = '\0';
+}
+
+/* NDJSON sample stream: one object per port and sample, plus one object per
+ * microburst as it ends and per port event. The constant part of each port's
+ * record is built once. */
+typedef struct {
+    obuf_t ob;
+    char (*prefix)[256];    // {"type":"sample","device":...,"port":N,
+    int n;
+    uint64_t bursts_written;
+    uint64_t events_written;
+} ndjson_t;
+
+static bool ndjson_open(ndjson_t *nj, int fd, const mon_dev_t *md, int n) {
+    memset(nj, 0, sizeof(*nj));
+    if (!ob_init(&nj->ob, fd, 1 << 16)) return false;
+    nj->prefix = calloc((size_t)n, sizeof(*nj->prefix));
+    if (!nj->prefix) return false;
+    nj->n = n;
+    nj->bursts_written = g_burst_count;
+    nj->events_written = g_event_count;
+    for (int i = 0; i < n; ++i) {
+        char q[200]; json_quote(q, sizeof(q), md[i].name);
+        snprintf(nj->prefix[i], sizeof(nj->prefix[i]), "{\"type\":\"sample\",\"device\":%s,\"port\":%d,\"data_words\":%s,",
+                 q, md[i].port, md[i].ctrs.data_is_words ? "true" : "false");
+    }
+    return true;
+}
+
+static void ndjson_close(ndjson_t *nj) {
+    ob_free(&nj->ob);
+    free(nj->prefix);
+    nj->prefix = NULL;
+}
+
+static void ndjson_u64(obuf_t *ob, const char *key, uint64_t v) { ob_str(ob, key); ob_u64(ob, v); }
+static void ndjson_fix(obuf_t *ob, const char *key, double v, int dec) { ob_str(ob, key); ob_fix(ob, v, dec); }
+
+// One record for port i, sampled at t_real (epoch seconds) / t_mono.
+static void ndjson_sample(ndjson_t *nj, int i, const mon_dev_t *md, double t_real, double t_mono) {
+    obuf_t *ob = &nj->ob;
+    ob_str(ob, nj->prefix[i]);
+    ndjson_fix(ob, "\"t\":", t_real, 6);
+    ndjson_fix(ob, ",\"mono\":", t_mono, 6);
+    ndjson_fix(ob, ",\"dt\":", md->dt, 6);
+    ndjson_u64(ob, ",\"rx_data\":", md->prev_rx_data);
+    ndjson_u64(ob, ",\"tx_data\":", md->prev_tx_data);
+    ndjson_u64(ob, ",\"rx_pkts\":", md->prev_rx_pkts);
+    ndjson_u64(ob, ",\"tx_pkts\":", md->prev_tx_pkts);
+    ndjson_u64(ob, ",\"d_rx_bytes\":", md->delta[0]);
+    ndjson_u64(ob, ",\"d_tx_bytes\":", md->delta[1]);
+    ndjson_u64(ob, ",\"d_rx_pkts\":", md->delta[2]);
+    ndjson_u64(ob, ",\"d_tx_pkts\":", md->delta[3]);
+    ndjson_fix(ob, ",\"rx_Bps\":", md->rx_Bps, 1);
+    ndjson_fix(ob, ",\"tx_Bps\":", md->tx_Bps, 1);
+    ndjson_fix(ob, ",\"rx_pps\":", md->rx_pps, 1);
+    ndjson_fix(ob, ",\"tx_pps\":", md->tx_pps, 1);
+    ob_raw(ob, "}\n", 2);
+}
+
+static void ndjson_bursts(ndjson_t *nj) {
+    obuf_t *ob = &nj->ob;
+    if (nj->bursts_written + BURST_LOG_CAP < g_burst_count) nj->bursts_written = g_burst_count - BURST_LOG_CAP;
+    for (; nj->bursts_written < g_burst_count; ++nj->bursts_written) {
+        const burst_ev_t *ev = &g_bursts[nj->bursts_written % BURST_LOG_CAP];
+        char q[200]; json_quote(q, sizeof(q), ev->dev);
+        ob_str(ob, "{\"type\":\"burst\",\"device\":"); ob_str(ob, q);
+        ndjson_u64(ob, ",\"port\":", (uint64_t)ev->port);
+        ob_str(ob, ev->dir ? ",\"dir\":\"tx\"" : ",\"dir\":\"rx\"");
+        ndjson_fix(ob, ",\"start\":", ev->start, 6);
+        ndjson_fix(ob, ",\"duration\":", ev->duration, 6);
+        ndjson_fix(ob, ",\"peak_Bps\":", ev->peak_Bps, 0);
+        ndjson_u64(ob, ",\"bytes\":", ev->bytes);
+        ob_raw(ob, "}\n", 2);
+    }
+}
+
+static void ndjson_events(ndjson_t *nj) {
+    obuf_t *ob = &nj->ob;
+    if (nj->events_written + EVENT_LOG_CAP < g_event_count) nj->events_written = g_event_count - EVENT_LOG_CAP;
+    for (; nj->events_written < g_event_count; ++nj->events_written) {
+        const port_ev_t *ev = &g_events[nj->events_written % EVENT_LOG_CAP];
+        char q[300];
+        ob_str(ob, "{\"type\":\"event\",\"event\":\""); ob_str(ob, port_ev_names[ev->kind]);
+        json_quote(q, sizeof(q), ev->dev); ob_str(ob, "\",\"device\":"); ob_str(ob, q);
+        ndjson_u64(ob, ",\"port\":", (uint64_t)ev->port);
+        ndjson_fix(ob, ",\"t\":", ev->real, 6);
+        ndjson_fix(ob, ",\"mono\":", ev->mono, 6);
+        json_quote(q, sizeof(q), ev->from); ob_str(ob, ",\"from\":"); ob_str(ob, q);
+        json_quote(q, sizeof(q), ev->to); ob_str(ob, ",\"to\":"); ob_str(ob, q);
+        ob_raw(ob, "}\n", 2);
+    }
+}
+
+
+// Append events logged since *written to an event log (CSV or NDJSON).
+static void event_log_flush(FILE *f, bool json, uint64_t *written) {
+    if (*written + EVENT_LOG_CAP < g_event_count) *written = g_event_count - EVENT_LOG_CAP;
+    for (; *written < g_event_count; ++*written) {
+        const port_ev_t *ev = &g_events[*written % EVENT_LOG_CAP];
+        if (!f) continue;
+        if (json) {
+            char d[300], a[140], b[140];
+            json_quote(d, sizeof(d), ev->dev); json_quote(a, sizeof(a), ev->from); json_quote(b, sizeof(b), ev->to);
+            fprintf(f, "{\"type\":\"event\",\"event\":\"%s\",\"device\":%s,\"port\":%d,\"t\":%.6f,\"mono\":%.6f,\"from\":%s,\"to\":%s}\n",
+                    port_ev_names[ev->kind], d, ev->port, ev->real, ev->mono, a, b);
+        } else {
+            fprintf(f, "%.6f,%.6f,%s,%d,%s,\"%s\",\"%s\"\n", ev->real, ev->mono, ev->dev, ev->port,
+                    port_ev_names[ev->kind], ev->from, ev->to);
+        }
+    }
+    if (f) fflush(f);
+}
+
+static FILE *event_log_open(const char *path, bool *json) {
+    size_t n = strlen(path);
+    *json = (n >= 5 && strcmp(path + n - 5, ".json") == 0) || (n >= 7 && strcmp(path + n - 7, ".ndjson") == 0);
+    FILE *f = fopen(path, "w");
+    if (!f) { fprintf(stderr, "Failed to open event log path: %s\n", path); return NULL; }
+    if (!*json) fprintf(f, "time_s,mono_s,device,port,event,from,to\n");
+    return f;
+}
+
+// Keys shared by all plot views: ',' '<' older, '.' '>' newer, '-' zoom out,
+// '+' '=' zoom in, 'l' back to live (at the --fps column width). Returns true if the key was consumed.
+static bool handle_view_key(int ch) {
+    uint64_t step = (uint64_t)(COLS > 8 ? COLS / 4 : 2) * (uint64_t)g_view.zoom;
+    switch (ch) {
+        case ',': case '<': case KEY_LEFT: g_view.offset += step; return true;
+        case '.': case '>': case KEY_RIGHT: g_view.offset = (g_view.offset > step) ? g_view.offset - step : 0; return true;
+        case '-': if (g_view.zoom < 4096) g_view.zoom *= 2; return true;
+        case '+': case '=': if (g_view.zoom > 1) g_view.zoom /= 2; return true;
+        case 'l': case 'L': g_view.offset = 0; g_view.zoom = g_view.zoom0; return true;
+        default: return false;
+    }
+}
+
+static bool view_is_live(void) { return g_view.offset == 0 && g_view.zoom == 1; }
+
+/* Render scheduler. The TUIs sample every interval but draw at most --fps
+ * frames per second, and skip a frame when nothing visible changed since the
+ * last one (no new sample, key or resize). When a frame spans several
+ * samples the live view plots one column per frame: the maximum of its
+ * samples with '=' at their mean, as when zoomed out. */
+typedef struct {
+    double period;          // seconds between frames, 0 = no cap
+    double next;            // monotonic time the next frame may be drawn
+    bool dirty;
+} frame_sched_t;
+
+// interval: seconds per sample, 0 if unknown (replay)
+static void frame_init(frame_sched_t *fs, double fps, double interval) {
+    fs->period = fps > 0 ? 1.0 / fps : 0.0;
+    fs->next = 0.0;
+    fs->dirty = true;
+    int spf = (fs->period > 0 && interval > 0) ? (int)floor(fs->period / interval + 0.5) : 1;
+    if (spf > 4096) spf = 4096;
+    if (spf > 1) g_view.zoom = g_view.zoom0 = spf;
+}
+
+// Something visible changed; input is drawn at once rather than at the next slot.
+static void frame_touch(frame_sched_t *fs, bool input) {
+    fs->dirty = true;
+    if (input) fs->next = 0.0;
+}
+
+// True if a frame should be drawn now; schedules the next one.
+static bool frame_due(frame_sched_t *fs, double now) {
+    if (!fs->dirty || now < fs->next) return false;
+    fs->dirty = false;
+    // keep the cadence unless we fell behind or were idle
+    fs->next = fs->next + fs->period > now ? fs->next + fs->period : now + fs->period;
+    return true;
+}
+
+// Milliseconds to wait for input before the pending frame is due, at most max_ms.
+static int frame_wait_ms(const frame_sched_t *fs, double now, int max_ms) {
+    if (!fs->dirty) return max_ms;
+    double ms = ceil((fs->next - now) * 1000.0);
+    return ms <= 0 ? 0 : (ms < max_ms ? (int)ms : max_ms);
+}
+
+// The plot state of a port, its ring refilled with the newest samples of the
+// store on first use. NULL if out of memory.
+static plot_state_t *mon_dev_plot(mon_dev_t *md) {
+    if (md->plot) return md->plot;
+    plot_state_t *ps = calloc(1, sizeof(*ps));
+    if (!ps) return NULL;
+    const hstore_t *hs = &md->hs;
+    uint64_t n = hs->seq_next - hstore_first_seq(hs);
+    if (n > HIST_CAP) n = HIST_CAP;
+    colagg_t *tmp = n ? malloc((size_t)n * sizeof(*tmp)) : NULL;
+    if (tmp) {
+        hstore_aggregate(hs, 1, hs->seq_next - n, hs->seq_next, hs->seq_next, tmp);
+        for (uint64_t i = 0; i < n; ++i) { ps->rx_hist[i] = tmp[i].max[0]; ps->tx_hist[i] = tmp[i].max[1]; }
+        ps->hist_len = (int)n;
+        free(tmp);
+    }
+    md->plot = ps;
+    md->chart[0].valid = md->chart[1].valid = false;
+    return ps;
+}
+
+static void mon_dev_plot_free(mon_dev_t *md) {
+    free(md->plot);
+    md->plot = NULL;
+}
+
+// Columns to plot for one direction (md->plot must exist): the live ring when
+// the view is at the newest sample, otherwise per-column max (return value)
+// and mean (*mean) from the column cache, falling back to the store for ranges
+// the cache lacks. *end is the sample (live) or column number just past the
+// last one returned.
+static const double *panel_series(mon_dev_t *md, int chan, int ncols, int *len, const double **mean,
+                                  uint64_t *end, char *tag, size_t taglen) {
+    static double smax[HS_CHANS][COL_CAP], smean[HS_CHANS][COL_CAP];
+    static colagg_t tmp[COL_CAP];
+    plot_state_t *ps = md->plot;
+    if (tag && taglen) tag[0] = '\0';
+    *mean = NULL;
+    if (view_is_live()) {
+        *len = ps->hist_len;
+        *end = md->hs.seq_next;
+        return (chan == 0 ? ps->rx_hist : ps->tx_hist) + ps->hist_off;
+    }
+    const hstore_t *hs = &md->hs;
+    colcache_t *cc = &ps->cols;
+    uint64_t zoom = (uint64_t)g_view.zoom;
+    uint64_t avail = hs->seq_next - hstore_first_seq(hs);
+    if (avail && g_view.offset >= avail) g_view.offset = avail - 1;
+    if (ncols > COL_CAP) ncols = COL_CAP;
+    if (cc->zoom != g_view.zoom) colcache_rebuild(cc, hs, g_view.zoom, COL_CAP / 2);
+
+    uint64_t end_seq = hs->seq_next - g_view.offset;
+    uint64_t c1 = (end_seq + zoom - 1) / zoom;
+    uint64_t cfirst = hstore_first_seq(hs) / zoom;
+    uint64_t c0 = (c1 > cfirst + (uint64_t)ncols) ? c1 - (uint64_t)ncols : cfirst;
+    int n = (int)(c1 - c0);
+    int64_t t_end = hstore_last_ms(hs);
+    if (cc->len && c0 >= cc->col0 && c1 <= cc->col0 + (uint64_t)cc->len) {
+        for (int k = 0; k < n; ++k) tmp[k] = cc->col[(cc->head + (int)(c0 - cc->col0) + k) % COL_CAP];
+        // the cached newest column may run past end_seq: cut it there, as the store path does
+        if (n && g_view.offset && end_seq % zoom) hstore_aggregate(hs, g_view.zoom, c1 - 1, c1, end_seq, &tmp[n - 1]);
+        colagg_t last;
+        if (g_view.offset) t_end = hstore_aggregate(hs, 1, end_seq - 1, end_seq, end_seq, &last);
+    } else {
+        t_end = hstore_aggregate(hs, g_view.zoom, c0, c1, end_seq, tmp);
+    }
+    for (int k = 0; k < n; ++k) {
+        smax[chan][k] = tmp[k].max[chan];
+        smean[chan][k] = tmp[k].n ? tmp[k].sum[chan] / tmp[k].n : 0.0;
+    }
+    *len = n;
+    *end = c1;
+    *mean = g_view.zoom > 1 ? smean[chan] : NULL; // a one-sample column is its own mean
+    if (tag && taglen) {
+        long ago = (long)((hstore_last_ms(hs) - t_end) / 1000);
+        if (g_view.offset == 0) snprintf(tag, taglen, " [x%d]", g_view.zoom);
+        else snprintf(tag, taglen, " [-%ldh%02ldm%02lds x%d]", ago / 3600, (ago / 60) % 60, ago % 60, g_view.zoom);
+    }
+    return smax[chan];
+}
+
+static bool mon_dev_open(mon_dev_t *md, const char *name, int port, double retention_s) {
+    snprintf(md->name, sizeof(md->name), "%s", name);
+    md->port = port;
+    hstore_init(&md->hs, retention_s);
+    pctl_reset(&md->rx_pct, now_realtime());
+    pctl_reset(&md->tx_pct, now_realtime());
+    md->tx_Bps = md->rx_Bps = md->tx_pps = md->rx_pps = 0.0;
+    if (!resolve_counters(name, port, &md->ctrs)) return false;
+    md->rate_gbps = parse_rate_gbps(md->ctrs.rate);
+    return true;
+}
+
+// Read the initial counter values that the first rate sample is measured against.
+static bool mon_dev_prime(mon_dev_t *md) {
+    bool ok = read_u64_file(md->ctrs.tx_data, &md->prev_tx_data)
+           && read_u64_file(md->ctrs.rx_data, &md->prev_rx_data)
+           && read_u64_file(md->ctrs.tx_pkts, &md->prev_tx_pkts)
+           && read_u64_file(md->ctrs.rx_pkts, &md->prev_rx_pkts);
+    md->prev_t = now_monotonic();
+    return ok;
+}
+
+static void mon_dev_close(mon_dev_t *md) {
+    mon_dev_plot_free(md);
+    twin_free(&md->sm.win);
+    twin_free(&md->burst.lng);
+    twin_free(&md->burst.shrt);
+    hstore_free(&md->hs);
+    free_counters(&md->ctrs);
+}
+
+static uint64_t counter_delta(uint64_t cur, uint64_t prev) {
+    return (cur >= prev) ? (cur - prev) : (cur + (UINT64_MAX - prev) + 1);
+}
+
+// Update rates from counter values read at `now` (live or replayed).
+static void mon_dev_apply(mon_dev_t *md, double now, uint64_t c_rxB, uint64_t c_txB, uint64_t c_rxp, uint64_t c_txp) {
+    double dt = now - md->prev_t; if (dt <= 0) dt = 1e-9;
+    uint64_t d_txB = counter_delta(c_txB, md->prev_tx_data);
+    uint64_t d_rxB = counter_delta(c_rxB, md->prev_rx_data);
+    uint64_t d_txp = counter_delta(c_txp, md->prev_tx_pkts);
+    uint64_t d_rxp = counter_delta(c_rxp, md->prev_rx_pkts);
+    if (md->ctrs.data_is_words) { d_txB *= 4; d_rxB *= 4; }
+    md->tx_Bps = (double)d_txB / dt; md->rx_Bps = (double)d_rxB / dt;
+    md->tx_pps = (double)d_txp / dt; md->rx_pps = (double)d_rxp / dt;
+    uint64_t d[4] = { d_rxB, d_txB, d_rxp, d_txp };
+    memcpy(md->delta, d, sizeof(d));
+    md->dt = dt;
+    smooth_update(&md->sm, dt, d);
+    burst_update(md, now, dt, d);
+    md->prev_tx_data = c_txB; md->prev_rx_data = c_rxB; md->prev_tx_pkts = c_txp; md->prev_rx_pkts = c_rxp;
+    md->prev_t = now;
+}
+
+// Read the data/packet counters and update rates. Leaves the previous rates
+// untouched if any counter could not be read.
+static bool mon_dev_sample(mon_dev_t *md, double now) {
+    uint64_t c_txB=0, c_rxB=0, c_txp=0, c_rxp=0;
+    if (!md->ctrs.tx_data) return false;
+    mon_dev_watch(md, now);
+    if (!read_u64_file(md->ctrs.tx_data, &c_txB) ||
+        !read_u64_file(md->ctrs.rx_data, &c_rxB) ||
+        !read_u64_file(md->ctrs.tx_pkts, &c_txp) ||
+        !read_u64_file(md->ctrs.rx_pkts, &c_rxp)) return false;
+    mon_dev_apply(md, now, c_rxB, c_txB, c_rxp, c_txp);
+    return true;
+}
+
+// Append the current rates to the compressed store and, while the port is
+// plotted, to the live ring.
+static void mon_dev_record(mon_dev_t *md, double now) {
+    plot_state_t *ps = md->plot;
+    if (ps) {
+        // the ring is twice the window, so the window is shifted back once every HIST_CAP samples
+        if (ps->hist_off + ps->hist_len == 2 * HIST_CAP) {
+            memmove(ps->rx_hist, ps->rx_hist + ps->hist_off, sizeof(double) * (size_t)ps->hist_len);
+            memmove(ps->tx_hist, ps->tx_hist + ps->hist_off, sizeof(double) * (size_t)ps->hist_len);
+            ps->hist_off = 0;
+        }
+        ps->rx_hist[ps->hist_off + ps->hist_len] = md->rx_Bps;
+        ps->tx_hist[ps->hist_off + ps->hist_len] = md->tx_Bps;
+        if (ps->hist_len < HIST_CAP) ps->hist_len++;
+        else ps->hist_off++;
+        wmax_push(&ps->rx_max, md->rx_Bps);
+        wmax_push(&ps->tx_max, md->tx_Bps);
+    }
+    pctl_add(&md->rx_pct, md->rx_Bps);
+    pctl_add(&md->tx_pct, md->tx_Bps);
+    double v[HS_CHANS] = { md->rx_Bps, md->tx_Bps };
+    if (hstore_append(&md->hs, now, v) && ps) colcache_push(&ps->cols, md->hs.seq_next - 1, v);
+}
+
+/* Binary sample log (see iblog.h): raw counters of every port per tick,
+ * delta/zigzag-varint encoded into checksummed blocks. A block is written
+ * when it nears BINLOG_BLOCK_BYTES or is older than BINLOG_BLOCK_SECS. */
+#define BINLOG_COUNTERS 4
+#define BINLOG_BLOCK_BYTES (64 * 1024)
+#define BINLOG_BLOCK_SECS 1.0
+
+typedef struct {
+    int fd;
+    int nports;
+    uint8_t *buf;           // block header + payload
+    size_t len, cap;
+    uint32_t nsamples;
+    uint64_t *prev;         // nports * BINLOG_COUNTERS values, reset per block
+    uint64_t mono_prev;
+    double t_block;         // monotonic time of the block's first sample
+    bool failed;
+} binlog_t;
+
+static const char *binlog_counter_names[BINLOG_COUNTERS] = {
+    "port_rcv_data", "port_xmit_data", "port_rcv_packets", "port_xmit_packets"
+};
+
+static bool binlog_write_all(binlog_t *bl, const uint8_t *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(bl->fd, p, n);
+        if (w < 0) { if (errno == EINTR) continue; bl->failed = true; return false; }
+        p += w; n -= (size_t)w;
+    }
+    return true;
+}
+
+static bool binlog_open(binlog_t *bl, const char *path, const mon_dev_t *md, int n) {
+    memset(bl, 0, sizeof(*bl));
+    bl->fd = -1;
+    if (n > IBLOG_MAX_PORTS) n = IBLOG_MAX_PORTS;
+    bl->nports = n;
+    bl->cap = IBLOG_BLOCK_HDR + (size_t)BINLOG_BLOCK_BYTES + 20 + (size_t)n * BINLOG_COUNTERS * 10;
+    bl->buf = (uint8_t *)malloc(bl->cap);
+    bl->prev = (uint64_t *)calloc((size_t)n * BINLOG_COUNTERS, sizeof(uint64_t));
+    size_t hcap = 16 + BINLOG_COUNTERS * 256 + (size_t)n * 264 + 4;
+    uint8_t *h = (uint8_t *)malloc(hcap);
+    if (!bl->buf || !bl->prev || !h) { free(h); fprintf(stderr, "Out of memory\n"); return false; }
+    size_t o = 0;
+    memcpy(h, IBLOG_MAGIC, 8); o = 8;
+    iblog_put16(h + o, IBLOG_VERSION); o += 2;
+    iblog_put16(h + o, BINLOG_COUNTERS); o += 2;
+    iblog_put16(h + o, (uint16_t)n); o += 2;
+    iblog_put16(h + o, 0); o += 2;
+    for (int c = 0; c < BINLOG_COUNTERS; ++c) {
+        size_t l = strlen(binlog_counter_names[c]);
+        h[o++] = (uint8_t)l; memcpy(h + o, binlog_counter_names[c], l); o += l;
+    }
+    for (int i = 0; i < n; ++i) {
+        size_t l = strnlen(md[i].name, 255);
+        h[o++] = (uint8_t)l; memcpy(h + o, md[i].name, l); o += l;
+        iblog_put16(h + o, (uint16_t)md[i].port); o += 2;
+        h[o++] = md[i].ctrs.data_is_words ? IBLOG_PORT_DATA_WORDS : 0;
+        iblog_put32(h + o, (uint32_t)llround(md[i].rate_gbps * 1000.0)); o += 4;
+    }
+    iblog_put32(h + o, iblog_crc32(0, h, o)); o += 4;
+    bl->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (bl->fd < 0) { fprintf(stderr, "Failed to open binary log %s: %s\n", path, strerror(errno)); free(h); return false; }
+    bool ok = binlog_write_all(bl, h, o);
+    free(h);
+    bl->len = IBLOG_BLOCK_HDR;
+    if (!ok) fprintf(stderr, "Failed to write binary log %s: %s\n", path, strerror(errno));
+    return ok;
+}
+
+static void binlog_flush(binlog_t *bl) {
+    if (bl->nsamples == 0 || bl->failed) { bl->len = IBLOG_BLOCK_HDR; bl->nsamples = 0; return; }
+    size_t plen = bl->len - IBLOG_BLOCK_HDR;
+    memcpy(bl->buf, IBLOG_BLOCK_MAGIC, 4);
+    iblog_put32(bl->buf + 4, (uint32_t)plen);
+    iblog_put32(bl->buf + 8, bl->nsamples);
+    iblog_put32(bl->buf + 12, iblog_crc32(0, bl->buf + IBLOG_BLOCK_HDR, plen));
+    binlog_write_all(bl, bl->buf, bl->len);
+    bl->len = IBLOG_BLOCK_HDR;
+    bl->nsamples = 0;
+}
+
+// Append one tick for all ports. Ports whose read failed repeat their last values.
+static void binlog_tick(binlog_t *bl, const mon_dev_t *md, double now, double now_real) {
+    if (bl->failed) return;
+    uint64_t mono_ns = (uint64_t)llround(now * 1e9);
+    if (bl->nsamples > 0 && now - bl->t_block >= BINLOG_BLOCK_SECS) binlog_flush(bl);
+    uint8_t *p = bl->buf + bl->len;
+    if (bl->nsamples == 0) {
+        p += iblog_put_varint(p, (uint64_t)llround(now_real * 1e9));
+        p += iblog_put_varint(p, mono_ns);
+        memset(bl->prev, 0, (size_t)bl->nports * BINLOG_COUNTERS * sizeof(uint64_t));
+        bl->t_block = now;
+    } else {
+        p += iblog_put_varint(p, mono_ns - bl->mono_prev);
+    }
+    bl->mono_prev = mono_ns;
+    for (int i = 0; i < bl->nports; ++i) {
+        const uint64_t v[BINLOG_COUNTERS] = { md[i].prev_rx_data, md[i].prev_tx_data, md[i].prev_rx_pkts, md[i].prev_tx_pkts };
+        uint64_t *pv = bl->prev + (size_t)i * BINLOG_COUNTERS;
+        for (int c = 0; c < BINLOG_COUNTERS; ++c) {
+            p += iblog_put_varint(p, iblog_zigzag((int64_t)(v[c] - pv[c])));
+            pv[c] = v[c];
+        }
+    }
+    bl->len = (size_t)(p - bl->buf);
+    bl->nsamples++;
+    if (bl->len >= IBLOG_BLOCK_HDR + BINLOG_BLOCK_BYTES) binlog_flush(bl);
+}
+
+static void binlog_close(binlog_t *bl) {
+    binlog_flush(bl);
+    if (bl->fd >= 0) close(bl->fd);
+    free(bl->buf);
+    free(bl->prev);
+    bl->fd = -1; bl->buf = NULL; bl->prev = NULL;
+}
+
+/* Arrow IPC stream output (--arrow): one record batch per `batch` ticks with a
+ * row per port and tick, readable by pyarrow, Polars, DuckDB and friends
+ * without parsing. Columns are filled in place as ticks arrive and go out
+ * with one writev() per batch; the few hundred bytes of FlatBuffers metadata
+ * per message are built by the small writer below. */
+#define ARROW_CONTINUATION 0xffffffffu
+#define ARROW_METADATA_V5 4
+#define ARROW_HDR_SCHEMA 1
+#define ARROW_HDR_RECORD_BATCH 3
+
+/* Minimal FlatBuffers writer. Objects are laid out front to back (vtable,
+ * table, then the objects the table refers to) and forward offsets are
+ * patched once their target is placed. Every scalar is aligned to its size
+ * relative to the start of the buffer, which sits 8-aligned in the file. */
+typedef struct {
+    uint8_t *b;
+    size_t len, cap;
+    bool failed;
+} fbw_t;
+
+typedef struct {
+    uint8_t slot;           // field id in the schema
+    uint8_t size;           // 1, 2, 4 or 8 bytes; 0 = offset, patched later via at
+    uint64_t v;
+    size_t at;              // out: position of the field
+} fbw_field_t;
+
+static size_t fbw_alloc(fbw_t *w, size_t n, size_t align, size_t skew) {
+    size_t pos = w->len;
+    while ((pos + skew) % align) pos++;
+    if (pos + n > w->cap) {
+        size_t cap = w->cap ? w->cap * 2 : 1024;
+        while (cap < pos + n) cap *= 2;
+        uint8_t *nb = realloc(w->b, cap);
+        if (!nb) { w->failed = true; return 0; }
+        w->b = nb; w->cap = cap;
+    }
+    memset(w->b + w->len, 0, pos + n - w->len);
+    w->len = pos + n;
+    return pos;
+}
+
+static void fbw_put(fbw_t *w, size_t at, uint64_t v, int size) {
+    if (w->failed) return;
+    for (int i = 0; i < size; ++i) w->b[at + (size_t)i] = (uint8_t)(v >> (8 * i));
+}
+
+// Point the offset field at `at` to the object at `target`.
+static void fbw_patch(fbw_t *w, size_t at, size_t target) { fbw_put(w, at, target - at, 4); }
+
+// A table with the given fields (a vtable of nslots entries); returns its position.
+static size_t fbw_table(fbw_t *w, int nslots, fbw_field_t *f, int nf) {
+    size_t vt = fbw_alloc(w, 4 + 2 * (size_t)nslots, 2, 0);
+    size_t t = fbw_alloc(w, 4, 4, 0);
+    for (int sz = 8; sz >= 1; sz /= 2) // widest first keeps the padding small
+        for (int i = 0; i < nf; ++i) {
+            int fs = f[i].size ? f[i].size : 4;
+            if (fs != sz) continue;
+            f[i].at = fbw_alloc(w, (size_t)fs, (size_t)fs, 0);
+            if (f[i].size) fbw_put(w, f[i].at, f[i].v, fs);
+            fbw_put(w, vt + 4 + 2 * (size_t)f[i].slot, f[i].at - t, 2);
+        }
+    fbw_put(w, vt, 4 + 2 * (uint64_t)nslots, 2);
+    fbw_put(w, vt + 2, w->len - t, 2);
+    fbw_put(w, t, t - vt, 4);
+    return t;
+}
+
+static size_t fbw_string(fbw_t *w, const char *s) {
+    size_t n = strlen(s), at = fbw_alloc(w, 4 + n + 1, 4, 0);
+    fbw_put(w, at, n, 4);
+    if (!w->failed) memcpy(w->b + at + 4, s, n);
+    return at;
+}
+
+// A vector of n elements of elem_size bytes (4 for offsets); elements start at pos + 4.
+static size_t fbw_vector(fbw_t *w, size_t n, size_t elem_size) {
+    size_t align = elem_size < 4 ? 4 : elem_size;
+    size_t at = fbw_alloc(w, 4 + n * elem_size, align, 4);
+    fbw_put(w, at, n, 4);
+    return at;
+}
+
+// Root offset plus Message { version, header_type, header, bodyLength }; returns the header field position.
+static size_t fbw_message(fbw_t *w, int header_type, uint64_t body_len) {
+    w->len = 0;
+    size_t root = fbw_alloc(w, 4, 4, 0);
+    fbw_field_t f[] = { { 0, 2, ARROW_METADATA_V5, 0 }, { 1, 1, (uint64_t)header_type, 0 }, { 2, 0, 0, 0 }, { 3, 8, body_len, 0 } };
+    fbw_patch(w, root, fbw_table(w, 5, f, 4));
+    return f[2].at;
+}
+
+enum { ARROW_TS, ARROW_INT, ARROW_FLOAT, ARROW_UTF8 };
+#define ARROW_NCOLS 12
+
+static const struct { const char *name; int type; int bits; bool is_signed; } arrow_cols[ARROW_NCOLS] = {
+    { "time", ARROW_TS, 64, true },            // wall clock, ns since the epoch (UTC)
+    { "mono_ns", ARROW_INT, 64, true },        // CLOCK_MONOTONIC
+    { "device", ARROW_UTF8, 0, false },
+    { "port", ARROW_INT, 16, false },
+    { "rx_bytes", ARROW_INT, 64, false },      // cumulative counters (data in bytes)
+    { "tx_bytes", ARROW_INT, 64, false },
+    { "rx_pkts", ARROW_INT, 64, false },
+    { "tx_pkts", ARROW_INT, 64, false },
+    { "rx_Bps", ARROW_FLOAT, 64, true },       // rates over the last interval
+    { "tx_Bps", ARROW_FLOAT, 64, true },
+    { "rx_pps", ARROW_FLOAT, 64, true },
+    { "tx_pps", ARROW_FLOAT, 64, true },
+};
+
+typedef struct {
+    int fd;
+    int nports, batch;      // rows per batch = nports * batch ticks
+    int ticks;              // ticks in the current batch
+    uint8_t *col[ARROW_NCOLS];  // fixed-width values; for device the int32 offsets
+    char *names;            // device column data of one tick
+    int32_t *name_end;      // per port: end of its name within names
+    char *dev;              // device column data of the batch
+    fbw_t meta;
+    bool failed;
+} arrow_t;
+
+static bool arrow_write_all(arrow_t *aw, struct iovec *iov, int n) {
+    while (n > 0 && !aw->failed) {
+        ssize_t w = writev(aw->fd, iov, n > IOV_MAX ? IOV_MAX : n);
+        if (w < 0) { if (errno == EINTR) continue; aw->failed = true; break; }
+        while (n > 0 && (size_t)w >= iov->iov_len) { w -= (ssize_t)iov->iov_len; iov++; n--; }
+        if (n > 0) { iov->iov_base = (char *)iov->iov_base + w; iov->iov_len -= (size_t)w; }
+    }
+    return !aw->failed;
+}
+
+// Write the metadata in aw->meta as one message whose body is `body`.
+static void arrow_message(arrow_t *aw, struct iovec *body, int nbody) {
+    static const uint8_t zeros[8];
+    uint32_t pre[2] = { ARROW_CONTINUATION, 0 };
+    size_t meta_len = aw->meta.len, pad = (8 - meta_len % 8) % 8;
+    pre[1] = (uint32_t)(meta_len + pad);
+    struct iovec iov[3 + 4 * ARROW_NCOLS];
+    int n = 0;
+    iov[n++] = (struct iovec){ pre, sizeof(pre) };
+    iov[n++] = (struct iovec){ aw->meta.b, meta_len };
+    if (pad) iov[n++] = (struct iovec){ (void *)zeros, pad };
+    for (int i = 0; i < nbody; ++i) iov[n++] = body[i];
+    if (aw->meta.failed) aw->failed = true;
+    else arrow_write_all(aw, iov, n);
+}
+
+static void arrow_schema(arrow_t *aw) {
+    fbw_t *w = &aw->meta;
+    size_t hdr = fbw_message(w, ARROW_HDR_SCHEMA, 0);
+    fbw_field_t sf[] = { { 0, 2, 0, 0 }, { 1, 0, 0, 0 } }; // little endian, fields
+    fbw_patch(w, hdr, fbw_table(w, 4, sf, 2));
+    size_t vec = fbw_vector(w, ARROW_NCOLS, 4);
+    fbw_patch(w, sf[1].at, vec);
+    for (int c = 0; c < ARROW_NCOLS; ++c) {
+        static const uint8_t type_ids[] = { [ARROW_TS] = 10, [ARROW_INT] = 2, [ARROW_FLOAT] = 3, [ARROW_UTF8] = 5 };
+        // Field { name, nullable, type_type, type, children }
+        fbw_field_t ff[] = { { 0, 0, 0, 0 }, { 1, 1, 0, 0 }, { 2, 1, type_ids[arrow_cols[c].type], 0 }, { 3, 0, 0, 0 }, { 5, 0, 0, 0 } };
+        fbw_patch(w, vec + 4 + 4 * (size_t)c, fbw_table(w, 7, ff, 5));
+        fbw_patch(w, ff[0].at, fbw_string(w, arrow_cols[c].name));
+        size_t type;
+        if (arrow_cols[c].type == ARROW_TS) {
+            fbw_field_t tf[] = { { 0, 2, 3, 0 }, { 1, 0, 0, 0 } }; // NANOSECOND, timezone
+            type = fbw_table(w, 2, tf, 2);
+            fbw_patch(w, tf[1].at, fbw_string(w, "UTC"));
+        } else if (arrow_cols[c].type == ARROW_INT) {
+            fbw_field_t tf[] = { { 0, 4, (uint64_t)arrow_cols[c].bits, 0 }, { 1, 1, arrow_cols[c].is_signed, 0 } };
+            type = fbw_table(w, 2, tf, 2);
+        } else if (arrow_cols[c].type == ARROW_FLOAT) {
+            fbw_field_t tf[] = { { 0, 2, 2, 0 } }; // DOUBLE
+            type = fbw_table(w, 1, tf, 1);
+        } else {
+            type = fbw_table(w, 0, NULL, 0);
+        }
+        fbw_patch(w, ff[3].at, type);
+        fbw_patch(w, ff[4].at, fbw_vector(w, 0, 4));
+    }
+    arrow_message(aw, NULL, 0);
+}
+
+static size_t arrow_width(int c) { return arrow_cols[c].type == ARROW_UTF8 ? 4 : (size_t)arrow_cols[c].bits / 8; }
+
+static arrow_t *arrow_open(const char *path, const mon_dev_t *md, int n, int batch) {
+    arrow_t *aw = calloc(1, sizeof(*aw));
+    if (!aw) return NULL;
+    aw->nports = n; aw->batch = batch;
+    size_t rows = (size_t)n * (size_t)batch, names_len = 0;
+    for (int i = 0; i < n; ++i) names_len += strlen(md[i].name);
+    aw->names = malloc(names_len + 1);
+    aw->name_end = malloc((size_t)n * sizeof(int32_t));
+    aw->dev = malloc(names_len * (size_t)batch + 1);
+    bool ok = aw->names && aw->name_end && aw->dev && names_len * (size_t)batch < INT32_MAX;
+    for (int c = 0; c < ARROW_NCOLS && ok; ++c)
+        ok = (aw->col[c] = malloc((rows + 1) * arrow_width(c))) != NULL;
+    if (!ok) { fprintf(stderr, "Arrow output: out of memory\n"); aw->fd = -1; goto fail; }
+    size_t o = 0;
+    for (int i = 0; i < n; ++i) {
+        size_t l = strlen(md[i].name);
+        memcpy(aw->names + o, md[i].name, l); o += l;
+        aw->name_end[i] = (int32_t)o;
+    }
+    aw->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (aw->fd < 0) { fprintf(stderr, "Failed to open Arrow output %s: %s\n", path, strerror(errno)); goto fail; }
+    arrow_schema(aw);
+    if (!aw->failed) return aw;
+    fprintf(stderr, "Failed to write Arrow output %s: %s\n", path, strerror(errno));
+fail:
+    if (aw->fd >= 0) close(aw->fd);
+    for (int c = 0; c < ARROW_NCOLS; ++c) free(aw->col[c]);
+    free(aw->names); free(aw->name_end); free(aw->dev); free(aw->meta.b); free(aw);
+    return NULL;
+}
+
+// Emit the rows collected so far as one record batch.
+static void arrow_flush(arrow_t *aw) {
+    if (aw->ticks == 0 || aw->failed) { aw->ticks = 0; return; }
+    static const uint8_t zeros[8];
+    size_t rows = (size_t)aw->nports * (size_t)aw->ticks;
+    int32_t names_len = aw->nports ? aw->name_end[aw->nports - 1] : 0;
+    // buffers: per column a validity bitmap (empty: no nulls) and the values,
+    // plus the string data of the device column
+    uint64_t boff[3 * ARROW_NCOLS], blen[3 * ARROW_NCOLS];
+    struct iovec body[4 * ARROW_NCOLS];
+    int nb = 0, ni = 0;
+    uint64_t off = 0;
+    for (int c = 0; c < ARROW_NCOLS; ++c) {
+        boff[nb] = off; blen[nb++] = 0;
+        const void *data[2] = { aw->col[c], aw->dev };
+        size_t len[2] = { (rows + (arrow_cols[c].type == ARROW_UTF8)) * arrow_width(c), (size_t)names_len * (size_t)aw->ticks };
+        for (int k = 0; k < (arrow_cols[c].type == ARROW_UTF8 ? 2 : 1); ++k) {
+            size_t pad = (8 - len[k] % 8) % 8;
+            boff[nb] = off; blen[nb++] = len[k];
+            body[ni++] = (struct iovec){ (void *)data[k], len[k] };
+            if (pad) body[ni++] = (struct iovec){ (void *)zeros, pad };
+            off += len[k] + pad;
+        }
+    }
+    fbw_t *w = &aw->meta;
+    size_t hdr = fbw_message(w, ARROW_HDR_RECORD_BATCH, off);
+    fbw_field_t rf[] = { { 0, 8, rows, 0 }, { 1, 0, 0, 0 }, { 2, 0, 0, 0 } }; // length, nodes, buffers
+    fbw_patch(w, hdr, fbw_table(w, 5, rf, 3));
+    size_t nodes = fbw_vector(w, ARROW_NCOLS, 16);
+    fbw_patch(w, rf[1].at, nodes);
+    for (int c = 0; c < ARROW_NCOLS; ++c) {
+        fbw_put(w, nodes + 4 + 16 * (size_t)c, rows, 8); // length; null_count stays 0
+    }
+    size_t bufs = fbw_vector(w, (size_t)nb, 16);
+    fbw_patch(w, rf[2].at, bufs);
+    for (int b = 0; b < nb; ++b) {
+        fbw_put(w, bufs + 4 + 16 * (size_t)b, boff[b], 8);
+        fbw_put(w, bufs + 12 + 16 * (size_t)b, blen[b], 8);
+    }
+    arrow_message(aw, body, ni);
+    aw->ticks = 0;
+}
+
+// Append one row per port; a full batch is written out.
+static void arrow_tick(arrow_t *aw, const mon_dev_t *md, double now, double now_real) {
+    if (aw->failed) return;
+    size_t r0 = (size_t)aw->nports * (size_t)aw->ticks;
+    int32_t names_len = aw->nports ? aw->name_end[aw->nports - 1] : 0, base = names_len * aw->ticks;
+    int64_t t = llround(now_real * 1e9), mono = llround(now * 1e9);
+    memcpy(aw->dev + base, aw->names, (size_t)names_len);
+    int32_t *doff = (int32_t *)aw->col[2];
+    if (r0 == 0) doff[0] = 0;
+    for (int i = 0; i < aw->nports; ++i) {
+        size_t r = r0 + (size_t)i;
+        uint64_t mul = md[i].ctrs.data_is_words ? 4 : 1;
+        ((int64_t *)aw->col[0])[r] = t;
+        ((int64_t *)aw->col[1])[r] = mono;
+        doff[r + 1] = base + aw->name_end[i];
+        ((uint16_t *)aw->col[3])[r] = (uint16_t)md[i].port;
+        ((uint64_t *)aw->col[4])[r] = md[i].prev_rx_data * mul;
+        ((uint64_t *)aw->col[5])[r] = md[i].prev_tx_data * mul;
+        ((uint64_t *)aw->col[6])[r] = md[i].prev_rx_pkts;
+        ((uint64_t *)aw->col[7])[r] = md[i].prev_tx_pkts;
+        ((double *)aw->col[8])[r] = md[i].rx_Bps;
+        ((double *)aw->col[9])[r] = md[i].tx_Bps;
+        ((double *)aw->col[10])[r] = md[i].rx_pps;
+        ((double *)aw->col[11])[r] = md[i].tx_pps;
+    }
+    if (++aw->ticks == aw->batch) arrow_flush(aw);
+}
+
+static void arrow_close(arrow_t *aw) {
+    if (!aw) return;
+    arrow_flush(aw);
+    uint32_t eos[2] = { ARROW_CONTINUATION, 0 };
+    struct iovec iov = { eos, sizeof(eos) };
+    arrow_write_all(aw, &iov, 1);
+    if (aw->failed) fprintf(stderr, "Arrow output: write failed, the file is incomplete\n");
+    close(aw->fd);
+    for (int c = 0; c < ARROW_NCOLS; ++c) free(aw->col[c]);
+    free(aw->names); free(aw->name_end); free(aw->dev); free(aw->meta.b); free(aw);
+}
+
+/* Asynchronous CSV writer. The sampler appends whole rows to a bounded byte
+ * ring and never touches the file; a writer thread drains the ring in large
+ * blocks, rotates the file by age or size and optionally paces writeback with
+ * sync_file_range(). When the ring is full the rows are dropped and counted
+ * instead of stalling sampling. */
+#define CSVW_RING_BYTES (4u << 20)
+#define CSVW_BLOCK_BYTES (256u << 10)
+#define CSVW_FLUSH_SECS 1.0
+
+typedef struct {
+    char path[PATH_MAX];
+    char *header;           // written at the top of every new file (NULL: none)
+    int fd;
+    double rotate_secs;     // 0: no time-based rotation
+    uint64_t rotate_bytes;  // 0: no size-based rotation
+    bool sync;              // pace writeback with sync_file_range
+    time_t file_t0;         // realtime the current file was opened
+    uint64_t file_bytes;
+    uint64_t synced;        // writeback issued up to this offset
+    uint64_t prev_synced;   // ... and the previous block started here
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    char *ring;
+    size_t head, len;       // ring read position and fill
+    bool stop;
+    uint64_t dropped;       // rows rejected because the ring was full
+    bool failed;            // a write failed; the writer gave up
+} csvw_t;
+
+static bool csvw_reopen(csvw_t *w, bool append, bool header) {
+    w->fd = open(w->path, O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0644);
+    if (w->fd < 0) return false;
+    struct stat st;
+    w->file_bytes = (fstat(w->fd, &st) == 0) ? (uint64_t)st.st_size : 0;
+    w->synced = w->prev_synced = w->file_bytes;
+    w->file_t0 = time(NULL);
+    if (header && w->header) {
+        size_t n = strlen(w->header);
+        if (write(w->fd, w->header, n) == (ssize_t)n) w->file_bytes += n;
+    }
+    return true;
+}
+
+// Close the current file as PATH.YYYYmmdd-HHMMSS (its start time) and start a new one.
+static void csvw_rotate(csvw_t *w) {
+    char stamp[32], dst[PATH_MAX + 40];
+    struct tm tm;
+    localtime_r(&w->file_t0, &tm);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+    snprintf(dst, sizeof(dst), "%s.%s", w->path, stamp);
+    for (int k = 1; access(dst, F_OK) == 0 && k < 1000; ++k) // several rotations within a second
+        snprintf(dst, sizeof(dst), "%s.%s-%d", w->path, stamp, k);
+    close(w->fd);
+    if (rename(w->path, dst) != 0) { w->failed = true; w->fd = -1; return; }
+    if (!csvw_reopen(w, false, true)) w->failed = true;
+}
+
+static void csvw_write_block(csvw_t *w, const char *buf, size_t n) {
+    if (w->rotate_bytes && w->file_bytes > 0 && w->file_bytes + n > w->rotate_bytes) csvw_rotate(w);
+    else if (w->rotate_secs > 0 && difftime(time(NULL), w->file_t0) >= w->rotate_secs) csvw_rotate(w);
+    if (w->failed) return;
+    for (size_t off = 0; off < n; ) {
+        ssize_t r = write(w->fd, buf + off, n - off);
+        if (r < 0) { if (errno == EINTR) continue; w->failed = true; return; }
+        off += (size_t)r;
+    }
+    w->file_bytes += n;
+    if (w->sync) {
+        // start writeback of the new block and wait for the previous one, so
+        // dirty pages never pile up into one long stall
+        sync_file_range(w->fd, (off_t)w->synced, (off_t)(w->file_bytes - w->synced), SYNC_FILE_RANGE_WRITE);
+        if (w->synced > w->prev_synced)
+            sync_file_range(w->fd, (off_t)w->prev_synced, (off_t)(w->synced - w->prev_synced),
+                            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        w->prev_synced = w->synced;
+        w->synced = w->file_bytes;
+    }
+}
+
+static void *csvw_thread(void *arg) {
+    csvw_t *w = arg;
+    char *block = malloc(CSVW_BLOCK_BYTES);
+    if (!block) { w->failed = true; return NULL; }
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        // wait for a full block, the flush interval, or shutdown
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts); // cond is on CLOCK_MONOTONIC (csvw_open)
+        ts.tv_sec += (time_t)CSVW_FLUSH_SECS;
+        while (!w->stop && w->len < CSVW_BLOCK_BYTES)
+            if (pthread_cond_timedwait(&w->cond, &w->lock, &ts) == ETIMEDOUT) break;
+        bool stop = w->stop;
+        while (w->len > 0) {
+            size_t n = w->len < CSVW_BLOCK_BYTES ? w->len : CSVW_BLOCK_BYTES;
+            size_t first = CSVW_RING_BYTES - w->head;
+            if (first > n) first = n;
+            memcpy(block, w->ring + w->head, first);
+            memcpy(block + first, w->ring, n - first);
+            // rotation must fall on a row boundary
+            size_t cut = n;
+            if (n < w->len) { while (cut > 0 && block[cut - 1] != '\n') --cut; if (cut == 0) cut = n; }
+            w->head = (w->head + cut) % CSVW_RING_BYTES;
+            w->len -= cut;
+            pthread_mutex_unlock(&w->lock);
+            if (!w->failed) csvw_write_block(w, block, cut);
+            pthread_mutex_lock(&w->lock);
+            if (w->len < CSVW_BLOCK_BYTES && !stop) break;
+        }
+        if (stop) break;
+    }
+    pthread_mutex_unlock(&w->lock);
+    free(block);
+    return NULL;
+}
+
+// `header` starts every rotated file; the first file gets it only if `header_now`.
+static csvw_t *csvw_open(const char *path, bool append, const char *header, bool header_now,
+                         double rotate_secs, uint64_t rotate_bytes, bool sync) {
+    csvw_t *w = calloc(1, sizeof(*w));
+    if (!w) return NULL;
+    snprintf(w->path, sizeof(w->path), "%s", path);
+    w->header = header ? strdup(header) : NULL;
+    w->rotate_secs = rotate_secs; w->rotate_bytes = rotate_bytes; w->sync = sync;
+    w->ring = malloc(CSVW_RING_BYTES);
+    if (!w->ring || !csvw_reopen(w, append, header_now)) {
+        free(w->ring); free(w->header); free(w);
+        return NULL;
+    }
+    pthread_mutex_init(&w->lock, NULL);
+    // flush deadlines must not move with wall-clock steps
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_init(&w->cond, &ca);
+    pthread_condattr_destroy(&ca);
+    if (pthread_create(&w->thread, NULL, csvw_thread, w) != 0) {
+        close(w->fd); free(w->ring); free(w->header); free(w);
+        return NULL;
+    }
+    return w;
+}
+
+// Queue `nrows` complete rows. Never blocks on I/O; drops them if the ring is full.
+static bool csvw_write(csvw_t *w, const char *buf, size_t n, unsigned nrows) {
+    pthread_mutex_lock(&w->lock);
+    bool ok = n <= CSVW_RING_BYTES - w->len;
+    if (ok) {
+        size_t tail = (w->head + w->len) % CSVW_RING_BYTES;
+        size_t first = CSVW_RING_BYTES - tail;
+        if (first > n) first = n;
+        memcpy(w->ring + tail, buf, first);
+        memcpy(w->ring, buf + first, n - first);
+        w->len += n;
+        if (w->len >= CSVW_BLOCK_BYTES) pthread_cond_signal(&w->cond);
+    } else {
+        w->dropped += nrows;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return ok;
+}
+
+static uint64_t csvw_dropped(csvw_t *w) {
+    pthread_mutex_lock(&w->lock);
+    uint64_t d = w->dropped;
+    pthread_mutex_unlock(&w->lock);
+    return d;
+}
+
+// Drain the ring, stop the writer and report losses on stderr.
+static void csvw_close(csvw_t *w) {
+    if (!w) return;
+    pthread_mutex_lock(&w->lock);
+    w->stop = true;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+    if (w->fd >= 0) close(w->fd);
+    if (w->dropped) fprintf(stderr, "CSV: dropped %" PRIu64 " row(s) because %s could not keep up\n", w->dropped, w->path);
+    if (w->failed) fprintf(stderr, "CSV: writing %s failed\n", w->path);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+    free(w->ring); free(w->header); free(w);
+}
+
+// --csv-rotate: a duration (30m, 1h, 1d) or a size with an upper-case unit (500M, 2G, 100KB).
+static bool parse_rotate(const char *s, double *secs, uint64_t *bytes) {
+    char *end = NULL;
+    double v = strtod(s, &end);
+    if (end == s || v <= 0) return false;
+    double mul = 0;
+    if (*end == 'K') mul = 1024.0;
+    else if (*end == 'M') mul = 1024.0 * 1024.0;
+    else if (*end == 'G') mul = 1024.0 * 1024.0 * 1024.0;
+    else if (*end == 'B') mul = 1.0;
+    if (mul > 0) {
+        if (*++end == 'B' && mul > 1.0) ++end;
+        if (*end) return false;
+        *bytes = (uint64_t)(v * mul); *secs = 0;
+        return true;
+    }
+    *secs = parse_duration(s); *bytes = 0;
+    return *secs > 0;
+}
+
+/* CSV rows for one tick. `long` has one row per port, `wide` one row with a
+ * column group per port, `single` is the original one-port layout. Either
+ * way a tick is queued with one csvw_write() and every port shares the
+ * tick's timestamp. */
+static char *csv_header(const mon_dev_t *md, int n, csv_layout_t layout) {
+    if (layout == CSV_SINGLE) return strdup("time_s,rx_Bps,tx_Bps,rx_pps,tx_pps\n");
+    if (layout == CSV_LONG) return strdup("time_s,device,port,rx_Bps,tx_Bps,rx_pps,tx_pps\n");
+    size_t cap = 16 + (size_t)n * (4 * 160), o = 0;
+    char *h = malloc(cap);
+    if (!h) return NULL;
+    o += (size_t)snprintf(h, cap, "time_s");
+    for (int i = 0; i < n; ++i) {
+        static const char *col[4] = { "rx_Bps", "tx_Bps", "rx_pps", "tx_pps" };
+        for (int k = 0; k < 4; ++k)
+            o += (size_t)snprintf(h + o, cap - o, ",%s:%d:%s", md[i].name, md[i].port, col[k]);
+    }
+    snprintf(h + o, cap - o, "\n");
+    return h;
+}
+
+// Bytes needed for one tick's rows.
+// Room for one tick: the timestamp, each port's name and number, and four
+// rates of up to 32 digits each (larger ones make csv_rows() drop the tick).
+static size_t csv_rows_cap(const mon_dev_t *md, int n) {
+    size_t cap = 64;
+    for (int i = 0; i < n; ++i) cap += strlen(md[i].name) + 48 + 4 * 32;
+    return cap;
+}
+
+// Format one tick into buf. Returns its length, or 0 if it did not fit
+// (snprintf reports the untruncated length, so o is checked before each call).
+static size_t csv_rows(char *buf, size_t cap, const mon_dev_t *md, int n, csv_layout_t layout,
+                       metric_t metric, double now) {
+    size_t o = 0;
+    if (layout != CSV_LONG) o += (size_t)snprintf(buf, cap, "%.6f", now);
+    for (int i = 0; i < n; ++i) {
+        if (o >= cap) return 0;
+        double r[4]; mon_dev_rates(&md[i], metric, r);
+        if (layout == CSV_LONG)
+            o += (size_t)snprintf(buf + o, cap - o, "%.6f,%s,%d,%.0f,%.0f,%.0f,%.0f\n",
+                                  now, md[i].name, md[i].port, r[0], r[1], r[2], r[3]);
+        else
+            o += (size_t)snprintf(buf + o, cap - o, ",%.0f,%.0f,%.0f,%.0f", r[0], r[1], r[2], r[3]);
+    }
+    if (o >= cap) return 0;
+    if (layout != CSV_LONG) o += (size_t)snprintf(buf + o, cap - o, "\n");
+    return o < cap ? o : 0;
+}
+
+/* Latest per-port values as published by the sampler for consumers on other
+ * threads. Data counters are converted to bytes. */
+typedef struct {
+    uint64_t rx_bytes, tx_bytes, rx_pkts, tx_pkts;
+    double rx_Bps, tx_Bps, rx_pps, tx_pps;
+    double link_Bps;        // current link rate, 0 if unknown
+    double t;               // realtime of the sample, 0 before the first one
+} port_snap_t;
+
+static void port_snap_fill(port_snap_t *ps, const mon_dev_t *md, double now_real) {
+    uint64_t mul = md->ctrs.data_is_words ? 4 : 1;
+    ps->rx_bytes = md->prev_rx_data * mul; ps->tx_bytes = md->prev_tx_data * mul;
+    ps->rx_pkts = md->prev_rx_pkts; ps->tx_pkts = md->prev_tx_pkts;
+    ps->rx_Bps = md->rx_Bps; ps->tx_Bps = md->tx_Bps;
+    ps->rx_pps = md->rx_pps; ps->tx_pps = md->tx_pps;
+    ps->link_Bps = md->rate_gbps * 1e9 / 8.0; // mon_dev_watch() follows speed changes
+    ps->t = now_real;
+}
+
+/* Prometheus exporter (--listen). A thread runs a small non-blocking HTTP/1.1
+ * responder on epoll. The sampler only copies its values into `snap` under the
+ * lock; a scrape copies them out and renders the text format into a reused
+ * buffer, so scrapes never touch sysfs and never wait for a sample. */
+#define PROM_MAX_CONN 32
+#define PROM_REQ_MAX 4096
+#define PROM_IDLE_SECS 10.0
+
+typedef struct {
+    int fd;                 // -1: free slot
+    char req[PROM_REQ_MAX];
+    size_t req_len;
+    char *out;              // unsent part of the response
+    size_t out_len, out_off;
+    double t_open;
+} prom_conn_t;
+
+typedef struct {
+    int lfd, epfd, evfd;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    int n;
+    char (*labels)[300];    // {device="...",port="N"}
+    port_snap_t *snap;      // written by the sampler under lock
+    port_snap_t *copy;      // scrape-side copy
+    uint64_t scrapes;
+    obuf_t body;            // reused for every scrape
+    prom_conn_t conn[PROM_MAX_CONN];
+} prom_t;
+
+// Prometheus label value escaping: backslash, quote and newline.
+static void prom_label_escape(char *dst, size_t n, const char *s) {
+    size_t o = 0;
+    for (; *s && o + 3 < n; ++s) {
+        if (*s == '\\' || *s == '"') { dst[o++] = '\\'; dst[o++] = *s; }
+        else if (*s == '\n') { dst[o++] = '\\'; dst[o++] = 'n'; }
+        else dst[o++] = *s;
+    }
+    dst[o] = '\0';
+}
+
+static void prom_render(prom_t *p) {
+    pthread_mutex_lock(&p->lock);
+    memcpy(p->copy, p->snap, (size_t)p->n * sizeof(port_snap_t));
+    uint64_t scrapes = ++p->scrapes;
+    pthread_mutex_unlock(&p->lock);
+
+    static const struct { const char *name, *type, *help; size_t off; bool is_u64; } fam[] = {
+        { "ibmon_port_receive_bytes_total", "counter", "Bytes received (port_rcv_data in bytes).", offsetof(port_snap_t, rx_bytes), true },
+        { "ibmon_port_transmit_bytes_total", "counter", "Bytes transmitted (port_xmit_data in bytes).", offsetof(port_snap_t, tx_bytes), true },
+        { "ibmon_port_receive_packets_total", "counter", "Packets received.", offsetof(port_snap_t, rx_pkts), true },
+        { "ibmon_port_transmit_packets_total", "counter", "Packets transmitted.", offsetof(port_snap_t, tx_pkts), true },
+        { "ibmon_port_receive_bytes_per_second", "gauge", "Receive rate over the last sampling interval.", offsetof(port_snap_t, rx_Bps), false },
+        { "ibmon_port_transmit_bytes_per_second", "gauge", "Transmit rate over the last sampling interval.", offsetof(port_snap_t, tx_Bps), false },
+        { "ibmon_port_receive_packets_per_second", "gauge", "Receive packet rate over the last sampling interval.", offsetof(port_snap_t, rx_pps), false },
+        { "ibmon_port_transmit_packets_per_second", "gauge", "Transmit packet rate over the last sampling interval.", offsetof(port_snap_t, tx_pps), false },
+        { "ibmon_port_last_sample_timestamp_seconds", "gauge", "Wall-clock time of the last sample.", offsetof(port_snap_t, t), false },
+    };
+    obuf_t *ob = &p->body;
+    ob->len = 0; ob->failed = false;
+    for (size_t f = 0; f < sizeof(fam) / sizeof(fam[0]); ++f) {
+        ob_str(ob, "# HELP "); ob_str(ob, fam[f].name); ob_raw(ob, " ", 1); ob_str(ob, fam[f].help);
+        ob_str(ob, "\n# TYPE "); ob_str(ob, fam[f].name); ob_raw(ob, " ", 1); ob_str(ob, fam[f].type); ob_raw(ob, "\n", 1);
+        for (int i = 0; i < p->n; ++i) {
+            const char *base = (const char *)&p->copy[i] + fam[f].off;
+            if (p->copy[i].t == 0) continue; // not sampled yet
+            ob_str(ob, fam[f].name); ob_str(ob, p->labels[i]); ob_raw(ob, " ", 1);
+            if (fam[f].is_u64) { uint64_t v; memcpy(&v, base, sizeof(v)); ob_u64(ob, v); }
+            else { double v; memcpy(&v, base, sizeof(v)); ob_fix(ob, v, fam[f].off == offsetof(port_snap_t, t) ? 3 : 1); }
+            ob_raw(ob, "\n", 1);
+        }
+    }
+    ob_str(ob, "# HELP ibmon_port_link_rate_bytes_per_second Link signalling rate from sysfs.\n"
+               "# TYPE ibmon_port_link_rate_bytes_per_second gauge\n");
+    for (int i = 0; i < p->n; ++i) {
+        if (p->copy[i].link_Bps <= 0) continue;
+        ob_str(ob, "ibmon_port_link_rate_bytes_per_second"); ob_str(ob, p->labels[i]); ob_raw(ob, " ", 1);
+        ob_fix(ob, p->copy[i].link_Bps, 0); ob_raw(ob, "\n", 1);
+    }
+    ob_str(ob, "# HELP ibmon_scrapes_total Scrapes served by this exporter.\n# TYPE ibmon_scrapes_total counter\nibmon_scrapes_total ");
+    ob_u64(ob, scrapes); ob_raw(ob, "\n", 1);
+}
+
+static void prom_conn_close(prom_t *p, prom_conn_t *c) {
+    epoll_ctl(p->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    free(c->out);
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+}
+
+// Send as much of hdr+body as the socket takes; keep the rest for EPOLLOUT.
+static void prom_send(prom_t *p, prom_conn_t *c, const char *hdr, size_t hlen, const char *body, size_t blen) {
+    struct iovec iov[2] = { { (void *)hdr, hlen }, { (void *)body, blen } };
+    ssize_t w;
+    do w = writev(c->fd, iov, 2); while (w < 0 && errno == EINTR);
+    size_t sent = w > 0 ? (size_t)w : 0;
+    if (w < 0 && errno != EAGAIN && errno != EWOULDBLOCK) { prom_conn_close(p, c); return; }
+    if (sent == hlen + blen) { prom_conn_close(p, c); return; }
+    c->out_len = hlen + blen - sent;
+    c->out = malloc(c->out_len);
+    if (!c->out) { prom_conn_close(p, c); return; }
+    size_t o = 0;
+    if (sent < hlen) { memcpy(c->out, hdr + sent, hlen - sent); o = hlen - sent; sent = hlen; }
+    memcpy(c->out + o, body + (sent - hlen), blen - (sent - hlen));
+    c->out_off = 0;
+    struct epoll_event ev = { .events = EPOLLOUT, .data.ptr = c };
+    epoll_ctl(p->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+static void prom_respond(prom_t *p, prom_conn_t *c) {
+    char hdr[256];
+    bool get = strncmp(c->req, "GET ", 4) == 0, head = strncmp(c->req, "HEAD ", 5) == 0;
+    const char *path = c->req + (head ? 5 : 4);
+    size_t plen = strcspn(path, " ?\r\n");
+    if (!get && !head) {
+        static const char msg[] = "HTTP/1.1 405 Method Not Allowed\r\nAllow: GET, HEAD\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        prom_send(p, c, msg, sizeof(msg) - 1, "", 0);
+    } else if ((plen == 8 && memcmp(path, "/metrics", 8) == 0) || (plen == 1 && path[0] == '/')) {
+        prom_render(p);
+        int h = snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                         "Content-Length: %zu\r\nConnection: close\r\n\r\n", p->body.len);
+        prom_send(p, c, hdr, (size_t)h, p->body.buf, head ? 0 : p->body.len);
+    } else {
+        static const char msg[] = "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: 22\r\nConnection: close\r\n\r\nTry /metrics instead.\n";
+        prom_send(p, c, msg, sizeof(msg) - 1, "", 0);
+    }
+}
+
+static void prom_accept(prom_t *p) {
+    for (;;) {
+        int fd = accept4(p->lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+        prom_conn_t *c = NULL;
+        for (int i = 0; i < PROM_MAX_CONN && !c; ++i) if (p->conn[i].fd < 0) c = &p->conn[i];
+        if (!c) { close(fd); continue; } // busy: the scraper retries
+        c->fd = fd; c->req_len = 0; c->t_open = now_monotonic();
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = c };
+        if (epoll_ctl(p->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) { close(fd); c->fd = -1; }
+    }
+}
+
+static void prom_readable(prom_t *p, prom_conn_t *c) {
+    for (;;) {
+        ssize_t r = read(c->fd, c->req + c->req_len, sizeof(c->req) - 1 - c->req_len);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (r <= 0) { prom_conn_close(p, c); return; }
+        c->req_len += (size_t)r;
+        c->req[c->req_len] = '\0';
+        if (strstr(c->req, "\r\n\r\n") || strstr(c->req, "\n\n")) { prom_respond(p, c); return; }
+        if (c->req_len >= sizeof(c->req) - 1) { prom_conn_close(p, c); return; }
+    }
+}
+
+static void prom_writable(prom_t *p, prom_conn_t *c) {
+    while (c->out_off < c->out_len) {
+        ssize_t w = write(c->fd, c->out + c->out_off, c->out_len - c->out_off);
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (w <= 0) break;
+        c->out_off += (size_t)w;
+    }
+    prom_conn_close(p, c);
+}
+
+static void *prom_thread(void *arg) {
+    prom_t *p = arg;
+    struct epoll_event evs[PROM_MAX_CONN + 2];
+    for (;;) {
+        int n = epoll_wait(p->epfd, evs, PROM_MAX_CONN + 2, 1000);
+        if (n < 0 && errno != EINTR) break;
+        for (int i = 0; i < n; ++i) {
+            void *ptr = evs[i].data.ptr;
+            if (ptr == &p->evfd) goto done;
+            if (ptr == &p->lfd) { prom_accept(p); continue; }
+            prom_conn_t *c = ptr;
+            if (c->fd < 0) continue;
+            if (evs[i].events & EPOLLOUT) prom_writable(p, c);
+            else if (evs[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)) prom_readable(p, c);
+        }
+        // drop clients that never finish their request
+        double now = now_monotonic();
+        for (int i = 0; i < PROM_MAX_CONN; ++i)
+            if (p->conn[i].fd >= 0 && now - p->conn[i].t_open > PROM_IDLE_SECS) prom_conn_close(p, &p->conn[i]);
+    }
+done:
+    return NULL;
+}
+
+// Bind HOST:PORT (or [V6]:PORT, or just PORT for 127.0.0.1).
+static int listen_tcp(const char *spec) {
+    char host[256] = "127.0.0.1";
+    const char *port = spec, *colon = strrchr(spec, ':');
+    if (colon) {
+        const char *h = spec; size_t hl = (size_t)(colon - spec);
+        if (hl >= 2 && h[0] == '[' && h[hl - 1] == ']') { h++; hl -= 2; }
+        if (hl > 0) { if (hl >= sizeof(host)) return -1; memcpy(host, h, hl); host[hl] = '\0'; }
+        port = colon + 1;
+    }
+    struct addrinfo hints, *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC; hints.ai_socktype = SOCK_STREAM; hints.ai_flags = AI_PASSIVE;
+    if (getaddrinfo(host, port, &hints, &res) != 0) return -1;
+    int fd = -1;
+    for (struct addrinfo *a = res; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, a->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, a->ai_addr, a->ai_addrlen) != 0 || listen(fd, 64) != 0) { close(fd); fd = -1; }
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+static prom_t *prom_open(const char *spec, const mon_dev_t *md, int n) {
+    prom_t *p = calloc(1, sizeof(*p));
+    if (!p) return NULL;
+    p->n = n;
+    p->labels = calloc((size_t)n, sizeof(*p->labels));
+    p->snap = calloc((size_t)n, sizeof(port_snap_t));
+    p->copy = calloc((size_t)n, sizeof(port_snap_t));
+    p->lfd = p->epfd = p->evfd = -1;
+    for (int i = 0; i < PROM_MAX_CONN; ++i) p->conn[i].fd = -1;
+    if (!p->labels || !p->snap || !p->copy || !ob_init(&p->body, -1, 16384)) goto fail;
+    for (int i = 0; i < n; ++i) {
+        char dev[260]; prom_label_escape(dev, sizeof(dev), md[i].name);
+        snprintf(p->labels[i], sizeof(p->labels[i]), "{device=\"%s\",port=\"%d\"}", dev, md[i].port);
+        p->snap[i].link_Bps = md[i].rate_gbps * 1e9 / 8.0; // shown before the first sample too
+    }
+    p->lfd = listen_tcp(spec);
+    if (p->lfd < 0) { fprintf(stderr, "Cannot listen on %s: %s\n", spec, strerror(errno)); goto fail; }
+    p->epfd = epoll_create1(EPOLL_CLOEXEC);
+    p->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (p->epfd < 0 || p->evfd < 0) goto fail;
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &p->lfd };
+    epoll_ctl(p->epfd, EPOLL_CTL_ADD, p->lfd, &ev);
+    ev.data.ptr = &p->evfd;
+    epoll_ctl(p->epfd, EPOLL_CTL_ADD, p->evfd, &ev);
+    pthread_mutex_init(&p->lock, NULL);
+    if (pthread_create(&p->thread, NULL, prom_thread, p) != 0) { pthread_mutex_destroy(&p->lock); goto fail; }
+    return p;
+fail:
+    if (p->lfd >= 0) close(p->lfd);
+    if (p->epfd >= 0) close(p->epfd);
+    if (p->evfd >= 0) close(p->evfd);
+    free(p->body.buf); free(p->labels); free(p->snap); free(p->copy); free(p);
+    return NULL;
+}
+
+static void prom_publish(prom_t *p, const mon_dev_t *md, double now_real) {
+    pthread_mutex_lock(&p->lock);
+    for (int i = 0; i < p->n; ++i) port_snap_fill(&p->snap[i], &md[i], now_real);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void prom_close(prom_t *p) {
+    if (!p) return;
+    uint64_t one = 1;
+    if (write(p->evfd, &one, sizeof(one)) < 0) {}
+    pthread_join(p->thread, NULL);
+    for (int i = 0; i < PROM_MAX_CONN; ++i) if (p->conn[i].fd >= 0) prom_conn_close(p, &p->conn[i]);
+    close(p->lfd); close(p->epfd); close(p->evfd);
+    pthread_mutex_destroy(&p->lock);
+    free(p->body.buf); free(p->labels); free(p->snap); free(p->copy); free(p);
+}
+
+/* Shared-memory snapshot (--shm NAME), layout in ibmon_shm.h. Updated once
+ * per tick under a seqlock so local readers get consistent copies with
+ * plain loads. The object is removed when ibmon exits. */
+typedef struct {
+    char name[NAME_MAX + 1];
+    unsigned char *base;
+    size_t size;
+    int n;
+} shmsnap_t;
+
+static struct ibmon_shm_port *shmsnap_port(shmsnap_t *sh, int i) {
+    return (struct ibmon_shm_port *)(sh->base + sizeof(struct ibmon_shm_header)) + i;
+}
+
+// pid of the ibmon that owns an existing segment, 0 if unknown.
+static pid_t shmsnap_owner(const char *name) {
+    ibmon_shm_t h;
+    if (ibmon_shm_open(name, &h) != 0) return 0;
+    pid_t pid = (pid_t)((const struct ibmon_shm_header *)h.base)->writer_pid;
+    ibmon_shm_close(&h);
+    return pid;
+}
+
+static shmsnap_t *shmsnap_open(const char *name, const mon_dev_t *md, int n, double interval) {
+    shmsnap_t *sh = calloc(1, sizeof(*sh));
+    if (!sh) return NULL;
+    snprintf(sh->name, sizeof(sh->name), "%s%s", name[0] == '/' ? "" : "/", name);
+    sh->n = n;
+    sh->size = sizeof(struct ibmon_shm_header) + (size_t)n * sizeof(struct ibmon_shm_port);
+    // never truncate a segment someone else has mapped: that would SIGBUS its
+    // readers. A segment left by an ibmon that is gone is replaced.
+    int fd = shm_open(sh->name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0 && errno == EEXIST) {
+        pid_t owner = shmsnap_owner(sh->name);
+        if (owner > 0 && (kill(owner, 0) == 0 || errno != ESRCH)) {
+            fprintf(stderr, "Shared memory %s is in use by ibmon (pid %d)\n", sh->name, (int)owner);
+            free(sh);
+            return NULL;
+        }
+        if (owner <= 0) {
+            fprintf(stderr, "Shared memory %s already exists and is not an ibmon segment; remove /dev/shm%s first\n", sh->name, sh->name);
+            free(sh);
+            return NULL;
+        }
+        shm_unlink(sh->name);
+        fd = shm_open(sh->name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    }
+    if (fd < 0 || ftruncate(fd, (off_t)sh->size) != 0) {
+        fprintf(stderr, "Cannot create shared memory %s: %s\n", sh->name, strerror(errno));
+        if (fd >= 0) { close(fd); shm_unlink(sh->name); }
+        free(sh);
+        return NULL;
+    }
+    void *p = mmap(NULL, sh->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) { fprintf(stderr, "Cannot map shared memory %s: %s\n", sh->name, strerror(errno)); shm_unlink(sh->name); free(sh); return NULL; }
+    sh->base = p;
+    struct ibmon_shm_header *h = p;
+    h->version = IBMON_SHM_VERSION;
+    h->nports = (uint32_t)n;
+    h->port_size = sizeof(struct ibmon_shm_port);
+    h->header_size = sizeof(struct ibmon_shm_header);
+    h->interval_ns = (uint64_t)llround(interval * 1e9);
+    h->writer_pid = (uint32_t)getpid();
+    for (int i = 0; i < n; ++i) {
+        struct ibmon_shm_port *sp = shmsnap_port(sh, i);
+        snprintf(sp->device, sizeof(sp->device), "%s", md[i].name);
+        sp->port = (uint32_t)md[i].port;
+        sp->link_Bps = md[i].rate_gbps * 1e9 / 8.0;
+    }
+    // publish the magic last so readers never see a half-initialised segment
+    __atomic_store_n(&h->magic, IBMON_SHM_MAGIC, __ATOMIC_RELEASE);
+    return sh;
+}
+
+static void shmsnap_publish(shmsnap_t *sh, const mon_dev_t *md, double now, double now_real) {
+    struct ibmon_shm_header *h = (struct ibmon_shm_header *)sh->base;
+    uint64_t seq = h->seq;
+    __atomic_store_n(&h->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    uint64_t real_ns = (uint64_t)llround(now_real * 1e9);
+    for (int i = 0; i < sh->n; ++i) {
+        struct ibmon_shm_port *sp = shmsnap_port(sh, i);
+        port_snap_t ps; port_snap_fill(&ps, &md[i], now_real);
+        sp->rx_bytes = ps.rx_bytes; sp->tx_bytes = ps.tx_bytes;
+        sp->rx_pkts = ps.rx_pkts; sp->tx_pkts = ps.tx_pkts;
+        sp->rx_Bps = ps.rx_Bps; sp->tx_Bps = ps.tx_Bps;
+        sp->rx_pps = ps.rx_pps; sp->tx_pps = ps.tx_pps;
+        sp->link_Bps = ps.link_Bps;
+        sp->sample_real_ns = md[i].prev_t > 0 ? real_ns : 0;
+    }
+    h->update_real_ns = real_ns;
+    h->update_mono_ns = (uint64_t)llround(now * 1e9);
+    __atomic_store_n(&h->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void shmsnap_close(shmsnap_t *sh) {
+    if (!sh) return;
+    munmap(sh->base, sh->size);
+    shm_unlink(sh->name);
+    free(sh);
+}
+
+/* StatsD emitter (--statsd). Per-port rate gauges are packed into
+ * newline-separated multi-metric datagrams of at most `mtu` bytes and the
+ * whole tick leaves in one sendmmsg() on a connected UDP socket. The name
+ * (plain StatsD) or tag (DogStatsD) part of every line is built once. */
+#define STATSD_METRICS 4
+
+typedef struct {
+    int fd;
+    int n;
+    size_t mtu;
+    char (*pre)[STATSD_METRICS][320];  // "ibmon.mlx5_0.port1.rx_bytes_per_second:"
+    char (*post)[200];                 // "|g" or "|g|#device:mlx5_0,port:1"
+    obuf_t buf;                        // all datagrams of the tick, back to back
+    size_t *start;                     // datagram offsets into buf
+    struct mmsghdr *msg;
+    struct iovec *iov;
+    uint64_t send_errors;
+} statsd_t;
+
+// StatsD names cannot contain ':', '|', '@', '#', ',' or whitespace.
+static void statsd_sanitize(char *dst, size_t n, const char *s) {
+    size_t o = 0;
+    for (; *s && o + 1 < n; ++s)
+        dst[o++] = (strchr(":|@#, \t\n", *s)) ? '_' : *s;
+    dst[o] = '\0';
+}
+
+// Resolve [HOST][:PORT] (HOST defaults to 127.0.0.1) to its first address.
+static bool resolve_inet(const char *spec, const char *default_port, int socktype,
+                         struct sockaddr_storage *sa, socklen_t *salen) {
+    char host[256] = "127.0.0.1";
+    const char *port = default_port, *colon = strrchr(spec, ':');
+    const char *h = spec; size_t hl = colon ? (size_t)(colon - spec) : strlen(spec);
+    if (colon) port = colon + 1;
+    if (hl >= 2 && h[0] == '[' && h[hl - 1] == ']') { h++; hl -= 2; }
+    if (hl > 0) { if (hl >= sizeof(host)) return false; memcpy(host, h, hl); host[hl] = '\0'; }
+    struct addrinfo hints, *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC; hints.ai_socktype = socktype;
+    if (getaddrinfo(host, port, &hints, &res) != 0) return false;
+    bool ok = res && res->ai_addrlen <= sizeof(*sa);
+    if (ok) { memcpy(sa, res->ai_addr, res->ai_addrlen); *salen = res->ai_addrlen; }
+    freeaddrinfo(res);
+    return ok;
+}
+
+// A non-blocking datagram socket connected to [HOST][:PORT].
+static int connect_inet(const char *spec, const char *default_port) {
+    struct sockaddr_storage sa; socklen_t salen;
+    if (!resolve_inet(spec, default_port, SOCK_DGRAM, &sa, &salen)) return -1;
+    int fd = socket(sa.ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&sa, salen) != 0) { close(fd); fd = -1; }
+    return fd;
+}
+
+static statsd_t *statsd_open(const opts_t *opt, const mon_dev_t *md, int n) {
+    static const char *metric[STATSD_METRICS] = {
+        "rx_bytes_per_second", "tx_bytes_per_second", "rx_packets_per_second", "tx_packets_per_second"
+    };
+    statsd_t *sd = calloc(1, sizeof(*sd));
+    if (!sd) return NULL;
+    sd->n = n;
+    sd->mtu = opt->statsd_mtu;
+    sd->pre = calloc((size_t)n, sizeof(*sd->pre));
+    sd->post = calloc((size_t)n, sizeof(*sd->post));
+    sd->start = calloc((size_t)n * STATSD_METRICS + 1, sizeof(size_t));
+    sd->msg = calloc((size_t)n * STATSD_METRICS + 1, sizeof(struct mmsghdr));
+    sd->iov = calloc((size_t)n * STATSD_METRICS + 1, sizeof(struct iovec));
+    sd->fd = connect_inet(opt->statsd_addr, "8125");
+    if (!sd->pre || !sd->post || !sd->start || !sd->msg || !sd->iov || !ob_init(&sd->buf, -1, 4096) || sd->fd < 0) {
+        fprintf(stderr, "Cannot set up StatsD output to %s\n", opt->statsd_addr);
+        if (sd->fd >= 0) close(sd->fd);
+        free(sd->buf.buf); free(sd->pre); free(sd->post); free(sd->start); free(sd->msg); free(sd->iov); free(sd);
+        return NULL;
+    }
+    char prefix[64]; statsd_sanitize(prefix, sizeof(prefix), opt->statsd_prefix);
+    for (int i = 0; i < n; ++i) {
+        char dev[128]; statsd_sanitize(dev, sizeof(dev), md[i].name);
+        for (int k = 0; k < STATSD_METRICS; ++k) {
+            if (opt->statsd_tags)
+                snprintf(sd->pre[i][k], sizeof(sd->pre[i][k]), "%s%s%s:", prefix, prefix[0] ? "." : "", metric[k]);
+            else
+                snprintf(sd->pre[i][k], sizeof(sd->pre[i][k]), "%s%s%s.port%d.%s:", prefix, prefix[0] ? "." : "", dev, md[i].port, metric[k]);
+        }
+        if (opt->statsd_tags) snprintf(sd->post[i], sizeof(sd->post[i]), "|g|#device:%s,port:%d", dev, md[i].port);
+        else snprintf(sd->post[i], sizeof(sd->post[i]), "|g");
+    }
+    return sd;
+}
+
+static void statsd_tick(statsd_t *sd, const mon_dev_t *md) {
+    obuf_t *ob = &sd->buf;
+    ob->len = 0; ob->failed = false;
+    int nd = 0;
+    sd->start[0] = 0;
+    for (int i = 0; i < sd->n; ++i) {
+        if (md[i].prev_t <= 0) continue;
+        const double v[STATSD_METRICS] = { md[i].rx_Bps, md[i].tx_Bps, md[i].rx_pps, md[i].tx_pps };
+        for (int k = 0; k < STATSD_METRICS; ++k) {
+            size_t before = ob->len;
+            if (nd > 0) ob_raw(ob, "\n", 1);
+            ob_str(ob, sd->pre[i][k]); ob_fix(ob, v[k], 0); ob_str(ob, sd->post[i]);
+            if (nd == 0) nd = 1;
+            else if (ob->len - sd->start[nd - 1] > sd->mtu) {
+                // does not fit: start the next datagram with this line
+                ob->len = before;
+                sd->start[nd++] = before;
+                ob_str(ob, sd->pre[i][k]); ob_fix(ob, v[k], 0); ob_str(ob, sd->post[i]);
+            }
+        }
+    }
+    if (nd == 0 || ob->failed) return;
+    for (int d = 0; d < nd; ++d) {
+        size_t end = (d + 1 < nd) ? sd->start[d + 1] : ob->len;
+        sd->iov[d].iov_base = ob->buf + sd->start[d];
+        sd->iov[d].iov_len = end - sd->start[d];
+        memset(&sd->msg[d], 0, sizeof(sd->msg[d]));
+        sd->msg[d].msg_hdr.msg_iov = &sd->iov[d];
+        sd->msg[d].msg_hdr.msg_iovlen = 1;
+    }
+    int sent = sendmmsg(sd->fd, sd->msg, (unsigned)nd, MSG_DONTWAIT);
+    if (sent < nd) sd->send_errors++; // agent down or socket buffer full: drop this tick
+}
+
+static void statsd_close(statsd_t *sd) {
+    if (!sd) return;
+    if (sd->send_errors) fprintf(stderr, "StatsD: %" PRIu64 " tick(s) could not be sent completely\n", sd->send_errors);
+    close(sd->fd);
+    free(sd->buf.buf); free(sd->pre); free(sd->post); free(sd->start); free(sd->msg); free(sd->iov); free(sd);
+}
+
+/* InfluxDB line protocol (--influx): one line per port and tick with the
+ * rates and cumulative counters, tagged by device and port, stamped in
+ * nanoseconds. The measurement and tag part of every line is escaped and
+ * built once; a tick is assembled in one buffer and leaves in one write.
+ * Sockets are non-blocking: output a slow reader has not taken yet waits in
+ * the buffer (up to INFLUX_PENDING_MAX, then whole ticks are dropped), and
+ * a lost connection is retried every INFLUX_RETRY_SECS. The address is
+ * resolved once at open; a reconnect is started on one tick and completed
+ * on a later one, so neither name lookups nor connects stall sampling. */
+#define INFLUX_PENDING_MAX (4u << 20)
+#define INFLUX_RETRY_SECS 5.0
+#define INFLUX_WAIT_MS 1000     // connecting at open, flushing at close
+
+typedef struct {
+    const char *dest;
+    int fd;                 // -1 while a socket is disconnected
+    bool sock;              // tcp:// or unix: destination
+    bool connecting;        // a non-blocking connect is in progress
+    struct sockaddr_storage sa;
+    socklen_t salen;
+    int n;
+    char (*pre)[448];       // "ibmon,device=mlx5_0,port=1 rx_bytes="
+    obuf_t buf;             // pending output, the first off bytes already sent
+    size_t off;
+    double retry_at;
+    uint64_t dropped, reconnects;
+} influx_t;
+
+// Escape a measurement (only ',' and ' ') or tag key/value (also '=').
+static size_t influx_escape(char *dst, size_t n, const char *s, bool tag) {
+    size_t o = 0;
+    for (; *s && o + 2 < n; ++s) {
+        if (*s == ',' || *s == ' ' || (tag && *s == '=')) dst[o++] = '\\';
+        dst[o++] = *s;
+    }
+    dst[o] = '\0';
+    return o;
+}
+
+static bool influx_resolve(influx_t *ix) {
+    if (strncmp(ix->dest, "tcp://", 6) == 0) return resolve_inet(ix->dest + 6, "8094", SOCK_STREAM, &ix->sa, &ix->salen);
+    const char *path = strncmp(ix->dest, "unix://", 7) == 0 ? ix->dest + 7 : ix->dest + 5;
+    struct sockaddr_un *un = (struct sockaddr_un *)&ix->sa;
+    if (strlen(path) >= sizeof(un->sun_path)) { errno = ENAMETOOLONG; return false; }
+    memset(un, 0, sizeof(*un));
+    un->sun_family = AF_UNIX;
+    snprintf(un->sun_path, sizeof(un->sun_path), "%s", path);
+    ix->salen = sizeof(*un);
+    return true;
+}
+
+// Start a non-blocking connect; influx_connected() completes it. retry_at is
+// also its deadline.
+static void influx_start(influx_t *ix, double now) {
+    ix->retry_at = now + INFLUX_RETRY_SECS;
+    ix->fd = socket(ix->sa.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (ix->fd < 0) return;
+    if (connect(ix->fd, (struct sockaddr *)&ix->sa, ix->salen) == 0) return;
+    if (errno == EINPROGRESS) { ix->connecting = true; return; }
+    int e = errno;
+    close(ix->fd); ix->fd = -1;
+    errno = e;
+}
+
+// True once the socket is connected, waiting up to wait_ms for a pending
+// connect. A connect that failed or is past its deadline is given up (errno
+// says why): the socket is closed, with what was queued for it, for a retry.
+static bool influx_connected(influx_t *ix, double now, int wait_ms) {
+    if (ix->fd < 0) return false;
+    if (!ix->connecting) return true;
+    struct pollfd pf = { .fd = ix->fd, .events = POLLOUT };
+    int r = poll(&pf, 1, wait_ms), err = ETIMEDOUT;
+    socklen_t el = sizeof(err);
+    if (r < 0 && errno == EINTR) return false;
+    if (r == 0 && now < ix->retry_at && wait_ms == 0) return false;
+    if (r > 0 && getsockopt(ix->fd, SOL_SOCKET, SO_ERROR, &err, &el) == 0 && err == 0) {
+        ix->connecting = false;
+        return true;
+    }
+    close(ix->fd); ix->fd = -1; ix->connecting = false;
+    ix->retry_at = now + INFLUX_RETRY_SECS;
+    if (ix->buf.len) { ix->buf.len = ix->off = 0; ix->dropped++; }
+    errno = err;
+    return false;
+}
+
+static influx_t *influx_open(const char *dest, const char *measurement, const mon_dev_t *md, int n) {
+    influx_t *ix = calloc(1, sizeof(*ix));
+    if (!ix) return NULL;
+    ix->dest = dest; ix->n = n;
+    ix->sock = strncmp(dest, "tcp://", 6) == 0 || strncmp(dest, "unix:", 5) == 0;
+    ix->fd = -1;
+    if (strcmp(dest, "-") == 0) ix->fd = dup(STDOUT_FILENO);
+    else if (!ix->sock) ix->fd = open(dest, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    else if (influx_resolve(ix)) {
+        double now = now_monotonic();
+        influx_start(ix, now);
+        influx_connected(ix, now, INFLUX_WAIT_MS);
+    }
+    ix->pre = calloc((size_t)n + 1, sizeof(*ix->pre));
+    if (ix->fd < 0 || !ix->pre || !ob_init(&ix->buf, -1, 65536)) {
+        fprintf(stderr, "Cannot open InfluxDB output %s: %s\n", dest, strerror(errno));
+        if (ix->fd >= 0) close(ix->fd);
+        free(ix->pre); free(ix->buf.buf); free(ix);
+        return NULL;
+    }
+    char meas[128], dev[256];
+    influx_escape(meas, sizeof(meas), measurement, false);
+    for (int i = 0; i < n; ++i) {
+        influx_escape(dev, sizeof(dev), md[i].name, true);
+        snprintf(ix->pre[i], sizeof(ix->pre[i]), "%s,device=%s,port=%d rx_bytes=", meas, dev, md[i].port);
+    }
+    return ix;
+}
+
+// Send what is pending, waiting at most wait_ms for a slow reader (0 on the
+// sampling path); a failed socket is closed for a retry later.
+static void influx_send(influx_t *ix, double now, int wait_ms) {
+    obuf_t *ob = &ix->buf;
+    double deadline = now_monotonic() + wait_ms / 1000.0;
+    while (ix->off < ob->len) {
+        ssize_t w = ix->sock ? send(ix->fd, ob->buf + ix->off, ob->len - ix->off, MSG_NOSIGNAL | MSG_DONTWAIT)
+                             : write(ix->fd, ob->buf + ix->off, ob->len - ix->off);
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pf = { .fd = ix->fd, .events = POLLOUT };
+            int left = (int)ceil((deadline - now_monotonic()) * 1000.0);
+            if (left > 0 && poll(&pf, 1, left) >= 0) continue;
+            break;
+        }
+        if (w <= 0) {
+            if (ix->sock) { close(ix->fd); ix->fd = -1; ix->retry_at = now + INFLUX_RETRY_SECS; }
+            ob->len = ix->off = 0; // a partly sent line cannot be resumed on a new connection
+            ob->failed = true;
+            return;
+        }
+        ix->off += (size_t)w;
+    }
+    if (ix->off == ob->len) ob->len = ix->off = 0;
+    else if (ix->off > ob->len / 2) {
+        memmove(ob->buf, ob->buf + ix->off, ob->len - ix->off);
+        ob->len -= ix->off; ix->off = 0;
+    }
+}
+
+static void influx_tick(influx_t *ix, const mon_dev_t *md, double now, double now_real) {
+    obuf_t *ob = &ix->buf;
+    if (ix->fd < 0) {
+        if (now < ix->retry_at) { ix->dropped++; return; }
+        influx_start(ix, now);
+        if (ix->fd < 0) { ix->dropped++; return; }
+        ix->reconnects++;
+    }
+    if (ob->failed && !ix->sock) return; // file or pipe gone: stop writing
+    ob->failed = false;
+    // while a connect is pending, ticks queue up like for a slow reader
+    bool ready = !ix->sock || influx_connected(ix, now, 0);
+    if (ix->fd < 0) { ix->dropped++; return; }
+    if (ob->len - ix->off > INFLUX_PENDING_MAX) { ix->dropped++; if (ready) influx_send(ix, now, 0); return; }
+    char ts[24]; int tl = snprintf(ts, sizeof(ts), " %lld\n", (long long)llround(now_real * 1e9));
+    for (int i = 0; i < ix->n; ++i) {
+        if (md[i].prev_t <= 0) continue;
+        uint64_t mul = md[i].ctrs.data_is_words ? 4 : 1;
+        ob_str(ob, ix->pre[i]);
+        ob_u64(ob, md[i].prev_rx_data * mul); ob_str(ob, "i,tx_bytes=");
+        ob_u64(ob, md[i].prev_tx_data * mul); ob_str(ob, "i,rx_pkts=");
+        ob_u64(ob, md[i].prev_rx_pkts); ob_str(ob, "i,tx_pkts=");
+        ob_u64(ob, md[i].prev_tx_pkts); ob_str(ob, "i,rx_Bps=");
+        ob_fix(ob, md[i].rx_Bps, 1); ob_str(ob, ",tx_Bps=");
+        ob_fix(ob, md[i].tx_Bps, 1); ob_str(ob, ",rx_pps=");
+        ob_fix(ob, md[i].rx_pps, 1); ob_str(ob, ",tx_pps=");
+        ob_fix(ob, md[i].tx_pps, 1);
+        ob_raw(ob, ts, (size_t)tl);
+    }
+    if (ob->failed) { ob->len = ix->off = 0; ix->dropped++; return; } // out of memory
+    if (ready) influx_send(ix, now, 0);
+}
+
+static void influx_close(influx_t *ix) {
+    if (!ix) return;
+    if (ix->fd >= 0 && ix->off < ix->buf.len) { // last chance for the pending lines, bounded
+        double now = now_monotonic();
+        if (!ix->sock || influx_connected(ix, now, INFLUX_WAIT_MS)) influx_send(ix, now, INFLUX_WAIT_MS);
+    }
+    if (ix->dropped) fprintf(stderr, "InfluxDB: %" PRIu64 " tick(s) dropped, %" PRIu64 " reconnect(s)\n", ix->dropped, ix->reconnects);
+    if (ix->fd >= 0) close(ix->fd);
+    free(ix->pre); free(ix->buf.buf); free(ix);
+}
+
+/* Per-tick outputs shared by the TUI, multi-device and headless loops. */
+typedef struct {
+    binlog_t bl; bool use_bl;
+    csvw_t *csv; char *csv_row; size_t csv_row_cap; csv_layout_t csv_layout;
+    prom_t *prom;
+    shmsnap_t *shm;
+    statsd_t *statsd;
+    arrow_t *arrow;
+    influx_t *influx;
+    FILE *events; bool events_json;
+    uint64_t events_written;
+} sinks_t;
+
+// Open the sinks requested in opt (before curses, so errors reach the terminal).
+// `single` keeps the original single-device CSV layout. Returns false if a
+// network or shared-memory sink could not be started.
+static bool sinks_open(sinks_t *s, const opts_t *opt, const mon_dev_t *md, int n, bool single) {
+    memset(s, 0, sizeof(*s));
+    if (opt->binlog_path) s->use_bl = binlog_open(&s->bl, opt->binlog_path, md, n);
+    if (opt->csv_path) {
+        s->csv_layout = single ? CSV_SINGLE : opt->csv_layout;
+        char *hdr = csv_header(md, n, s->csv_layout);
+        s->csv_row_cap = csv_rows_cap(md, n);
+        s->csv_row = malloc(s->csv_row_cap);
+        if (hdr && s->csv_row)
+            s->csv = csvw_open(opt->csv_path, opt->csv_append, hdr, !opt->csv_append || opt->csv_headers,
+                               opt->csv_rotate_secs, opt->csv_rotate_bytes, opt->csv_sync);
+        free(hdr);
+        if (!s->csv) fprintf(stderr, "Failed to open CSV path: %s\n", opt->csv_path);
+    }
+    if (opt->listen) {
+        s->prom = prom_open(opt->listen, md, n);
+        if (!s->prom) return false;
+    }
+    if (opt->shm_name) {
+        s->shm = shmsnap_open(opt->shm_name, md, n, opt->interval);
+        if (!s->shm) return false;
+    }
+    if (opt->statsd_addr) {
+        s->statsd = statsd_open(opt, md, n);
+        if (!s->statsd) return false;
+    }
+    if (opt->arrow_path) {
+        s->arrow = arrow_open(opt->arrow_path, md, n, opt->arrow_batch);
+        if (!s->arrow) return false;
+    }
+    if (opt->influx_dest) {
+        s->influx = influx_open(opt->influx_dest, opt->influx_measurement, md, n);
+        if (!s->influx) return false;
+    }
+    if (opt->event_log_path) {
+        s->events = event_log_open(opt->event_log_path, &s->events_json);
+        s->events_written = g_event_count;
+    }
+    return true;
+}
+
+// Baseline right after the counters were primed.
+static void sinks_prime(sinks_t *s, const mon_dev_t *md, double now, double now_real) {
+    if (s->use_bl) binlog_tick(&s->bl, md, now, now_real);
+    if (s->prom) prom_publish(s->prom, md, now_real);
+    if (s->shm) shmsnap_publish(s->shm, md, now, now_real);
+}
+
+static void sinks_tick(sinks_t *s, const opts_t *opt, const mon_dev_t *md, int n, double now, double now_real) {
+    if (s->use_bl) binlog_tick(&s->bl, md, now, now_real);
+    if (s->csv) {
+        size_t len = csv_rows(s->csv_row, s->csv_row_cap, md, n, s->csv_layout, opt->csv_metric, now);
+        if (len) csvw_write(s->csv, s->csv_row, len, s->csv_layout == CSV_LONG ? (unsigned)n : 1u);
+    }
+    if (s->prom) prom_publish(s->prom, md, now_real);
+    if (s->shm) shmsnap_publish(s->shm, md, now, now_real);
+    if (s->statsd) statsd_tick(s->statsd, md);
+    if (s->arrow) arrow_tick(s->arrow, md, now, now_real);
+    if (s->influx) influx_tick(s->influx, md, now, now_real);
+    if (s->events) event_log_flush(s->events, s->events_json, &s->events_written);
+}
+
+static void sinks_close(sinks_t *s) {
+    if (s->use_bl) binlog_close(&s->bl);
+    csvw_close(s->csv);
+    free(s->csv_row);
+    prom_close(s->prom);
+    shmsnap_close(s->shm);
+    statsd_close(s->statsd);
+    arrow_close(s->arrow);
+    influx_close(s->influx);
+    if (s->events) { event_log_flush(s->events, s->events_json, &s->events_written); fclose(s->events); }
+    memset(s, 0, sizeof(*s));
+}
+
+/* ibmond: the sampler serves its ports, history and live counters on a Unix
+ * socket, so any number of viewers share one sysfs poller and one history.
+ * Requests and replies are text lines:
+ *
+ *   PORTS                      "PORTS n interval_s", n x "P idx device port rate_gbps words", "."
+ *   HISTORY idx|* [FROM [TO]]  "H idx t_s rx_Bps tx_Bps" per stored sample, then "."
+ *                              (monotonic seconds; a negative FROM counts back from now)
+ *   SUBSCRIBE                  "B t_s real_s" + rx_data tx_data rx_pkts tx_pkts per port
+ *                              (the current baseline), then the same as "S ..." every tick
+ *   QUIT
+ *
+ * Errors are answered with "ERR message". Counters are raw sysfs values
+ * (data in 4-byte words when `words` is 1). Everything runs on the sampling
+ * thread between ticks: history is generated a block at a time as the
+ * socket drains and requests are answered in order, so HISTORY followed by
+ * SUBSCRIBE has neither gaps nor overlap. A HISTORY after SUBSCRIBE has its
+ * lines interleaved with the stream's. */
+#define IBMOND_SOCK "ibmond.sock"       // in $XDG_RUNTIME_DIR, else IBMOND_RUN_DIR
+#define IBMOND_RUN_DIR "/run/ibmond"
+#define SRV_MAX_CONN 64
+#define SRV_REQ_MAX 1024
+#define SRV_OUT_CHUNK (256u << 10)   // history generated ahead of the socket
+#define SRV_OUT_MAX (64u << 20)      // a subscriber this far behind is dropped
+
+typedef struct {
+    int fd;                 // -1: free slot
+    char req[SRV_REQ_MAX];
+    size_t req_len;
+    obuf_t out;             // memory buffer, the first out_off bytes already sent
+    size_t out_off;
+    uint32_t events;        // registered epoll events
+    bool subscribed;
+    bool quit;              // close once the pending output is sent
+    bool eof;               // the client closed its side; finish the requests already read
+    bool hist;              // a HISTORY reply is being generated
+    int hist_first, hist_last;
+    uint64_t *hist_next;    // per port: next sample sequence number to send
+    int64_t hist_from_ms, hist_to_ms;
+} srv_conn_t;
+
+typedef struct {
+    int lfd, epfd;
+    char path[108];
+    dev_t sock_dev;         // the socket we bound, so only it is removed on exit
+    ino_t sock_ino;
+    const mon_dev_t *md;
+    int n;
+    double interval;
+    srv_conn_t conn[SRV_MAX_CONN];
+} srv_t;
+
+static void srv_close_conn(srv_t *s, srv_conn_t *c) {
+    epoll_ctl(s->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    ob_free(&c->out);
+    free(c->hist_next);
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+}
+
+static void srv_counters(obuf_t *ob, const char *tag, const mon_dev_t *md, int n, double t, double t_real) {
+    ob_str(ob, tag); ob_fix(ob, t, 6); ob_raw(ob, " ", 1); ob_fix(ob, t_real, 6);
+    for (int i = 0; i < n; ++i) {
+        const uint64_t v[4] = { md[i].prev_rx_data, md[i].prev_tx_data, md[i].prev_rx_pkts, md[i].prev_tx_pkts };
+        for (int k = 0; k < 4; ++k) { ob_raw(ob, " ", 1); ob_u64(ob, v[k]); }
+    }
+    ob_raw(ob, "\n", 1);
+}
+
+// Append history lines until the buffer holds SRV_OUT_CHUNK or the reply is complete.
+static void srv_hist_step(srv_t *s, srv_conn_t *c) {
+    while (c->hist && c->out.len - c->out_off < SRV_OUT_CHUNK && !c->out.failed) {
+        int p = -1;
+        for (int i = c->hist_first; i <= c->hist_last && p < 0; ++i)
+            if (c->hist_next[i] < s->md[i].hs.seq_next) p = i;
+        if (p < 0) { ob_raw(&c->out, ".\n", 2); c->hist = false; break; }
+        // one compressed block of port p
+        const hstore_t *hs = &s->md[p].hs;
+        uint64_t seq = c->hist_next[p];
+        if (seq < hstore_first_seq(hs)) seq = hstore_first_seq(hs);
+        int bi = hstore_find_block(hs, seq);
+        hs_iter_t it; hs_iter_init(&it, &hs->blk[bi]);
+        uint64_t q = hs->blk[bi].seq0;
+        int64_t t; double v[HS_CHANS];
+        bool past = false;
+        char pre[16]; int pl = snprintf(pre, sizeof(pre), "H %d ", p);
+        while (hs_iter_next(&it, &t, v)) {
+            if (q++ < seq || t < c->hist_from_ms) continue;
+            if (t > c->hist_to_ms) { past = true; break; }
+            ob_raw(&c->out, pre, (size_t)pl);
+            ob_u64(&c->out, (uint64_t)(t / 1000)); ob_raw(&c->out, ".", 1);
+            char ms[3] = { (char)('0' + t / 100 % 10), (char)('0' + t / 10 % 10), (char)('0' + t % 10) };
+            ob_raw(&c->out, ms, 3);
+            for (int k = 0; k < HS_CHANS; ++k) { ob_raw(&c->out, " ", 1); ob_u64(&c->out, v[k] > 0 ? (uint64_t)v[k] : 0); }
+            ob_raw(&c->out, "\n", 1);
+        }
+        c->hist_next[p] = past ? UINT64_MAX : q;
+    }
+}
+
+static void srv_flush(srv_t *s, srv_conn_t *c) {
+    for (;;) {
+        if (c->hist) srv_hist_step(s, c);
+        if (c->out.failed) { srv_close_conn(s, c); return; }
+        while (c->out_off < c->out.len) {
+            ssize_t w = send(c->fd, c->out.buf + c->out_off, c->out.len - c->out_off, MSG_NOSIGNAL);
+            if (w < 0 && errno == EINTR) continue;
+            if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (w <= 0) { srv_close_conn(s, c); return; }
+            c->out_off += (size_t)w;
+        }
+        if (c->out_off == c->out.len) { c->out.len = c->out_off = 0; }
+        if (c->out_off < c->out.len || !c->hist) break;
+    }
+    bool done = c->quit || (c->eof && !c->subscribed && !memchr(c->req, '\n', c->req_len));
+    if (done && !c->hist && c->out.len == 0) { srv_close_conn(s, c); return; }
+    if (c->out_off > c->out.len / 2) { // keep the pending part at the front
+        memmove(c->out.buf, c->out.buf + c->out_off, c->out.len - c->out_off);
+        c->out.len -= c->out_off; c->out_off = 0;
+    }
+    uint32_t events = (c->eof || c->req_len == sizeof(c->req) ? 0 : EPOLLIN | EPOLLRDHUP) | (c->out.len > 0 ? EPOLLOUT : 0);
+    if (events != c->events) {
+        struct epoll_event ev = { .events = events, .data.ptr = c };
+        epoll_ctl(s->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+        c->events = events;
+    }
+}
+
+// A HISTORY time argument: seconds, finite and small enough to hold in ms.
+static bool srv_time_arg(const char *a, double *v) {
+    char *end = NULL;
+    *v = strtod(a, &end);
+    return end != a && *end == '\0' && isfinite(*v) && fabs(*v) < 1e12;
+}
+
+// Answer one request line.
+static void srv_request(srv_t *s, srv_conn_t *c, char *line) {
+    char *save = NULL;
+    char *cmd = strtok_r(line, " \t\r", &save);
+    obuf_t *ob = &c->out;
+    if (!cmd) return;
+    if (strcasecmp(cmd, "PORTS") == 0) {
+        char l[320];
+        snprintf(l, sizeof(l), "PORTS %d %.6f\n", s->n, s->interval);
+        ob_str(ob, l);
+        for (int i = 0; i < s->n; ++i) {
+            snprintf(l, sizeof(l), "P %d %s %d %.3f %d\n", i, s->md[i].name, s->md[i].port,
+                     s->md[i].rate_gbps, s->md[i].ctrs.data_is_words ? 1 : 0);
+            ob_str(ob, l);
+        }
+        ob_raw(ob, ".\n", 2);
+    } else if (strcasecmp(cmd, "HISTORY") == 0) {
+        char *a = strtok_r(NULL, " \t\r", &save), *f = strtok_r(NULL, " \t\r", &save), *t = strtok_r(NULL, " \t\r", &save);
+        bool all = a && strcmp(a, "*") == 0;
+        char *end = NULL;
+        long idx = a && !all ? strtol(a, &end, 10) : -1;
+        double from = 0.0, to = 0.0;
+        if (!a || (!all && (*end || idx < 0 || idx >= s->n)) || (f && !srv_time_arg(f, &from)) || (t && !srv_time_arg(t, &to))) {
+            ob_str(ob, "ERR usage: HISTORY idx|* [FROM [TO]]\n");
+            return;
+        }
+        if (!c->hist_next && !(c->hist_next = calloc((size_t)s->n + 1, sizeof(uint64_t)))) { c->out.failed = true; return; }
+        memset(c->hist_next, 0, (size_t)s->n * sizeof(uint64_t));
+        if (from < 0) from += now_monotonic();
+        c->hist_first = all ? 0 : (int)idx;
+        c->hist_last = all ? s->n - 1 : (int)idx;
+        c->hist_from_ms = f ? (int64_t)llround(from * 1000.0) : INT64_MIN;
+        c->hist_to_ms = t ? (int64_t)llround(to * 1000.0) : INT64_MAX;
+        c->hist = true;
+    } else if (strcasecmp(cmd, "SUBSCRIBE") == 0) {
+        double now = now_monotonic(), t = s->n ? s->md[0].prev_t : now;
+        srv_counters(ob, "B ", s->md, s->n, t, now_realtime() - (now - t));
+        c->subscribed = true;
+    } else if (strcasecmp(cmd, "QUIT") == 0) {
+        c->quit = true;
+    } else {
+        ob_str(ob, "ERR unknown command\n");
+    }
+}
+
+// Answer complete request lines in order. A pending HISTORY reply holds back
+// the requests after it until it is complete.
+static void srv_handle(srv_t *s, srv_conn_t *c) {
+    for (;;) {
+        char *nl;
+        while (!c->hist && !c->quit && (nl = memchr(c->req, '\n', c->req_len))) {
+            *nl = '\0';
+            srv_request(s, c, c->req);
+            size_t used = (size_t)(nl + 1 - c->req);
+            memmove(c->req, nl + 1, c->req_len - used);
+            c->req_len -= used;
+        }
+        srv_flush(s, c);
+        if (c->fd < 0 || c->hist || c->quit || !memchr(c->req, '\n', c->req_len)) return;
+    }
+}
+
+static void srv_readable(srv_t *s, srv_conn_t *c) {
+    for (;;) {
+        if (c->req_len == sizeof(c->req)) {
+            if (!memchr(c->req, '\n', c->req_len)) { srv_close_conn(s, c); return; } // line too long
+            break; // read more once the queued requests are answered
+        }
+        ssize_t r = read(c->fd, c->req + c->req_len, sizeof(c->req) - c->req_len);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (r < 0) { srv_close_conn(s, c); return; }
+        if (r == 0) { c->eof = true; break; }
+        c->req_len += (size_t)r;
+    }
+    srv_handle(s, c);
+}
+
+static void srv_accept(srv_t *s) {
+    for (;;) {
+        int fd = accept4(s->lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+        srv_conn_t *c = NULL;
+        for (int i = 0; i < SRV_MAX_CONN && !c; ++i) if (s->conn[i].fd < 0) c = &s->conn[i];
+        if (!c) { close(fd); continue; }
+        memset(c, 0, sizeof(*c));
+        c->fd = fd;
+        if (!ob_init(&c->out, -1, 65536)) { close(fd); c->fd = -1; continue; }
+        c->events = EPOLLIN | EPOLLRDHUP;
+        struct epoll_event ev = { .events = c->events, .data.ptr = c };
+        if (epoll_ctl(s->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) { ob_free(&c->out); close(fd); c->fd = -1; }
+    }
+}
+
+// Serve clients until the monotonic deadline (the next sampling tick).
+static void srv_wait(srv_t *s, double deadline) {
+    struct epoll_event evs[SRV_MAX_CONN + 1];
+    while (!g_stop) {
+        double left = deadline - now_monotonic();
+        if (left <= 0) break;
+        int n = epoll_wait(s->epfd, evs, SRV_MAX_CONN + 1, (int)ceil(left * 1000.0));
+        if (n < 0 && errno != EINTR) break;
+        for (int i = 0; i < n; ++i) {
+            if (evs[i].data.ptr == &s->lfd) { srv_accept(s); continue; }
+            srv_conn_t *c = evs[i].data.ptr;
+            if (c->fd < 0) continue;
+            if (evs[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)) srv_readable(s, c);
+            if (c->fd >= 0 && (evs[i].events & EPOLLOUT)) srv_handle(s, c);
+        }
+    }
+}
+
+// Stream this tick's counters to every subscriber.
+static void srv_tick(srv_t *s, double now, double now_real) {
+    for (int i = 0; i < SRV_MAX_CONN; ++i) {
+        srv_conn_t *c = &s->conn[i];
+        if (c->fd < 0 || !c->subscribed) continue;
+        if (c->out.len - c->out_off > SRV_OUT_MAX) { srv_close_conn(s, c); continue; } // stalled viewer
+        srv_counters(&c->out, "S ", s->md, s->n, now, now_real);
+        srv_flush(s, c);
+    }
+}
+
+static srv_t *srv_open(const char *path, const mon_dev_t *md, int n, double interval) {
+    struct sockaddr_un sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(sa.sun_path)) { fprintf(stderr, "Socket path too long: %s\n", path); return NULL; }
+    snprintf(sa.sun_path, sizeof(sa.sun_path), "%s", path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) { fprintf(stderr, "socket: %s\n", strerror(errno)); return NULL; }
+    // created 0600: the socket hands out every port's counters and history
+    mode_t um = umask(077);
+    bool bound = bind(fd, (struct sockaddr *)&sa, sizeof(sa)) == 0;
+    if (!bound && errno == EADDRINUSE) {
+        // a stale socket from a daemon of ours that died is replaced; a live
+        // one, or anything that is not our socket, is left alone
+        struct stat st;
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool live = probe >= 0 && connect(probe, (struct sockaddr *)&sa, sizeof(sa)) == 0;
+        if (probe >= 0) close(probe);
+        if (live) { fprintf(stderr, "Another ibmond is serving %s\n", path); umask(um); close(fd); return NULL; }
+        if (lstat(path, &st) != 0 || !S_ISSOCK(st.st_mode) || st.st_uid != geteuid()) {
+            fprintf(stderr, "%s exists and is not a stale ibmond socket; remove it or choose another --serve path\n", path);
+            umask(um); close(fd); return NULL;
+        }
+        unlink(path);
+        bound = bind(fd, (struct sockaddr *)&sa, sizeof(sa)) == 0;
+    }
+    umask(um);
+    struct stat st;
+    if (!bound || listen(fd, 16) != 0 || lstat(path, &st) != 0) {
+        fprintf(stderr, "Cannot serve on %s: %s\n", path, strerror(errno));
+        close(fd);
+        if (bound) unlink(path);
+        return NULL;
+    }
+    srv_t *s = calloc(1, sizeof(*s));
+    if (!s) { close(fd); unlink(path); return NULL; }
+    s->lfd = fd; s->md = md; s->n = n; s->interval = interval;
+    s->sock_dev = st.st_dev; s->sock_ino = st.st_ino;
+    snprintf(s->path, sizeof(s->path), "%s", path);
+    for (int i = 0; i < SRV_MAX_CONN; ++i) s->conn[i].fd = -1;
+    s->epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &s->lfd };
+    if (s->epfd < 0 || epoll_ctl(s->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        fprintf(stderr, "epoll: %s\n", strerror(errno));
+        if (s->epfd >= 0) close(s->epfd);
+        close(fd); unlink(path); free(s);
+        return NULL;
+    }
+    return s;
+}
+
+// Where ibmond listens unless told otherwise: the user's private runtime
+// directory, or IBMOND_RUN_DIR (created if missing) for a system daemon.
+static const char *ibmond_default_sock(void) {
+    static char path[108];
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    if (!dir || !*dir) { dir = IBMOND_RUN_DIR; mkdir(dir, 0755); }
+    snprintf(path, sizeof(path), "%s/%s", dir, IBMOND_SOCK);
+    return path;
+}
+
+static void srv_close(srv_t *s) {
+    if (!s) return;
+    for (int i = 0; i < SRV_MAX_CONN; ++i) if (s->conn[i].fd >= 0) srv_close_conn(s, &s->conn[i]);
+    close(s->lfd); close(s->epfd);
+    // only if it is still ours: another daemon may have replaced it meanwhile
+    struct stat st;
+    if (lstat(s->path, &st) == 0 && st.st_dev == s->sock_dev && st.st_ino == s->sock_ino) unlink(s->path);
+    free(s);
+}
+
+static void draw_ascii_box(WINDOW *w)
+{
+    wborder(w, '|', '|', '-', '-', '+', '+', '+', '+');
+}
+
+/* Plot glyphs. A column is a stack of cells whose fill is counted in
+ * sub-rows: one per cell in ASCII ('|' or the background), eight with the
+ * eighth blocks U+2581..U+2588 and four with braille (U+2800 + dots), which
+ * also packs two plot columns into each cell. The glyphs of every style and
+ * colour are built once; a frame is composed a row at a time from them and
+ * written with one call per row. Braille cells are indexed by their dot
+ * pattern, so a zoomed-out column's mean can be marked by a single dot
+ * without losing the bar around it. */
+#define GLYPH_MEAN 9            // '=' at a zoomed-out column's mean
+#define GLYPH_BG 10             // empty cell
+#define GLYPH_N 11
+
+static const int plot_sub[] = { 1, 8, 4 };  // sub-rows per cell, by plot_style_t
+static const int plot_per[] = { 1, 1, 2 };  // plot columns per cell
+
+static chtype g_glyph[3][GLYPH_N];          // ASCII, by colour: none, RX, TX
+#ifdef IBMON_WIDE
+static cchar_t g_wglyph[3][GLYPH_N];
+static cchar_t g_wbraille[3][256];          // by dot pattern; 0 is the background
+static const int braille_dot[2][4] = { { 0x40, 0x04, 0x02, 0x01 },  // left column: dots 7, 3, 2, 1 from the bottom
+                                       { 0x80, 0x20, 0x10, 0x08 } }; // right column: dots 8, 6, 5, 4
+
+// Dots of a braille column filled f sub-rows from the bottom.
+static int braille_fill(int k, int f) {
+    int dots = 0;
+    for (int i = 0; i < f; ++i) dots |= braille_dot[k][i];
+    return dots;
+}
+#endif
+
+static void plot_glyphs_init(bool light) {
+    static int built = -1;
+    if (built == (int)light) return;
+    built = (int)light;
+    for (int c = 0; c < 3; ++c) {
+        chtype cp = c ? COLOR_PAIR(c) : 0;
+        for (int k = 0; k < GLYPH_N; ++k) g_glyph[c][k] = '|' | cp;
+        g_glyph[c][GLYPH_MEAN] = '=' | cp;
+        g_glyph[c][GLYPH_BG] = (light ? ' ' : '.') | cp;
+#ifdef IBMON_WIDE
+        const wchar_t bg = light ? L' ' : 0x00b7;                                // middle dot, as '.' in ASCII
+        for (int k = 0; k < GLYPH_N; ++k) {
+            wchar_t w[2] = { bg, 0 };
+            if (k == GLYPH_MEAN) w[0] = 0x2501;                                  // heavy horizontal
+            else if (k > 0 && k < GLYPH_MEAN) w[0] = 0x2580 + (wchar_t)k;        // eighth blocks
+            setcchar(&g_wglyph[c][k], w, A_NORMAL, (short)c, NULL);
+        }
+        for (int d = 0; d < 256; ++d) {
+            wchar_t w[2] = { d ? 0x2800 + (wchar_t)d : bg, 0 };
+            setcchar(&g_wbraille[c][d], w, A_NORMAL, (short)c, NULL);
+        }
+#endif
+    }
+}
+
+static void chart_reset(mon_dev_t *md) { md->chart[0].valid = md->chart[1].valid = false; }
+
+// Draw one direction's plot in the --plot style. Plot columns (samples, or
+// zoomed-out columns) are grouped into cells by absolute position, so cell j
+// always holds entries j*per.., and end is the entry number after the newest.
+// With a chart cache (cc) and the view at the newest entry, a frame whose
+// scale, zoom and size match the previous one only scrolls the plot left by
+// the number of cells appended since and draws the new ones, plus the last
+// old one when it may have been partial; anything else is a full redraw.
+static void draw_panel_win(WINDOW *win, const char *title, double cur_Bps, double cur_pps, pctl_t *pc,
+                           const double *hist, const double *mean, int hist_len, wmax_t *wm,
+                           chart_t *cc, uint64_t end, units_t units, double rate_gbps,
+                           bool use_colors, bool light)
+{
+    static int lvl[2][HIST_CAP], mlvl[2][HIST_CAP];
+    static chtype row[HIST_CAP + 1];
+#ifdef IBMON_WIDE
+    static cchar_t wrow[HIST_CAP + 1];
+#endif
+    const int per = plot_per[g_plot], sub = plot_sub[g_plot];
+    int wy, wx; getmaxyx(win, wy, wx);
+    int y_label_w = 12;
+    int chart_h = wy - 3;
+    int chart_w = wx - 2 - y_label_w;
+    bool plot = chart_h >= 3 && chart_w >= 10 && hist_len >= 2;
+    double maxv = 1.0;
+    char topbuf[32], midbuf[32], botbuf[32];
+    const uint64_t first_entry = end - (uint64_t)hist_len, cend = (end + (uint64_t)per - 1) / (uint64_t)per;
+    int ncells = 0;
+    if (plot) {
+        int samples = chart_w * per;
+        if (samples > HIST_CAP) samples = HIST_CAP;
+        if (wm) {
+            // live view: the deque tracks the maximum as samples are appended
+            if (wm->win != samples) wmax_reset(wm, samples, hist, hist_len);
+            double v = wmax_get(wm);
+            if (units == UNITS_BITS) v *= 8.0;
+            if (v > maxv) maxv = v;
+        } else {
+            if (samples > hist_len) samples = hist_len;
+            for (int i = 0; i < samples; ++i) {
+                double v = hist[hist_len - samples + i];
+                if (units == UNITS_BITS) v *= 8.0;
+                if (v > maxv) maxv = v;
+            }
+        }
+        if (units == UNITS_BITS && rate_gbps > 0) {
+            double link_bps = rate_gbps * 1e9;
+            if (link_bps > 0 && link_bps < maxv) maxv = link_bps;
+        }
+        // dynamic labels with appropriate units
+        format_scale_label(maxv, units, topbuf, sizeof(topbuf));
+        format_scale_label(maxv/2.0, units, midbuf, sizeof(midbuf));
+        snprintf(botbuf, sizeof(botbuf), "%s", (units == UNITS_BITS) ? "0.00 b/s" : "0.00 B/s");
+        int lblw = (int)strlen(topbuf);
+        if ((int)strlen(midbuf) > lblw) lblw = (int)strlen(midbuf);
+        if ((int)strlen(botbuf) > lblw) lblw = (int)strlen(botbuf);
+        y_label_w = lblw + 3; // 1 space padding + '|' + margin
+        chart_w = wx - 2 - y_label_w;
+        if (chart_w < 1) chart_w = 1;
+        if (chart_w > HIST_CAP) chart_w = HIST_CAP;
+        ncells = (int)(cend - first_entry / (uint64_t)per);
+        if (ncells > chart_w) ncells = chart_w;
+    }
+    uint64_t shift = cc ? cend - cc->end : 0;
+    bool scroll = plot && cc && cc->valid && g_view.offset == 0 && cc->zoom == g_view.zoom &&
+                  cc->h == wy && cc->w == wx && cc->maxv == maxv && cc->units == (int)units &&
+                  cc->use_colors == use_colors && cc->light == light &&
+                  cend >= cc->end && shift < (uint64_t)ncells;
+    // right-aligned drawing: newest cell at far right
+    int x0 = y_label_w + 1, base_col = x0 + (chart_w - ncells);
+    if (scroll) {
+        if (shift) {
+            int keep = chart_w - (int)shift;
+            for (int y = 1; y <= chart_h; ++y) {
+#ifdef IBMON_WIDE
+                if (g_plot != PLOT_ASCII) {
+                    mvwin_wchnstr(win, y, x0 + (int)shift, wrow, keep);
+                    mvwadd_wchnstr(win, y, x0, wrow, keep);
+                    continue;
+                }
+#endif
+                mvwinchnstr(win, y, x0 + (int)shift, row, keep);
+                mvwaddchnstr(win, y, x0, row, keep);
+            }
+        }
+    } else {
+        werase(win);
+        if (use_colors) {
+            wbkgd(win, COLOR_PAIR(11));
+            wbkgdset(win, COLOR_PAIR(11) | ' ');
+        }
+    }
+    if (use_colors) wattron(win, COLOR_PAIR(13));
+    draw_ascii_box(win);
+    if (use_colors) wattroff(win, COLOR_PAIR(13));
+    char ratebuf[64], ppsbuf[64], pctbuf[64], line[256];
+    human_rate(cur_Bps, units, ratebuf, sizeof(ratebuf));
+    human_pps(cur_pps, ppsbuf, sizeof(ppsbuf));
+    if (pc) pctl_label(pc, units, pctbuf, sizeof(pctbuf)); else pctbuf[0] = '\0';
+    if (use_colors) wattron(win, COLOR_PAIR(10));
+    snprintf(line, sizeof(line), " %s  %s  %s %s%s ", title ? title : "", ratebuf, ppsbuf, pctbuf[0] ? " " : "", pctbuf);
+    if (wx > 4) mvwprintw(win, 0, 2, "%.*s", wx - 4, line);
+    if (use_colors) wattroff(win, COLOR_PAIR(10));
+    if (!plot) {
+        if (cc) cc->valid = false;
+        wnoutrefresh(win);
+        return;
+    }
+    int first = 0;
+    if (scroll) {
+        first = ncells - (int)shift - (per > 1 || g_view.zoom > 1);
+        if (first < 0) first = 0;
+    } else {
+        // y-axis with right-aligned labels
+        if (use_colors) wattron(win, COLOR_PAIR(10));
+        mvwprintw(win, 1, 1, "%*s |", y_label_w-3, topbuf);
+        mvwprintw(win, 1 + chart_h/2, 1, "%*s |", y_label_w-3, midbuf);
+        mvwprintw(win, 1 + chart_h - 1, 1, "%*s |", y_label_w-3, botbuf);
+        if (use_colors) wattroff(win, COLOR_PAIR(10));
+    }
+    // fill levels and mean marks of the plot columns to draw, in sub-rows
+    for (int i = first; i < ncells; ++i) {
+        uint64_t j = cend - (uint64_t)(ncells - i);
+        for (int k = 0; k < per; ++k) {
+            uint64_t a = j * (uint64_t)per + (uint64_t)k;
+            lvl[k][i] = mlvl[k][i] = 0;
+            if (a < first_entry || a >= end) continue;
+            double v = hist[a - first_entry];
+            if (units == UNITS_BITS) v *= 8.0;
+            long h = llround((v / maxv) * chart_h * sub);
+            lvl[k][i] = h < 0 ? 0 : (h > chart_h * sub ? chart_h * sub : (int)h);
+            if (mean) {
+                // zoomed out: the bar is the column peak, the mark its mean
+                double m = mean[a - first_entry];
+                if (units == UNITS_BITS) m *= 8.0;
+                long hm = llround((m / maxv) * chart_h * sub);
+                mlvl[k][i] = hm < 0 ? 0 : (hm > chart_h * sub ? chart_h * sub : (int)hm);
+            }
+        }
+    }
+    plot_glyphs_init(light);
+    int color = use_colors ? ((title && title[0]=='R') ? 1 : 2) : 0;
+    for (int yy = 0; yy < chart_h; ++yy) {
+        int n = 0;
+        for (int i = first; i < ncells; ++i, ++n) {
+            int f[2] = { 0, 0 };
+            for (int k = 0; k < per; ++k) {
+                f[k] = lvl[k][i] - yy * sub;
+                f[k] = f[k] < 0 ? 0 : (f[k] > sub ? sub : f[k]);
+            }
+#ifdef IBMON_WIDE
+            if (g_plot == PLOT_BRAILLE) {
+                // the mean is one dot per column, toggled so it shows inside the bar
+                int dots = braille_fill(0, f[0]) | braille_fill(1, f[1]);
+                for (int k = 0; k < 2; ++k)
+                    if (mlvl[k][i] && (mlvl[k][i] - 1) / sub == yy) dots ^= braille_dot[k][(mlvl[k][i] - 1) % sub];
+                wrow[n] = g_wbraille[color][dots];
+                continue;
+            }
+#endif
+            int g = f[0];
+            if (mlvl[0][i] && (mlvl[0][i] - 1) / sub == yy) g = GLYPH_MEAN;
+            else if (!g) g = GLYPH_BG;
+#ifdef IBMON_WIDE
+            if (g_plot != PLOT_ASCII) { wrow[n] = g_wglyph[color][g]; continue; }
+#endif
+            row[n] = g_glyph[color][g];
+        }
+        int y = 1 + (chart_h - 1 - yy);
+#ifdef IBMON_WIDE
+        if (g_plot != PLOT_ASCII) { mvwadd_wchnstr(win, y, base_col + first, wrow, n); continue; }
+#endif
+        mvwaddchnstr(win, y, base_col + first, row, n);
+    }
+    if (cc) {
+        // only a view at the newest entry scrolls; older ones are redrawn from the store
+        *cc = (chart_t){ .valid = g_view.offset == 0, .h = wy, .w = wx, .maxv = maxv, .end = cend,
+                         .zoom = g_view.zoom, .units = (int)units, .use_colors = use_colors, .light = light };
+    }
+    wnoutrefresh(win);
+}
+
+// The RX/TX plots of a pane are its subwindows sub_rx and sub_tx (see grid_layout).
+static void draw_device_pane(WINDOW *pane, WINDOW *sub_rx, WINDOW *sub_tx, const char *devname, mon_dev_t *md,
+                             units_t units, bool use_colors, bool light)
+{
+    int pw = getmaxx(pane);
+    if (!md->chart[0].valid && !md->chart[1].valid) {
+        // otherwise the two plots below cover the whole interior
+        werase(pane);
+        if (use_colors) wbkgd(pane, COLOR_PAIR(11));
+    }
+    if (use_colors) wattron(pane, COLOR_PAIR(13));
+    draw_ascii_box(pane);
+    if (use_colors) { wattroff(pane, COLOR_PAIR(13)); wattron(pane, COLOR_PAIR(10)); }
+    mvwprintw(pane, 0, 2, " %s ", devname);
+    if (use_colors) wattroff(pane, COLOR_PAIR(10));
+    wnoutrefresh(pane);
+    if (!sub_rx || !sub_tx) return; // pane too small for plots
+    plot_state_t *ps = mon_dev_plot(md);
+    if (!ps) return;
+    char tag[48], title[64]; int n; const double *mean; uint64_t end;
+    double r[4]; mon_dev_rates(md, g_smooth.metric, r);
+    const char *mtag = g_smooth.metric == METRIC_RAW ? "" : (g_smooth.metric == METRIC_EWMA ? " ewma" : " avg");
+    const double *h = panel_series(md, 0, pw * plot_per[g_plot], &n, &mean, &end, tag, sizeof(tag));
+    snprintf(title, sizeof(title), "RX%s%s", mtag, tag);
+    draw_panel_win(sub_rx, title, r[0], r[2], &md->rx_pct, h, mean, n, view_is_live() ? &ps->rx_max : NULL,
+                   &md->chart[0], end, units, md->rate_gbps, use_colors, light);
+    h = panel_series(md, 1, pw * plot_per[g_plot], &n, &mean, &end, tag, sizeof(tag));
+    snprintf(title, sizeof(title), "TX%s%s", mtag, tag);
+    draw_panel_win(sub_tx, title, r[1], r[3], &md->tx_pct, h, mean, n, view_is_live() ? &ps->tx_max : NULL,
+                   &md->chart[1], end, units, md->rate_gbps, use_colors, light);
+}
+
+static void draw_device_data_pane(WINDOW *pane, const char *devname, mon_dev_t *md, bool use_colors)
+{
+    werase(pane);
+    if (use_colors) { wbkgd(pane, COLOR_PAIR(11)); wattron(pane, COLOR_PAIR(13)); }
+    draw_ascii_box(pane);
+    if (use_colors) { wattroff(pane, COLOR_PAIR(13)); wattron(pane, COLOR_PAIR(10)); }
+    mvwprintw(pane, 0, 2, " %s - Raw Counters ", devname);
+    int row = 1;
+    uint64_t v;
+    if (!md->ctrs.rx_data) { // replay: only the logged counters, as of the current sample
+        mvwprintw(pane, row++, 2, "port_rcv_data:    %20" PRIu64 " %s", md->prev_rx_data, md->ctrs.data_is_words ? "(words)" : "");
+        mvwprintw(pane, row++, 2, "port_rcv_packets: %20" PRIu64, md->prev_rx_pkts);
+        mvwprintw(pane, row++, 2, "port_xmit_data:   %20" PRIu64 " %s", md->prev_tx_data, md->ctrs.data_is_words ? "(words)" : "");
+        mvwprintw(pane, row++, 2, "port_xmit_packets:%20" PRIu64, md->prev_tx_pkts);
+    }
+    if (md->ctrs.rx_data && read_u64_file(md->ctrs.rx_data, &v)) mvwprintw(pane, row++, 2, "port_rcv_data:    %20" PRIu64 " %s", v, md->ctrs.data_is_words ? "(words)" : "");
+    if (md->ctrs.rx_pkts && read_u64_file(md->ctrs.rx_pkts, &v)) mvwprintw(pane, row++, 2, "port_rcv_packets: %20" PRIu64, v);
+    if (md->ctrs.rx_errors && read_u64_file(md->ctrs.rx_errors, &v)) mvwprintw(pane, row++, 2, "port_rcv_errors:  %20" PRIu64, v);
+    if (md->ctrs.rx_remote_phy_err && read_u64_file(md->ctrs.rx_remote_phy_err, &v)) mvwprintw(pane, row++, 2, "rcv_remote_phy:   %20" PRIu64, v);
+    if (md->ctrs.rx_switch_relay_err && read_u64_file(md->ctrs.rx_switch_relay_err, &v)) mvwprintw(pane, row++, 2, "rcv_switch_relay: %20" PRIu64, v);
+    if (md->ctrs.tx_data && read_u64_file(md->ctrs.tx_data, &v)) mvwprintw(pane, row++, 2, "port_xmit_data:   %20" PRIu64 " %s", v, md->ctrs.data_is_words ? "(words)" : "");
+    if (md->ctrs.tx_pkts && read_u64_file(md->ctrs.tx_pkts, &v)) mvwprintw(pane, row++, 2, "port_xmit_packets:%20" PRIu64, v);
+    if (md->ctrs.tx_discards && read_u64_file(md->ctrs.tx_discards, &v)) mvwprintw(pane, row++, 2, "xmit_discards:    %20" PRIu64, v);
+    if (md->ctrs.tx_wait && read_u64_file(md->ctrs.tx_wait, &v)) mvwprintw(pane, row++, 2, "xmit_wait:        %20" PRIu64, v);
+    if (md->ctrs.local_phy_errors && read_u64_file(md->ctrs.local_phy_errors, &v)) mvwprintw(pane, row++, 2, "local_phy_errors: %20" PRIu64, v);
+    if (md->ctrs.symbol_error && read_u64_file(md->ctrs.symbol_error, &v)) mvwprintw(pane, row++, 2, "symbol_error:     %20" PRIu64, v);
+    if (md->ctrs.link_error_recovery && read_u64_file(md->ctrs.link_error_recovery, &v)) mvwprintw(pane, row++, 2, "link_err_recov:   %20" PRIu64, v);
+    if (md->ctrs.link_downed && read_u64_file(md->ctrs.link_downed, &v)) mvwprintw(pane, row++, 2, "link_downed:      %20" PRIu64, v);
+    if (md->ctrs.vl15_dropped && read_u64_file(md->ctrs.vl15_dropped, &v)) mvwprintw(pane, row++, 2, "vl15_dropped:     %20" PRIu64, v);
+    if (md->ctrs.excessive_buf_overrun && read_u64_file(md->ctrs.excessive_buf_overrun, &v)) mvwprintw(pane, row++, 2, "excess_buf_over:  %20" PRIu64, v);
+    if (use_colors) wattroff(pane, COLOR_PAIR(10));
+    wnoutrefresh(pane);
+}
+
+static void draw_device_info_pane(WINDOW *pane, const char *devname, bool use_colors)
+{
+    int ph, pw; getmaxyx(pane, ph, pw);
+    werase(pane);
+    if (use_colors) { wbkgd(pane, COLOR_PAIR(11)); wattron(pane, COLOR_PAIR(13)); }
+    draw_ascii_box(pane);
+    if (use_colors) { wattroff(pane, COLOR_PAIR(13)); wattron(pane, COLOR_PAIR(10)); }
+    mvwprintw(pane, 0, 2, " %s - GIDs ", devname);
+    mvwprintw(pane, 1, 2, "Idx  Type        Ndev              GID");
+    gid_entry_t *list = NULL; int cnt = 0;
+    fetch_gid_list(devname, 1, &list, &cnt);
+    int row = 2;
+    for (int i = 0; i < cnt && row < ph - 1; ++i) {
+        char line[512];
+        snprintf(line, sizeof(line), "%3d  %-10s  %-16s  %s", list[i].idx,
+                 list[i].type ? list[i].type : "",
+                 list[i].ndev ? list[i].ndev : "",
+                 list[i].gid ? list[i].gid : "");
+        mvwprintw(pane, row++, 2, "%.*s", pw - 4, line);
+    }
+    free_gid_list(list, cnt);
+    if (use_colors) wattroff(pane, COLOR_PAIR(10));
+    wnoutrefresh(pane);
+}
+
+// Microburst events, newest first; devname == NULL lists every port.
+static void draw_burst_list(WINDOW *w, const char *title, const char *devname, int port, units_t units, bool use_colors)
+{
+    int wy, wx; getmaxyx(w, wy, wx);
+    werase(w);
+    if (use_colors) { wbkgd(w, COLOR_PAIR(11)); wattron(w, COLOR_PAIR(13)); }
+    draw_ascii_box(w);
+    if (use_colors) { wattroff(w, COLOR_PAIR(13)); wattron(w, COLOR_PAIR(10)); }
+    mvwprintw(w, 0, 2, " %s ", title);
+    mvwprintw(w, 1, 2, "%.*s", wx - 4, "Start                    Port            Dir   Duration        Peak         Bytes");
+    int row = 2;
+    uint64_t oldest = g_burst_count > BURST_LOG_CAP ? g_burst_count - BURST_LOG_CAP : 0;
+    for (uint64_t k = g_burst_count; k > oldest && row < wy - 1; --k) {
+        const burst_ev_t *ev = &g_bursts[(k - 1) % BURST_LOG_CAP];
+        if (devname && (strcmp(ev->dev, devname) != 0 || ev->port != port)) continue;
+        char tbuf[32], pbuf[32], pname[160], line[320];
+        time_t t = (time_t)ev->start;
+        struct tm lt; localtime_r(&t, &lt);
+        strftime(tbuf, sizeof(tbuf), "%Y-%m-%d %H:%M:%S", &lt);
+        snprintf(pname, sizeof(pname), "%s/%d", ev->dev, ev->port);
+        snprintf(line, sizeof(line), "%s.%03d  %-14.14s  %s  %8.3f s  %s  %12" PRIu64,
+                 tbuf, (int)((ev->start - floor(ev->start)) * 1000.0), pname, ev->dir ? "TX" : "RX",
+                 ev->duration, human_rate(ev->peak_Bps, units, pbuf, sizeof(pbuf)), ev->bytes);
+        mvwprintw(w, row++, 2, "%.*s", wx - 4, line);
+    }
+    if (row == 2) mvwprintw(w, row, 2, "%.*s", wx - 4, "(no microbursts detected)");
+    if (use_colors) wattroff(w, COLOR_PAIR(10));
+    wnoutrefresh(w);
+}
+
+static bool file_read_has(const char *path, const char *needle)
+{
+    char *s = read_str_file(path);
+    if (!s) return false;
+    bool ok = (strstr(s, needle) != NULL);
+    free(s);
+    return ok;
+}
+
+// Append a device name (truncated to 127 bytes) to a growing list.
+static bool dev_list_add(char (**names)[128], int *count, const char *name, size_t len)
+{
+    if (len > 127) len = 127;
+    char (*nm)[128] = realloc(*names, (size_t)(*count + 1) * sizeof(*nm));
+    if (!nm) return false;
+    *names = nm;
+    memcpy(nm[*count], name, len);
+    nm[*count][len] = '\0';
+    (*count)++;
+    return true;
+}
+
+static int enumerate_active_devices(char (**names)[128])
+{
+    DIR *d = opendir(SYSFS_IB_BASE);
+    if (!d) return 0;
+    int count = 0; struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.') continue;
+        char p[512]; snprintf(p, sizeof(p), "%s/%s/ports/1/state", SYSFS_IB_BASE, de->d_name);
+        if (access(p, R_OK) != 0) continue;
+        if (!file_read_has(p, "ACTIVE")) continue;
+        if (!dev_list_add(names, &count, de->d_name, strlen(de->d_name))) break;
+    }
+    closedir(d);
+    return count;
+}
+
+static int parse_device_list(const char *arg, char (**names)[128])
+{
+    if (!arg) return 0;
+    int count = 0;
+    for (const char *p = arg; *p; ) {
+        size_t len = strcspn(p, ",");
+        if (len > 0 && !dev_list_add(names, &count, p, len)) break;
+        p += len;
+        if (*p) p++;
+    }
+    return count;
+}
+
+// Pages of the multi-device grid, and the port table (one row per port).
+enum { VIEW_PLOT=0, VIEW_DATA=1, VIEW_INFO=2, VIEW_BURST=3, VIEW_TABLE=4 };
+
+#define TABLE_AUTO_PORTS 16 // multi-port views open in the table above this many ports
+
+static bool init_colors(const opts_t *opt)
+{
+    if (!has_colors()) return false;
+    start_color(); use_default_colors();
+    int bg = (opt->bg_mode == 1 ? -1 : COLOR_BLACK);
+    int fg_text = (opt->bg_mode == 1 ? -1 : COLOR_WHITE);
+    int fg_border = (opt->bg_mode == 1 ? -1 : COLOR_WHITE);
+    init_pair(1, COLOR_CYAN, bg); init_pair(2, COLOR_RED, bg);
+    init_pair(10, fg_text, bg); init_pair(11, bg, bg); init_pair(12, bg, bg); init_pair(13, fg_border, bg);
+    return true;
+}
+
+static const char *view_name(int view)
+{
+    return view==VIEW_PLOT?"PLOT":(view==VIEW_DATA?"DATA":(view==VIEW_INFO?"INFO":(view==VIEW_BURST?"BURSTS":"TABLE")));
+}
+
+/* Multi-device layout: the pane of every port and the RX/TX plot
+ * subwindows inside it are built once for a terminal size and port count,
+ * so a frame only writes content into existing windows. */
+typedef struct {
+    WINDOW *win;            // NULL if the pane falls off the screen
+    WINDOW *plot[2];        // RX, TX subwindows, NULL if the pane is too small
+} pane_t;
+
+typedef struct {
+    int maxy, maxx, n, hdr_h; // what the panes were built for
+    pane_t *pane;
+    WINDOW *table;          // the port table, below the header
+    double *key;            // table scratch: sort key and ranking per port
+    int *rank;
+} grid_t;
+
+static void grid_free(grid_t *g) {
+    for (int i = 0; g->pane && i < g->n; ++i) {
+        pane_t *p = &g->pane[i];
+        if (p->plot[0]) delwin(p->plot[0]);
+        if (p->plot[1]) delwin(p->plot[1]);
+        if (p->win) delwin(p->win);
+    }
+    if (g->table) delwin(g->table);
+    free(g->pane); free(g->key); free(g->rank);
+    memset(g, 0, sizeof(*g));
+}
+
+// Lay the ports out in a near-square grid below the header. Returns true if
+// the panes were (re)built, i.e. they are blank.
+static bool grid_layout(grid_t *g, int ndev, int hdr_h) {
+    int maxy = getmaxy(stdscr), maxx = getmaxx(stdscr);
+    if (g->pane && g->maxy == maxy && g->maxx == maxx && g->n == ndev && g->hdr_h == hdr_h) return false;
+    grid_free(g);
+    g->pane = calloc((size_t)ndev, sizeof(pane_t));
+    g->key = malloc((size_t)ndev * sizeof(double));
+    g->rank = malloc((size_t)ndev * sizeof(int));
+    if (!g->pane || !g->key || !g->rank) { grid_free(g); return false; }
+    g->maxy = maxy; g->maxx = maxx; g->n = ndev; g->hdr_h = hdr_h;
+    int cols = (int)ceil(sqrt((double)ndev)); if (cols < 1) cols = 1; int rows = (ndev + cols - 1)/cols;
+    int cell_h = (maxy - hdr_h) / rows; if (cell_h < 6) cell_h = 6;
+    int cell_w = (maxx) / cols; if (cell_w < 20) cell_w = 20;
+    for (int i = 0; i < ndev; ++i) {
+        int r = i / cols, c = i % cols;
+        int y = hdr_h + r * cell_h; int h = (r == rows-1) ? (maxy - y) : cell_h;
+        int x = c * cell_w; int w = (c == cols-1) ? (maxx - x) : cell_w;
+        pane_t *p = &g->pane[i];
+        if (h <= 0 || w <= 0 || y >= maxy || x >= maxx) continue; // newwin(0, ..) would mean full screen
+        p->win = newwin(h, w, y, x);
+        if (!p->win || h < 6) continue;
+        int rx_h = (h - 2) / 2;
+        p->plot[0] = derwin(p->win, rx_h, w - 2, 1, 1);
+        p->plot[1] = derwin(p->win, h - 2 - rx_h, w - 2, 1 + rx_h, 1);
+    }
+    if (maxy - hdr_h >= 4) g->table = newwin(maxy - hdr_h, maxx, hdr_h, 0);
+    return true;
+}
+
+/* Port table (VIEW_TABLE), in the style of top: one row per port, sorted by
+ * any column. A frame ranks only the ports up to the last visible row: a
+ * bounded heap keeps the first top+rows ports in table order (O(n log k)),
+ * and only the visible rows are formatted. */
+typedef enum { TCOL_PORT, TCOL_RX, TCOL_TX, TCOL_RX_PPS, TCOL_TX_PPS, TCOL_PKT, TCOL_UTIL, TCOL_ERR, TCOL_N } tcol_t;
+
+static const struct { const char *name; int w; } tcols[TCOL_N] = {
+    { "PORT", -24 }, { "RX", 11 }, { "TX", 11 }, { "RX PPS", 11 }, { "TX PPS", 11 },
+    { "AVG PKT", 8 }, { "UTIL%", 6 }, { "ERR/S", 8 },
+};
+
+typedef struct {
+    tcol_t sort;
+    bool asc;
+    int top;                // first visible row
+} ptable_t;
+
+static ptable_t g_table = { TCOL_RX, false, 0 };
+
+// Sort column (o/O), direction (r) and scrolling keys of the table.
+static bool handle_table_key(int ch) {
+    int page = LINES > 6 ? LINES - 5 : 1;
+    switch (ch) {
+        case 'o': case 'O':
+            g_table.sort = (tcol_t)((g_table.sort + (ch == 'o' ? 1 : TCOL_N - 1)) % TCOL_N);
+            g_table.asc = g_table.sort == TCOL_PORT;
+            return true;
+        case 'r': case 'R': g_table.asc = !g_table.asc; return true;
+        case KEY_UP: g_table.top--; break;
+        case KEY_DOWN: g_table.top++; break;
+        case KEY_PPAGE: g_table.top -= page; break;
+        case KEY_NPAGE: g_table.top += page; break;
+        default: return false;
+    }
+    if (g_table.top < 0) g_table.top = 0; // the upper bound is applied when drawing
+    return true;
+}
+
+// Does port a come before port b in table order?
+static bool ptable_before(const mon_dev_t *md, const double *key, int a, int b) {
+    int c;
+    if (g_table.sort == TCOL_PORT) {
+        c = strcmp(md[a].name, md[b].name);
+        if (c == 0) c = md[a].port - md[b].port;
+    } else {
+        c = key[a] < key[b] ? -1 : key[a] > key[b];
+    }
+    if (!g_table.asc) c = -c;
+    return c != 0 ? c < 0 : a < b; // ties keep the port order
+}
+
+// Sift h[i] down the heap h[0..n), whose root is the port that comes last.
+static void ptable_sift(int *h, int n, int i, const mon_dev_t *md, const double *key) {
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, m = i;
+        if (l < n && ptable_before(md, key, h[m], h[l])) m = l;
+        if (r < n && ptable_before(md, key, h[m], h[r])) m = r;
+        if (m == i) return;
+        int t = h[i]; h[i] = h[m]; h[m] = t;
+        i = m;
+    }
+}
+
+// Fill rank[0..k) with the first k ports in table order.
+static void ptable_rank(int *rank, int k, const mon_dev_t *md, const double *key, int n) {
+    int hn = 0;
+    for (int i = 0; i < n; ++i) {
+        if (hn < k) {
+            int j = hn++;
+            rank[j] = i;
+            while (j > 0 && ptable_before(md, key, rank[(j - 1) / 2], rank[j])) {
+                int p = (j - 1) / 2, t = rank[p]; rank[p] = rank[j]; rank[j] = t;
+                j = p;
+            }
+        } else if (ptable_before(md, key, i, rank[0])) {
+            rank[0] = i;
+            ptable_sift(rank, hn, 0, md, key);
+        }
+    }
+    for (int end = hn - 1; end > 0; --end) { // heapsort the survivors into order
+        int t = rank[0]; rank[0] = rank[end]; rank[end] = t;
+        ptable_sift(rank, end, 0, md, key);
+    }
+}
+
+// Table columns of one port: { rx_Bps, tx_Bps, rx_pps, tx_pps, avg packet bytes, util %, errors/s }.
+// Unknown values (no packets, no link rate) are -1.
+static void ptable_values(const mon_dev_t *md, double *v) {
+    double r[4];
+    mon_dev_rates(md, g_smooth.metric, r);
+    for (int k = 0; k < 4; ++k) v[k] = r[k];
+    v[4] = r[2] + r[3] > 0 ? (r[0] + r[1]) / (r[2] + r[3]) : -1.0;
+    double link_Bps = md->rate_gbps * 1e9 / 8.0;
+    v[5] = link_Bps > 0 ? 100.0 * fmax(r[0], r[1]) / link_Bps : -1.0;
+    v[6] = md->watch.primed ? md->watch.err_ps : -1.0; // not watched in replay and --connect
+}
+
+static void draw_port_table(grid_t *g, mon_dev_t *md, int n, units_t units, bool use_colors)
+{
+    WINDOW *w = g->table;
+    int wy, wx; getmaxyx(w, wy, wx);
+    int rows = wy - 3;
+    if (g_table.top > n - rows) g_table.top = n - rows > 0 ? n - rows : 0;
+    int k = g_table.top + rows < n ? g_table.top + rows : n;
+    if (g_table.sort != TCOL_PORT)
+        for (int i = 0; i < n; ++i) {
+            double v[7];
+            ptable_values(&md[i], v);
+            g->key[i] = v[g_table.sort - TCOL_RX];
+        }
+    ptable_rank(g->rank, k, md, g->key, n);
+
+    werase(w);
+    if (use_colors) { wbkgd(w, COLOR_PAIR(11)); wattron(w, COLOR_PAIR(13)); }
+    draw_ascii_box(w);
+    if (use_colors) { wattroff(w, COLOR_PAIR(13)); wattron(w, COLOR_PAIR(10)); }
+    mvwprintw(w, 0, 2, " Ports %d-%d of %d - sort: %s %s [o/O:column r:reverse Up/Dn/PgUp/PgDn:scroll] ",
+              n ? g_table.top + 1 : 0, k, n, tcols[g_table.sort].name, g_table.asc ? "asc" : "desc");
+    wmove(w, 1, 2);
+    for (tcol_t c = 0; c < TCOL_N; ++c) {
+        if (c == g_table.sort) wattron(w, A_REVERSE);
+        wprintw(w, "%*s", tcols[c].w, tcols[c].name);
+        if (c == g_table.sort) wattroff(w, A_REVERSE);
+        wprintw(w, " ");
+    }
+    for (int r = g_table.top; r < k; ++r) {
+        const mon_dev_t *d = &md[g->rank[r]];
+        double v[7];
+        ptable_values(d, v);
+        char pname[160], b[7][32], line[320];
+        snprintf(pname, sizeof(pname), "%s/%d", d->name, d->port);
+        human_rate(v[0], units, b[0], sizeof(b[0])); human_rate(v[1], units, b[1], sizeof(b[1]));
+        human_pps(v[2], b[2], sizeof(b[2])); human_pps(v[3], b[3], sizeof(b[3]));
+        if (v[4] < 0) strcpy(b[4], "-"); else snprintf(b[4], sizeof(b[4]), "%.0f", v[4]);
+        if (v[5] < 0) strcpy(b[5], "-"); else snprintf(b[5], sizeof(b[5]), "%.1f", v[5]);
+        if (v[6] < 0) strcpy(b[6], "-"); else snprintf(b[6], sizeof(b[6]), "%.1f", v[6]);
+        snprintf(line, sizeof(line), "%-24.24s %11s %11s %11s %11s %8s %6s %8s",
+                 pname, b[0], b[1], b[2], b[3], b[4], b[5], b[6]);
+        mvwprintw(w, 2 + r - g_table.top, 2, "%.*s", wx - 4, line);
+    }
+    if (use_colors) wattroff(w, COLOR_PAIR(10));
+    wnoutrefresh(w);
+}
+
+// Draw `view` in every pane of the grid, rebuilding it first if the terminal changed.
+static void draw_multi_grid(grid_t *g, mon_dev_t *md, int ndev, int view, const opts_t *opt, bool use_colors, int hdr_h)
+{
+    if (grid_layout(g, ndev, hdr_h))
+        for (int i = 0; i < ndev; ++i) chart_reset(&md[i]);
+    if (!g->pane) return;
+    // ports not plotted this frame give up their plot state
+    for (int i = 0; i < ndev; ++i)
+        if (view != VIEW_PLOT || !g->pane[i].win || !g->pane[i].plot[0]) mon_dev_plot_free(&md[i]);
+    if (view == VIEW_TABLE) {
+        for (int i = 0; i < ndev; ++i) chart_reset(&md[i]); // the panes are covered
+        if (g->table) draw_port_table(g, md, ndev, opt->units, use_colors);
+        return;
+    }
+    for (int i = 0; i < ndev; ++i) {
+        pane_t *p = &g->pane[i];
+        if (!p->win) continue;
+        if (view != VIEW_PLOT) chart_reset(&md[i]);
+        if (view == VIEW_PLOT)
+            draw_device_pane(p->win, p->plot[0], p->plot[1], md[i].name, &md[i], opt->units, use_colors, false);
+        else if (view == VIEW_DATA)
+            draw_device_data_pane(p->win, md[i].name, &md[i], use_colors);
+        else if (view == VIEW_BURST) {
+            char t[160]; snprintf(t, sizeof(t), "%s - Microbursts", md[i].name);
+            draw_burst_list(p->win, t, md[i].name, md[i].port, opt->units, use_colors);
+        } else
+            draw_device_info_pane(p->win, md[i].name, use_colors);
+    }
+}
+
+static int run_multi_mode(char devs[][128], int ndev, opts_t *opt)
+{
+    bool sum_json = false;
+    FILE *sum = opt->summary_path ? summary_open(opt->summary_path, &sum_json) : NULL;
+    mon_dev_t *md = calloc(ndev, sizeof(mon_dev_t));
+    for (int i = 0; i < ndev; ++i)
+        if (mon_dev_open(&md[i], devs[i], 1, opt->retention)) mon_dev_prime(&md[i]);
+    sinks_t sinks;
+    if (!sinks_open(&sinks, opt, md, ndev, false)) {
+        sinks_close(&sinks);
+        for (int i = 0; i < ndev; ++i) mon_dev_close(&md[i]);
+        free(md);
+        if (sum) fclose(sum);
+        return 1;
+    }
+    sinks_prime(&sinks, md, now_monotonic(), now_realtime());
+    signal(SIGINT, on_sigint);
+    signal(SIGWINCH, on_sigwinch);
+    initscr(); cbreak(); noecho(); nodelay(stdscr, FALSE); keypad(stdscr, TRUE); curs_set(0); timeout((int)(opt->interval * 1000));
+    bool use_colors = init_colors(opt);
+    double start_time = now_monotonic();
+    double win_start = now_monotonic();
+    FILE *blog = opt->burst_log_path ? burst_log_open(opt->burst_log_path) : NULL;
+    uint64_t blog_written = 0;
+    int view = ndev > TABLE_AUTO_PORTS ? VIEW_TABLE : VIEW_PLOT; bool paused = false;
+    frame_sched_t fs; frame_init(&fs, opt->fps, opt->interval);
+    grid_t grid = {0}; // rebuilt by draw_multi_grid() when the size changes
+    // keys do not trigger a sampling pass, which is slow with many ports
+    double next_sample = now_monotonic() + opt->interval;
+    while (!g_stop) {
+        if (g_resized) {
+            // sampling is not interrupted: only the screen is rebuilt
+            g_resized = 0;
+            endwin();
+            refresh();
+            for (int i = 0; i < ndev; ++i) chart_reset(&md[i]);
+            frame_touch(&fs, true);
+        }
+        double wait = paused ? opt->interval : next_sample - now_monotonic();
+        timeout(wait > 0 ? (int)ceil(wait * 1000) : 0);
+        int ch = getch();
+        bool fast_switch = false;
+        if (ch != ERR) frame_touch(&fs, true);
+        if (ch != ERR && !handle_view_key(ch) && !(view == VIEW_TABLE && handle_table_key(ch))) {
+            if (ch == 'q' || ch == 'Q') break;
+            if (ch == 'u' || ch == 'U') opt->units = (opt->units == UNITS_BITS) ? UNITS_BYTES : UNITS_BITS;
+            if (ch == 'p' || ch == 'P') paused = !paused;
+            if (ch == 'm' || ch == 'M') g_smooth.metric = (metric_t)((g_smooth.metric + 1) % 3);
+            if (ch == 'd' || ch == 'D') { view = (view == VIEW_DATA) ? VIEW_PLOT : VIEW_DATA; fast_switch = true; }
+            if (ch == 'i' || ch == 'I') { view = (view == VIEW_INFO) ? VIEW_PLOT : VIEW_INFO; fast_switch = true; }
+            if (ch == 'b' || ch == 'B') { view = (view == VIEW_BURST) ? VIEW_PLOT : VIEW_BURST; fast_switch = true; }
+            if (ch == 't' || ch == 'T') { view = (view == VIEW_TABLE) ? VIEW_PLOT : VIEW_TABLE; fast_switch = true; }
+            if (ch == KEY_RESIZE) for (int i = 0; i < ndev; ++i) chart_reset(&md[i]); // screen was cleared
+        }
+        double nowt = now_monotonic();
+        if (!fast_switch && !paused && nowt >= next_sample) {
+            next_sample = next_sample + opt->interval > nowt ? next_sample + opt->interval : nowt + opt->interval;
+            for (int i = 0; i < ndev; ++i) {
+                if (!mon_dev_sample(&md[i], nowt)) continue;
+                mon_dev_record(&md[i], nowt);
+                frame_touch(&fs, false);
+            }
+            sinks_tick(&sinks, opt, md, ndev, nowt, now_realtime());
+            if (opt->pctl_window > 0 && nowt - win_start >= opt->pctl_window) {
+                summary_window(sum, sum_json, md, ndev, now_realtime());
+                win_start = nowt;
+            }
+            if (blog) burst_log_flush(blog, &blog_written);
+        }
+        if (opt->duration > 0 && (now_monotonic() - start_time) >= opt->duration) break;
+        if (!frame_due(&fs, now_monotonic())) continue;
+        // Header (avoid full-screen erase to reduce flicker)
+        int maxx = getmaxx(stdscr);
+        mvhline(0, 0, ' ', maxx);
+        if (use_colors) attron(COLOR_PAIR(10));
+        mvprintw(0,2," ibmon - multi-device (%d) [%s] [%s] [q:quit u:units p:pause m:metric d:data i:info b:bursts t:table </>:scroll -/+:zoom l:live] ",
+                 ndev, view_name(view), metric_name(g_smooth.metric));
+        if (use_colors) attroff(COLOR_PAIR(10));
+        draw_multi_grid(&grid, md, ndev, view, opt, use_colors, 1);
+        doupdate();
+    }
+    grid_free(&grid);
+    burst_finish(md, ndev);
+    if (sum) { summary_window(sum, sum_json, md, ndev, now_realtime()); fclose(sum); }
+    if (blog) { burst_log_flush(blog, &blog_written); fclose(blog); }
+    for (int i=0;i<ndev;++i) mon_dev_close(&md[i]);
+    free(md);
+    endwin();
+    sinks_close(&sinks);
+    return 0;
+}
+
+static void sleep_until(double t_mono) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)t_mono;
+    ts.tv_nsec = (long)((t_mono - (double)ts.tv_sec) * 1e9);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && !g_stop) {}
+}
+
+// Sample without curses and stream records to stdout until SIGINT/--duration.
+static int run_headless(char devs[][128], int ndev, opts_t *opt)
+{
+    signal(SIGINT, on_sigint);
+    signal(SIGTERM, on_sigint);
+    signal(SIGPIPE, SIG_IGN);
+    mon_dev_t *md = calloc((size_t)ndev, sizeof(mon_dev_t));
+    if (!md) { fprintf(stderr, "Out of memory\n"); return 1; }
+    for (int i = 0; i < ndev; ++i) {
+        if (!mon_dev_open(&md[i], devs[i], opt->port, opt->retention) || !mon_dev_prime(&md[i]))
+            fprintf(stderr, "Warning: no usable counters for %s port %d\n", devs[i], opt->port);
+    }
+    bool sum_json = false;
+    FILE *sum = opt->summary_path ? summary_open(opt->summary_path, &sum_json) : NULL;
+    FILE *blog = opt->burst_log_path ? burst_log_open(opt->burst_log_path) : NULL;
+    uint64_t blog_written = 0;
+    int rc = 1;
+    sinks_t sinks;
+    srv_t *srv = NULL;
+    ndjson_t nj = {0};
+    if (!sinks_open(&sinks, opt, md, ndev, false)) goto out;
+    sinks_prime(&sinks, md, now_monotonic(), now_realtime());
+    // the daemon keeps stdout quiet; its viewers get the samples from the socket
+    if (opt->serve_path && !(srv = srv_open(opt->serve_path, md, ndev, opt->interval))) goto out;
+    if (!srv && !ndjson_open(&nj, STDOUT_FILENO, md, ndev)) { fprintf(stderr, "Out of memory\n"); goto out; }
+    rc = 0;
+
+    double start_time = now_monotonic(), win_start = start_time;
+    double next = start_time + opt->interval;
+    while (!g_stop && !nj.ob.failed) {
+        if (srv) srv_wait(srv, next);
+        else sleep_until(next);
+        if (g_stop) break;
+        double now = now_monotonic(), now_r = now_realtime();
+        for (int i = 0; i < ndev; ++i) {
+            if (!mon_dev_sample(&md[i], now)) continue;
+            // nothing is drawn: keep history only for HISTORY requests, percentiles only for --summary
+            if (srv) mon_dev_record(&md[i], now);
+            else if (sum) { pctl_add(&md[i].rx_pct, md[i].rx_Bps); pctl_add(&md[i].tx_pct, md[i].tx_Bps); }
+            if (!srv) ndjson_sample(&nj, i, &md[i], now_r, now);
+        }
+        sinks_tick(&sinks, opt, md, ndev, now, now_r);
+        if (srv) {
+            srv_tick(srv, now, now_r);
+        } else {
+            ndjson_bursts(&nj);
+            ndjson_events(&nj);
+            ob_flush(&nj.ob);
+        }
+        if (blog) burst_log_flush(blog, &blog_written);
+        if (opt->pctl_window > 0 && now - win_start >= opt->pctl_window) {
+            summary_window(sum, sum_json, md, ndev, now_r);
+            win_start = now;
+        }
+        if (opt->duration > 0 && now - start_time >= opt->duration) break;
+        // keep a fixed cadence; skip missed ticks instead of bursting to catch up
+        next += opt->interval;
+        if (next < now) next = now + opt->interval;
+    }
+    burst_finish(md, ndev);
+    if (!srv && !nj.ob.failed) { ndjson_bursts(&nj); ob_flush(&nj.ob); }
+    if (sum) summary_window(sum, sum_json, md, ndev, now_realtime());
+out: // also the setup failure path: everything below copes with what was not opened
+    ndjson_close(&nj);
+    srv_close(srv);
+    sinks_close(&sinks);
+    if (sum) fclose(sum);
+    if (blog) { burst_log_flush(blog, &blog_written); fclose(blog); }
+    for (int i = 0; i < ndev; ++i) mon_dev_close(&md[i]);
+    free(md);
+    return rc;
+}
+
+/* Replay of a recorded --binlog or --csv file through the multi-device grid.
+ * The whole log is loaded up front as cumulative counters per port; playback
+ * then feeds them to mon_dev_apply() at `speed` times the recorded pace, so
+ * rendering only depends on how far the log position moved since the last
+ * frame. Rates from a CSV are turned back into counters (rate * dt). */
+#define REPLAY_FRAME_MS 100
+
+typedef struct {
+    int n;                  // ports
+    char (*name)[128];
+    int *port;
+    double *rate_gbps;      // 0 if unknown
+    bool *words;            // data counters in 4-byte words
+    size_t ns, cap;         // samples
+    double *t;              // sample times (recording's monotonic seconds)
+    uint64_t *ctr;          // ns x n x { rx_data, tx_data, rx_pkts, tx_pkts }
+    double real_offset;     // wall clock minus t, 0 if the log does not say
+    uint64_t bad_blocks;
+} replay_t;
+
+static bool replay_add_port(replay_t *rp, const char *name, int port) {
+    char (*nm)[128] = realloc(rp->name, (size_t)(rp->n + 1) * sizeof(*nm));
+    if (nm) rp->name = nm;
+    int *pt = realloc(rp->port, (size_t)(rp->n + 1) * sizeof(int));
+    if (pt) rp->port = pt;
+    double *rg = realloc(rp->rate_gbps, (size_t)(rp->n + 1) * sizeof(double));
+    if (rg) rp->rate_gbps = rg;
+    bool *w = realloc(rp->words, (size_t)(rp->n + 1) * sizeof(bool));
+    if (w) rp->words = w;
+    if (!nm || !pt || !rg || !w) return false;
+    snprintf(rp->name[rp->n], 128, "%s", name);
+    rp->port[rp->n] = port; rp->rate_gbps[rp->n] = 0.0; rp->words[rp->n] = false;
+    rp->n++;
+    return true;
+}
+
+// Append a sample at time t; returns its n x 4 counter row (zeroed), NULL on OOM.
+static uint64_t *replay_push(replay_t *rp, double t) {
+    if (rp->ns == rp->cap) {
+        size_t cap = rp->cap ? rp->cap * 2 : 1024;
+        double *nt = realloc(rp->t, cap * sizeof(double));
+        if (nt) rp->t = nt;
+        uint64_t *nc = realloc(rp->ctr, cap * (size_t)rp->n * 4 * sizeof(uint64_t));
+        if (nc) rp->ctr = nc;
+        if (!nt || !nc) return NULL;
+        rp->cap = cap;
+    }
+    rp->t[rp->ns] = t;
+    uint64_t *row = rp->ctr + rp->ns * (size_t)rp->n * 4;
+    memset(row, 0, (size_t)rp->n * 4 * sizeof(uint64_t));
+    rp->ns++;
+    return row;
+}
+
+static void replay_free(replay_t *rp) {
+    free(rp->name); free(rp->port); free(rp->rate_gbps); free(rp->words);
+    free(rp->t); free(rp->ctr);
+    memset(rp, 0, sizeof(*rp));
+}
+
+static const char *replay_load_binlog(replay_t *rp, const uint8_t *buf, size_t len) {
+    iblog_header_t h;
+    const char *err = iblog_read_header(buf, len, &h);
+    if (err) return err;
+    int idx[BINLOG_COUNTERS];
+    for (int k = 0; k < BINLOG_COUNTERS; ++k) {
+        idx[k] = iblog_counter_index(&h, binlog_counter_names[k]);
+        if (idx[k] < 0) { free(h.ports); return "log lacks the data/packet counters"; }
+    }
+    for (int i = 0; i < h.nports; ++i) {
+        if (!replay_add_port(rp, h.ports[i].name, h.ports[i].port)) { free(h.ports); return "out of memory"; }
+        rp->rate_gbps[i] = h.ports[i].rate_mbps / 1000.0;
+        rp->words[i] = (h.ports[i].flags & IBLOG_PORT_DATA_WORDS) != 0;
+    }
+    size_t nv = (size_t)h.nports * (size_t)h.ncounters;
+    uint64_t *vals = calloc(nv + 1, sizeof(uint64_t));
+    if (!vals) { free(h.ports); return "out of memory"; }
+    size_t o = h.size;
+    const uint8_t *payload; uint32_t plen, ns;
+    bool have_offset = false;
+    while (iblog_next_block(buf, len, &o, &payload, &plen, &ns, &rp->bad_blocks)) {
+        const uint8_t *p = payload, *end = payload + plen;
+        uint64_t real_ns = 0, mono_ns = 0;
+        for (uint32_t s = 0; s < ns; ++s) {
+            if (!iblog_read_sample(&p, end, s, &real_ns, &mono_ns, vals, nv)) { rp->bad_blocks++; break; }
+            double t = (double)mono_ns / 1e9;
+            if (s == 0 && !have_offset) { rp->real_offset = (double)real_ns / 1e9 - t; have_offset = true; }
+            if (rp->ns && t <= rp->t[rp->ns - 1]) continue;
+            uint64_t *row = replay_push(rp, t);
+            if (!row) { free(vals); free(h.ports); return "out of memory"; }
+            for (int i = 0; i < h.nports; ++i)
+                for (int k = 0; k < BINLOG_COUNTERS; ++k)
+                    row[i * 4 + k] = vals[(size_t)i * h.ncounters + idx[k]];
+        }
+    }
+    free(vals); free(h.ports);
+    return NULL;
+}
+
+// Split a CSV line in place; returns the number of fields.
+static int csv_split(char *line, char **f, int maxf) {
+    int n = 0;
+    line[strcspn(line, "\r\n")] = '\0';
+    for (char *s = line; n < maxf; ) {
+        f[n++] = s;
+        char *c = strchr(s, ',');
+        if (!c) break;
+        *c = '\0'; s = c + 1;
+    }
+    return n;
 }
 
-static double now_monotonic(void) {
-    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+/* Any of the CSV layouts ibmon writes: single (time_s,rx_Bps,...), long
+ * (time_s,device,port,rx_Bps,...) or wide (time_s,DEV:PORT:rx_Bps,...).
+ * The first tick is the baseline; every later one adds rate * dt. */
+static const char *replay_load_csv(replay_t *rp, FILE *f, const char *path) {
+    enum { MAXF = 4 * IBLOG_MAX_PORTS + 8 };
+    char **fld = malloc(MAXF * sizeof(char *));
+    char *line = NULL; size_t lcap = 0;
+    const char *err = NULL;
+    if (!fld) return "out of memory";
+    if (getline(&line, &lcap, f) < 0) { free(fld); return "empty file"; }
+    int nf = csv_split(line, fld, MAXF);
+    csv_layout_t layout;
+    if (strcmp(fld[0], "time_s") != 0) err = "unrecognized CSV header";
+    else if (nf == 7 && strcmp(fld[1], "device") == 0) layout = CSV_LONG;
+    else if (nf == 5 && strcmp(fld[1], "rx_Bps") == 0) layout = CSV_SINGLE;
+    else if (nf >= 5 && (nf - 1) % 4 == 0 && strchr(fld[1], ':')) layout = CSV_WIDE;
+    else err = "unrecognized CSV header";
+    if (err) { free(line); free(fld); return err; }
+    if (layout == CSV_SINGLE) {
+        const char *b = strrchr(path, '/');
+        char nm[128]; snprintf(nm, sizeof(nm), "%s", b ? b + 1 : path);
+        char *dot = strrchr(nm, '.'); if (dot && dot != nm) *dot = '\0';
+        if (!replay_add_port(rp, nm, 1)) err = "out of memory";
+    } else if (layout == CSV_WIDE) {
+        for (int c = 1; c + 3 < nf && !err; c += 4) {
+            // DEV:PORT:rx_Bps; the port is the last number before the column name
+            char *p2 = strrchr(fld[c], ':'), *p1 = NULL;
+            if (p2) { *p2 = '\0'; p1 = strrchr(fld[c], ':'); }
+            if (!p1) { err = "unrecognized CSV header"; break; }
+            *p1 = '\0';
+            if (!replay_add_port(rp, fld[c], atoi(p1 + 1))) err = "out of memory";
+        }
+    }
+    // long layout: ports are collected from the first tick, which is only
+    // pushed once the second one starts
+    double t_first = 0.0; bool in_first = true;
+    int last = -1;
+    uint64_t *row = NULL;
+    while (!err && getline(&line, &lcap, f) >= 0) {
+        nf = csv_split(line, fld, MAXF);
+        if (nf < 5 || strcmp(fld[0], "time_s") == 0) continue; // blank line or repeated header
+        double t = strtod(fld[0], NULL);
+        int i = 0;
+        if (layout == CSV_LONG) {
+            if (nf != 7) continue;
+            int port = atoi(fld[2]);
+            // rows come in port order, so the next port is tried first
+            i = rp->n ? (last + 1) % rp->n : 0;
+            if (rp->n == 0 || rp->port[i] != port || strcmp(rp->name[i], fld[1]) != 0)
+                for (i = 0; i < rp->n && (rp->port[i] != port || strcmp(rp->name[i], fld[1]) != 0); ++i) {}
+            if (in_first && (rp->n == 0 || t == t_first)) {
+                t_first = t;
+                if (i == rp->n && !replay_add_port(rp, fld[1], port)) err = "out of memory";
+                last = i;
+                continue;
+            }
+            if (in_first) {
+                in_first = false;
+                if (!replay_push(rp, t_first)) { err = "out of memory"; break; }
+            }
+            if (i == rp->n) continue; // port not in the first tick
+            last = i;
+        } else if (nf != 1 + 4 * rp->n) continue;
+        if (!rp->ns || t > rp->t[rp->ns - 1]) {
+            row = replay_push(rp, t);
+            if (!row) { err = "out of memory"; break; }
+            if (rp->ns > 1) memcpy(row, row - (size_t)rp->n * 4, (size_t)rp->n * 4 * sizeof(uint64_t));
+        } else if (t < rp->t[rp->ns - 1]) continue;
+        if (rp->ns == 1) continue; // baseline
+        double dt = rp->t[rp->ns - 1] - rp->t[rp->ns - 2];
+        const uint64_t *prev = row - (size_t)rp->n * 4;
+        int j0 = layout == CSV_LONG ? i : 0, j1 = layout == CSV_LONG ? i + 1 : rp->n;
+        for (int j = j0; j < j1; ++j)
+            for (int k = 0; k < 4; ++k) {
+                double r = strtod(fld[layout == CSV_LONG ? 3 + k : 1 + j * 4 + k], NULL);
+                row[j * 4 + k] = prev[j * 4 + k] + (r > 0 ? (uint64_t)llround(r * dt) : 0);
+            }
+    }
+    if (!err && layout == CSV_LONG && in_first && rp->n && !replay_push(rp, t_first)) err = "out of memory";
+    free(line); free(fld);
+    return err;
 }
 
-static const char *human_rate(double Bps, units_t units, char *buf, size_t buflen) {
-    static const char *u[] = { " ", "K", "M", "G", "T", "P" };
-    double v = Bps;
-    if (units == UNITS_BITS) v *= 8.0;
-    int i = 0;
-    while (fabs(v) >= 1000.0 && i < 5) { v /= 1000.0; i++; }
-    snprintf(buf, buflen, "%6.2f %s%s", v, u[i], units == UNITS_BITS ? "b/s" : "B/s");
-    return buf;
+static bool replay_load(replay_t *rp, const char *path) {
+    memset(rp, 0, sizeof(*rp));
+    FILE *f = fopen(path, "rb");
+    if (!f) { fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno)); return false; }
+    char magic[8] = {0};
+    size_t got = fread(magic, 1, sizeof(magic), f);
+    const char *err = NULL;
+    if (got == sizeof(magic) && memcmp(magic, IBLOG_MAGIC, 8) == 0) {
+        struct stat st;
+        uint8_t *buf = MAP_FAILED;
+        if (fstat(fileno(f), &st) == 0 && st.st_size > 0)
+            buf = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+        if (buf == MAP_FAILED) err = strerror(errno);
+        else { err = replay_load_binlog(rp, buf, (size_t)st.st_size); munmap(buf, (size_t)st.st_size); }
+    } else {
+        rewind(f);
+        err = replay_load_csv(rp, f, path);
+    }
+    fclose(f);
+    if (!err && (rp->n == 0 || rp->ns < 2)) err = "fewer than two samples";
+    if (err) { fprintf(stderr, "%s: %s\n", path, err); replay_free(rp); return false; }
+    if (rp->bad_blocks) fprintf(stderr, "Warning: %s: skipped %" PRIu64 " damaged block(s)\n", path, rp->bad_blocks);
+    return true;
 }
 
-static const char *human_pps(double pps, char *buf, size_t buflen) {
-    static const char *u[] = { " ", "K", "M", "G", "T" };
-    double v = pps; int i = 0;
-    while (fabs(v) >= 1000.0 && i < 4) { v /= 1000.0; i++; }
-    snprintf(buf, buflen, "%6.2f %spps", v, u[i]);
-    return buf;
+// Set up a port whose counters come from a log or an ibmond instead of sysfs.
+static void mon_dev_open_remote(mon_dev_t *md, const char *name, int port, double rate_gbps, bool words,
+                                double retention_s, double t_real) {
+    memset(md, 0, sizeof(*md));
+    snprintf(md->name, sizeof(md->name), "%s", name);
+    md->port = port;
+    md->rate_gbps = rate_gbps;
+    md->ctrs.data_is_words = words;
+    hstore_init(&md->hs, retention_s);
+    pctl_reset(&md->rx_pct, t_real);
+    pctl_reset(&md->tx_pct, t_real);
 }
 
-static double parse_rate_gbps(const char *rate) {
-    if (!rate) return 0.0;
-    // Expect leading number, e.g., "100 Gb/sec (4X EDR)"
-    char *end = NULL;
-    double v = strtod(rate, &end);
-    if (end == rate) return 0.0;
-    return v;
+// Put every port back at the first sample of the log.
+static void replay_rewind(mon_dev_t *md, const replay_t *rp, double retention) {
+    for (int i = 0; i < rp->n; ++i) {
+        mon_dev_close(&md[i]);
+        mon_dev_open_remote(&md[i], rp->name[i], rp->port[i], rp->rate_gbps[i], rp->words[i], retention,
+                            rp->t[0] + rp->real_offset);
+        const uint64_t *c = rp->ctr + (size_t)i * 4;
+        md[i].prev_rx_data = c[0]; md[i].prev_tx_data = c[1];
+        md[i].prev_rx_pkts = c[2]; md[i].prev_tx_pkts = c[3];
+        md[i].prev_t = rp->t[0];
+    }
+    g_burst_count = 0;
 }
 
-static void format_scale_label(double v_disp_per_s, units_t units, char *buf, size_t buflen) {
-    // v_disp_per_s is already in chosen display units (bits or bytes per second)
-    const char *suffixes_bits[] = {"b/s","Kb/s","Mb/s","Gb/s","Tb/s","Pb/s"};
-    const char *suffixes_bytes[] = {"B/s","KB/s","MB/s","GB/s","TB/s","PB/s"};
-    double v = v_disp_per_s;
-    int idx = 0;
-    while (v >= 1000.0 && idx < 5) { v /= 1000.0; idx++; }
-    const char *suf = (units == UNITS_BITS) ? suffixes_bits[idx] : suffixes_bytes[idx];
-    snprintf(buf, buflen, "%6.2f %s", v, suf);
+static void replay_apply(mon_dev_t *md, const replay_t *rp, size_t s) {
+    const uint64_t *row = rp->ctr + s * (size_t)rp->n * 4;
+    for (int i = 0; i < rp->n; ++i) {
+        const uint64_t *c = row + (size_t)i * 4;
+        mon_dev_apply(&md[i], rp->t[s], c[0], c[1], c[2], c[3]);
+        mon_dev_record(&md[i], rp->t[s]);
+    }
 }
 
-static void draw_ascii_box(WINDOW *w)
-{
-    wborder(w, '|', '|', '-', '-', '+', '+', '+', '+');
+static void fmt_hms(char *buf, size_t n, double s) {
+    long v = (long)(s < 0 ? 0 : s);
+    snprintf(buf, n, "%ld:%02ld:%02ld", v / 3600, (v / 60) % 60, v % 60);
 }
 
-static void draw_panel_win(WINDOW *win, const char *title, double cur_Bps, double cur_pps,
-                           double *hist, int hist_len, units_t units, double rate_gbps,
-                           bool use_colors, bool light)
+/* Keys: p/space pause, f/s double/halve the speed, [ ] seek -/+1 minute,
+ * { } seek -/+10 minutes, Home/End (or 0/$) jump to either end, plus the
+ * view keys of the live grid. Seeking back replays from the start, which
+ * takes well under a second even for long captures. */
+static int run_replay(const char *path, opts_t *opt)
 {
-    int wy, wx; getmaxyx(win, wy, wx);
-    werase(win);
-    if (use_colors) {
-        wbkgd(win, COLOR_PAIR(11));
-        wbkgdset(win, COLOR_PAIR(11) | ' ');
-        wattron(win, COLOR_PAIR(13));
-    }
-    draw_ascii_box(win);
-    if (use_colors) wattroff(win, COLOR_PAIR(13));
-    char ratebuf[64], ppsbuf[64];
-    human_rate(cur_Bps, units, ratebuf, sizeof(ratebuf));
-    human_pps(cur_pps, ppsbuf, sizeof(ppsbuf));
-    if (use_colors) wattron(win, COLOR_PAIR(10));
-    mvwprintw(win, 0, 2, " %s  %s  %s ", title ? title : "", ratebuf, ppsbuf);
+    replay_t rp;
+    if (!replay_load(&rp, path)) return 1;
+    // a log's intervals may vary: check against their mean, and say so at
+    // exit if a shorter stretch still filled a window
+    if (rp.ns > 1 && !windows_fit((rp.t[rp.ns - 1] - rp.t[0]) / (double)(rp.ns - 1))) { replay_free(&rp); return 2; }
+    mon_dev_t *md = calloc((size_t)rp.n, sizeof(mon_dev_t));
+    if (!md) { fprintf(stderr, "Out of memory\n"); replay_free(&rp); return 1; }
+    g_replay_real_offset = rp.real_offset;
+    replay_rewind(md, &rp, opt->retention);
 
-    int y_label_w = 12;
-    int chart_h = wy - 3;
-    int chart_w = wx - 2 - y_label_w;
-    if (chart_h < 3 || chart_w < 10 || hist_len < 2) {
-        wnoutrefresh(win);
-        return;
-    }
-    int samples = chart_w;
-    if (samples > hist_len) samples = hist_len;
-    double maxv = 1.0;
-    for (int i = 0; i < samples; ++i) {
-        double v = hist[hist_len - samples + i];
-        if (units == UNITS_BITS) v *= 8.0;
-        if (v > maxv) maxv = v;
-    }
-    if (units == UNITS_BITS && rate_gbps > 0) {
-        double link_bps = rate_gbps * 1e9;
-        if (link_bps > 0 && link_bps < maxv) maxv = link_bps;
-    }
-    // dynamic labels with appropriate units
-    char topbuf[32], midbuf[32], botbuf[32];
-    format_scale_label(maxv, units, topbuf, sizeof(topbuf));
-    format_scale_label(maxv/2.0, units, midbuf, sizeof(midbuf));
-    snprintf(botbuf, sizeof(botbuf), "%s", (units == UNITS_BITS) ? "0.00 b/s" : "0.00 B/s");
-    int lblw = (int)strlen(topbuf);
-    if ((int)strlen(midbuf) > lblw) lblw = (int)strlen(midbuf);
-    if ((int)strlen(botbuf) > lblw) lblw = (int)strlen(botbuf);
-    y_label_w = lblw + 3; // 1 space padding + '|' + margin
-    chart_w = wx - 2 - y_label_w;
-    if (chart_w < 1) chart_w = 1;
-    // y-axis with right-aligned labels
-    mvwprintw(win, 1, 1, "%*s |", y_label_w-3, topbuf);
-    mvwprintw(win, 1 + chart_h/2, 1, "%*s |", y_label_w-3, midbuf);
-    mvwprintw(win, 1 + chart_h - 1, 1, "%*s |", y_label_w-3, botbuf);
-
-    // right-aligned drawing: newest sample at far right
-    int base_col = y_label_w + 1 + (chart_w - samples);
-    // fill plot area with dots in bar color; ensure background matches panel
-    if (!light) {
-        if (use_colors) wcolor_set(win, (title && title[0]=='R')? 1 : 2, NULL);
-        for (int i = 0; i < samples; ++i) {
-            int col = base_col + i;
-            for (int yy = 0; yy < chart_h; ++yy) {
-                int y = 1 + (chart_h - 1 - yy);
-                mvwaddch(win, y, col, '.');
+    signal(SIGINT, on_sigint);
+    initscr(); cbreak(); noecho(); keypad(stdscr, TRUE); curs_set(0);
+    timeout(opt->fps > 0 ? (int)ceil(1000.0 / opt->fps) : REPLAY_FRAME_MS);
+    bool use_colors = init_colors(opt);
+    const double t0 = rp.t[0], t_end = rp.t[rp.ns - 1];
+    double pos = t0, speed = opt->replay_speed, last_wall = now_monotonic();
+    size_t next = 1;   // first sample not yet applied
+    int view = rp.n > TABLE_AUTO_PORTS ? VIEW_TABLE : VIEW_PLOT; bool paused = false;
+    frame_sched_t fs; frame_init(&fs, opt->fps, 0.0);
+    grid_t grid = {0};
+    while (!g_stop) {
+        int ch = getch();
+        double target = -1.0;
+        if (ch != ERR) frame_touch(&fs, true);
+        else if (!paused) frame_touch(&fs, false);
+        if (ch != ERR && !handle_view_key(ch) && !(view == VIEW_TABLE && handle_table_key(ch))) {
+            if (ch == 'q' || ch == 'Q') break;
+            switch (ch) {
+                case 'p': case 'P': case ' ':
+                    if (paused && pos >= t_end) target = t0; // play again from the start
+                    paused = !paused; break;
+                case 'f': case 'F': if (speed < 65536) speed *= 2; break;
+                case 's': case 'S': if (speed > 1.0 / 64) speed /= 2; break;
+                case '[': target = pos - 60; break;
+                case ']': target = pos + 60; break;
+                case '{': target = pos - 600; break;
+                case '}': target = pos + 600; break;
+                case '0': case KEY_HOME: target = t0; break;
+                case '$': case KEY_END: target = t_end; break;
+                case 'u': case 'U': opt->units = (opt->units == UNITS_BITS) ? UNITS_BYTES : UNITS_BITS; break;
+                case 'm': case 'M': g_smooth.metric = (metric_t)((g_smooth.metric + 1) % 3); break;
+                case 'd': case 'D': view = (view == VIEW_DATA) ? VIEW_PLOT : VIEW_DATA; break;
+                case 'i': case 'I': view = (view == VIEW_INFO) ? VIEW_PLOT : VIEW_INFO; break;
+                case 'b': case 'B': view = (view == VIEW_BURST) ? VIEW_PLOT : VIEW_BURST; break;
+                case 't': case 'T': view = (view == VIEW_TABLE) ? VIEW_PLOT : VIEW_TABLE; break;
+                case KEY_RESIZE: for (int i = 0; i < rp.n; ++i) chart_reset(&md[i]); break; // screen was cleared
             }
         }
-    }
-    // draw bars on top
-    if (use_colors) wcolor_set(win, (title && title[0]=='R')? 1 : 2, NULL);
-    for (int i = 0; i < samples; ++i) {
-        double v = hist[hist_len - samples + i];
-        if (units == UNITS_BITS) v *= 8.0;
-        int h = (int)llround((v / maxv) * chart_h);
-        if (h < 0) h = 0;
-        if (h > chart_h) h = chart_h;
-        int col = base_col + i;
-        for (int yy = 0; yy < h; ++yy) {
-            int y = 1 + (chart_h - 1 - yy);
-            mvwaddch(win, y, col, '|');
+        double wall = now_monotonic();
+        if (!paused && target < 0) pos += (wall - last_wall) * speed;
+        last_wall = wall;
+        if (target >= 0) {
+            pos = target;
+            if (pos < rp.t[next - 1]) { replay_rewind(md, &rp, opt->retention); next = 1; }
+        }
+        if (pos < t0) pos = t0;
+        if (pos >= t_end) { pos = t_end; paused = true; }
+        while (next < rp.ns && rp.t[next] <= pos) replay_apply(md, &rp, next++);
+        if (!frame_due(&fs, now_monotonic())) continue;
+
+        int maxx = getmaxx(stdscr);
+        char at[32], len[32];
+        fmt_hms(at, sizeof(at), pos - t0); fmt_hms(len, sizeof(len), t_end - t0);
+        char when[32] = "";
+        if (rp.real_offset != 0.0) {
+            time_t tt = (time_t)(pos + rp.real_offset); struct tm lt; localtime_r(&tt, &lt);
+            strftime(when, sizeof(when), " %Y-%m-%d %H:%M:%S", &lt);
         }
+        mvhline(0, 0, ' ', maxx);
+        if (use_colors) attron(COLOR_PAIR(10));
+        mvprintw(0, 2, " ibmon - replay (%d) [%s] [%s] %s/%s%s x%g%s [q:quit p:pause f/s:speed [/]:1m {/}:10m 0/$:ends d:data b:bursts] ",
+                 rp.n, view_name(view), metric_name(g_smooth.metric), at, len, when, speed,
+                 pos >= t_end ? " [END]" : (paused ? " [PAUSED]" : ""));
+        if (use_colors) attroff(COLOR_PAIR(10));
+        draw_multi_grid(&grid, md, rp.n, view, opt, use_colors, 1);
+        doupdate();
     }
-    if (use_colors) wcolor_set(win, 10, NULL);
-    wnoutrefresh(win);
+    grid_free(&grid);
+    for (int i = 0; i < rp.n; ++i) mon_dev_close(&md[i]);
+    free(md);
+    endwin();
+    replay_free(&rp);
+    windows_capped_warn();
+    return 0;
 }
 
-static void draw_device_pane(WINDOW *pane, const char *devname, mon_dev_t *md, units_t units, bool use_colors, bool light)
-{
-    int ph, pw; getmaxyx(pane, ph, pw);
-    werase(pane);
-    if (use_colors) { wbkgd(pane, COLOR_PAIR(11)); wattron(pane, COLOR_PAIR(13)); }
-    draw_ascii_box(pane);
-    if (use_colors) { wattroff(pane, COLOR_PAIR(13)); wattron(pane, COLOR_PAIR(10)); }
-    mvwprintw(pane, 0, 2, " %s ", devname);
-    if (use_colors) wattroff(pane, COLOR_PAIR(10));
-    int inner_h = ph - 2; if (inner_h < 4) inner_h = 4;
-    int rx_h = inner_h / 2;
-    int tx_h = inner_h - rx_h;
-    WINDOW *sub_rx = derwin(pane, rx_h, pw - 2, 1, 1);
-    WINDOW *sub_tx = derwin(pane, tx_h, pw - 2, 1 + rx_h, 1);
-    draw_panel_win(sub_rx, "RX", md->rx_Bps, md->rx_pps, md->rx_hist, md->hist_len, units, md->rate_gbps, use_colors, light);
-    draw_panel_win(sub_tx, "TX", md->tx_Bps, md->tx_pps, md->tx_hist, md->hist_len, units, md->rate_gbps, use_colors, light);
-    delwin(sub_rx);
-    delwin(sub_tx);
-    wnoutrefresh(pane);
+/* --connect: a viewer of a running ibmond. The newest screen width of the
+ * daemon's history is loaded first, rebuilding the compressed store, ring and
+ * percentiles a local run would have over that span, then its counter stream
+ * is applied tick by tick. Scrolling or zooming past the loaded start asks
+ * for the range before it, which is put in front of the stores when the
+ * reply is complete (the percentiles keep the span loaded at start). The
+ * daemon and the viewer share CLOCK_MONOTONIC, so burst times need no
+ * translation. */
+typedef struct {
+    int idx;
+    double t, v[HS_CHANS];
+} client_hsamp_t;
+
+typedef struct {
+    int fd;
+    char *buf;
+    size_t len, cap;
+    mon_dev_t *md;
+    int n;
+    double interval, retention;
+    int stage;              // 0: port list, 1: history, 2: counter stream
+    int described;          // ports listed so far
+    bool closed;
+    bool fetching;          // an older range was requested (stage 2)
+    bool oldest;            // the daemon has nothing before the loaded start
+    client_hsamp_t *old;    // samples of that range received so far
+    size_t nold, old_cap;
+    char err[256];          // ERR reply or protocol violation
+} client_t;
+
+// Parse n x 4 counters ("B"/"S" lines) into the ports.
+static bool client_counters(client_t *cl, char *p, bool baseline) {
+    char *end;
+    double t = strtod(p, &end);
+    if (end == p) return false;
+    strtod(end, &p); // realtime stamp, not needed locally
+    for (int i = 0; i < cl->n; ++i) {
+        uint64_t c[4];
+        for (int k = 0; k < 4; ++k) {
+            c[k] = strtoull(p, &end, 10);
+            if (end == p) return false;
+            p = end;
+        }
+        mon_dev_t *md = &cl->md[i];
+        if (baseline) {
+            md->prev_rx_data = c[0]; md->prev_tx_data = c[1];
+            md->prev_rx_pkts = c[2]; md->prev_tx_pkts = c[3];
+            md->prev_t = t;
+        } else {
+            mon_dev_apply(md, t, c[0], c[1], c[2], c[3]);
+            mon_dev_record(md, t);
+        }
+    }
+    return true;
 }
 
-static void draw_device_data_pane(WINDOW *pane, const char *devname, mon_dev_t *md, bool use_colors)
-{
-    werase(pane);
-    if (use_colors) { wbkgd(pane, COLOR_PAIR(11)); wattron(pane, COLOR_PAIR(13)); }
-    draw_ascii_box(pane);
-    if (use_colors) { wattroff(pane, COLOR_PAIR(13)); wattron(pane, COLOR_PAIR(10)); }
-    mvwprintw(pane, 0, 2, " %s - Raw Counters ", devname);
-    int row = 1;
-    uint64_t v;
-    if (md->ctrs.rx_data && read_u64_file(md->ctrs.rx_data, &v)) mvwprintw(pane, row++, 2, "port_rcv_data:    %20" PRIu64 " %s", v, md->ctrs.data_is_words ? "(words)" : "");
-    if (md->ctrs.rx_pkts && read_u64_file(md->ctrs.rx_pkts, &v)) mvwprintw(pane, row++, 2, "port_rcv_packets: %20" PRIu64, v);
-    if (md->ctrs.rx_errors && read_u64_file(md->ctrs.rx_errors, &v)) mvwprintw(pane, row++, 2, "port_rcv_errors:  %20" PRIu64, v);
-    if (md->ctrs.rx_remote_phy_err && read_u64_file(md->ctrs.rx_remote_phy_err, &v)) mvwprintw(pane, row++, 2, "rcv_remote_phy:   %20" PRIu64, v);
-    if (md->ctrs.rx_switch_relay_err && read_u64_file(md->ctrs.rx_switch_relay_err, &v)) mvwprintw(pane, row++, 2, "rcv_switch_relay: %20" PRIu64, v);
-    if (md->ctrs.tx_data && read_u64_file(md->ctrs.tx_data, &v)) mvwprintw(pane, row++, 2, "port_xmit_data:   %20" PRIu64 " %s", v, md->ctrs.data_is_words ? "(words)" : "");
-    if (md->ctrs.tx_pkts && read_u64_file(md->ctrs.tx_pkts, &v)) mvwprintw(pane, row++, 2, "port_xmit_packets:%20" PRIu64, v);
-    if (md->ctrs.tx_discards && read_u64_file(md->ctrs.tx_discards, &v)) mvwprintw(pane, row++, 2, "xmit_discards:    %20" PRIu64, v);
-    if (md->ctrs.tx_wait && read_u64_file(md->ctrs.tx_wait, &v)) mvwprintw(pane, row++, 2, "xmit_wait:        %20" PRIu64, v);
-    if (md->ctrs.local_phy_errors && read_u64_file(md->ctrs.local_phy_errors, &v)) mvwprintw(pane, row++, 2, "local_phy_errors: %20" PRIu64, v);
-    if (md->ctrs.symbol_error && read_u64_file(md->ctrs.symbol_error, &v)) mvwprintw(pane, row++, 2, "symbol_error:     %20" PRIu64, v);
-    if (md->ctrs.link_error_recovery && read_u64_file(md->ctrs.link_error_recovery, &v)) mvwprintw(pane, row++, 2, "link_err_recov:   %20" PRIu64, v);
-    if (md->ctrs.link_downed && read_u64_file(md->ctrs.link_downed, &v)) mvwprintw(pane, row++, 2, "link_downed:      %20" PRIu64, v);
-    if (md->ctrs.vl15_dropped && read_u64_file(md->ctrs.vl15_dropped, &v)) mvwprintw(pane, row++, 2, "vl15_dropped:     %20" PRIu64, v);
-    if (md->ctrs.excessive_buf_overrun && read_u64_file(md->ctrs.excessive_buf_overrun, &v)) mvwprintw(pane, row++, 2, "excess_buf_over:  %20" PRIu64, v);
-    if (use_colors) wattroff(pane, COLOR_PAIR(10));
-    wnoutrefresh(pane);
+static int client_hsamp_cmp(const void *a, const void *b) {
+    const client_hsamp_t *x = a, *y = b;
+    if (x->idx != y->idx) return x->idx < y->idx ? -1 : 1;
+    return (x->t > y->t) - (x->t < y->t);
 }
 
-static void draw_device_info_pane(WINDOW *pane, const char *devname, bool use_colors)
-{
-    int ph, pw; getmaxyx(pane, ph, pw);
-    werase(pane);
-    if (use_colors) { wbkgd(pane, COLOR_PAIR(11)); wattron(pane, COLOR_PAIR(13)); }
-    draw_ascii_box(pane);
-    if (use_colors) { wattroff(pane, COLOR_PAIR(13)); wattron(pane, COLOR_PAIR(10)); }
-    mvwprintw(pane, 0, 2, " %s - GIDs ", devname);
-    mvwprintw(pane, 1, 2, "Idx  Type        Ndev              GID");
-    gid_entry_t *list = NULL; int cnt = 0;
-    fetch_gid_list(devname, 1, &list, &cnt);
-    int row = 2;
-    for (int i = 0; i < cnt && row < ph - 1; ++i) {
-        char line[512];
-        snprintf(line, sizeof(line), "%3d  %-10s  %-16s  %s", list[i].idx,
-                 list[i].type ? list[i].type : "",
-                 list[i].ndev ? list[i].ndev : "",
-                 list[i].gid ? list[i].gid : "");
-        mvwprintw(pane, row++, 2, "%.*s", pw - 4, line);
+// Put the older range in front of every port's store. The store only
+// appends, so it is rebuilt: the older samples, then the ones already loaded.
+static bool client_merge_older(client_t *cl) {
+    cl->fetching = false;
+    if (cl->nold == 0) { cl->oldest = true; return true; }
+    qsort(cl->old, cl->nold, sizeof(*cl->old), client_hsamp_cmp);
+    size_t k = 0;
+    for (int i = 0; i < cl->n; ++i) {
+        mon_dev_t *md = &cl->md[i];
+        int64_t first = md->hs.nblk ? md->hs.blk[0].t0_ms : INT64_MAX;
+        hstore_t hs;
+        hstore_init(&hs, cl->retention);
+        bool ok = true;
+        for (; k < cl->nold && cl->old[k].idx == i; ++k)
+            if (ok && llround(cl->old[k].t * 1000.0) < first) ok = hstore_append(&hs, cl->old[k].t, cl->old[k].v);
+        for (int b = 0; ok && b < md->hs.nblk; ++b) {
+            hs_iter_t it; hs_iter_init(&it, &md->hs.blk[b]);
+            int64_t t; double v[HS_CHANS];
+            while (ok && hs_iter_next(&it, &t, v)) ok = hstore_append(&hs, (double)t / 1000.0, v);
+        }
+        if (!ok) {
+            hstore_free(&hs);
+            snprintf(cl->err, sizeof(cl->err), "out of memory");
+            return false;
+        }
+        hstore_free(&md->hs);
+        md->hs = hs;
+        mon_dev_plot_free(md); // refilled from the new store when next drawn
     }
-    free_gid_list(list, cnt);
-    if (use_colors) wattroff(pane, COLOR_PAIR(10));
-    wnoutrefresh(pane);
+    cl->nold = 0;
+    return true;
 }
 
-static bool file_read_has(const char *path, const char *needle)
-{
-    char *s = read_str_file(path);
-    if (!s) return false;
-    bool ok = (strstr(s, needle) != NULL);
-    free(s);
-    return ok;
+// Ask for the history before the loaded start once the view reaches past it
+// (`cols` columns at the current zoom and scroll position), about as much
+// again as is loaded and at least a screen width beyond what the view needs.
+static bool client_fetch_older(client_t *cl, int cols) {
+    if (cl->stage < 2 || cl->fetching || cl->oldest || cl->closed || cl->n == 0) return true;
+    const hstore_t *hs = &cl->md[0].hs;
+    uint64_t avail = hs->seq_next - hstore_first_seq(hs);
+    uint64_t need = g_view.offset + (uint64_t)cols * (uint64_t)g_view.zoom;
+    if (!hs->nblk || need <= avail) return true;
+    double first = (double)hs->blk[0].t0_ms / 1000.0, last = (double)hstore_last_ms(hs) / 1000.0;
+    if (cl->retention > 0 && first <= last - cl->retention) return true; // older samples would be dropped
+    uint64_t more = need - avail + (uint64_t)cols * (uint64_t)g_view.zoom;
+    if (more < avail) more = avail;
+    double from = first - (double)more * cl->interval;
+    if (cl->retention > 0 && from < last - cl->retention) from = last - cl->retention;
+    if (from < 0) from = 0; // a negative FROM would count back from now
+    char req[96];
+    int len = snprintf(req, sizeof(req), "HISTORY * %.3f %.3f\n", from, (double)(hs->blk[0].t0_ms - 1) / 1000.0);
+    cl->fetching = true;
+    if (send(cl->fd, req, (size_t)len, MSG_NOSIGNAL) == len) return true;
+    snprintf(cl->err, sizeof(cl->err), "send: %s", strerror(errno));
+    return false;
 }
 
-static int enumerate_active_devices(char names[][128], int maxn)
-{
-    DIR *d = opendir(SYSFS_IB_BASE);
-    if (!d) return 0;
-    int count = 0; struct dirent *de;
-    while ((de = readdir(d)) != NULL && count < maxn) {
-        if (de->d_name[0] == '.') continue;
-        char p[512]; snprintf(p, sizeof(p), "%s/%s/ports/1/state", SYSFS_IB_BASE, de->d_name);
-        if (access(p, R_OK) != 0) continue;
-        if (!file_read_has(p, "ACTIVE")) continue;
-        // Copy device name safely into fixed buffer
-        snprintf(names[count], 128, "%.127s", de->d_name);
-        count++;
+static bool client_line(client_t *cl, char *line) {
+    char *p, *end;
+    if (strncmp(line, "ERR", 3) == 0) {
+        snprintf(cl->err, sizeof(cl->err), "%s", line);
+        return false;
     }
-    closedir(d);
-    return count;
+    if (line[0] == '.' && line[1] == '\0') {
+        if (cl->stage == 0 && (cl->n == 0 || cl->described != cl->n)) {
+            snprintf(cl->err, sizeof(cl->err), "incomplete port list");
+            return false;
+        }
+        if (cl->stage == 2) return !cl->fetching || client_merge_older(cl);
+        cl->stage++;
+        return true;
+    }
+    if (line[0] == 'H' && line[1] == ' ' && (cl->stage == 1 || cl->fetching)) {
+        long idx = strtol(line + 2, &p, 10);
+        double t = strtod(p, &end), v[HS_CHANS];
+        if (end == p || idx < 0 || idx >= cl->n) goto bad;
+        v[0] = strtod(end, &p);
+        v[1] = strtod(p, &end);
+        if (end == p) goto bad;
+        mon_dev_t *md = &cl->md[idx];
+        if (cl->stage == 1) {
+            md->rx_Bps = v[0]; md->tx_Bps = v[1];
+            mon_dev_record(md, t);
+            return true;
+        }
+        // an older range: kept until its reply is complete
+        if (cl->nold == cl->old_cap) {
+            size_t cap = cl->old_cap ? cl->old_cap * 2 : 4096;
+            client_hsamp_t *na = realloc(cl->old, cap * sizeof(*na));
+            if (!na) { snprintf(cl->err, sizeof(cl->err), "out of memory"); return false; }
+            cl->old = na; cl->old_cap = cap;
+        }
+        cl->old[cl->nold++] = (client_hsamp_t){ .idx = (int)idx, .t = t, .v = { v[0], v[1] } };
+        return true;
+    }
+    switch (cl->stage) {
+        case 0:
+            if (strncmp(line, "PORTS ", 6) == 0) {
+                int n = (int)strtol(line + 6, &p, 10);
+                cl->interval = strtod(p, NULL);
+                if (n <= 0 || cl->md) break;
+                if (!(cl->md = calloc((size_t)n, sizeof(mon_dev_t)))) break;
+                cl->n = n;
+                return true;
+            }
+            if (line[0] == 'P' && cl->md) {
+                int idx, port, words; double rate; char name[128];
+                if (sscanf(line, "P %d %127s %d %lf %d", &idx, name, &port, &rate, &words) != 5 || idx < 0 || idx >= cl->n) break;
+                mon_dev_open_remote(&cl->md[idx], name, port, rate, words != 0, cl->retention, now_realtime());
+                cl->described++;
+                return true;
+            }
+            break;
+        case 2:
+            if ((line[0] == 'S' || line[0] == 'B') && line[1] == ' ' && client_counters(cl, line + 2, line[0] == 'B'))
+                return true;
+            break;
+    }
+bad:
+    snprintf(cl->err, sizeof(cl->err), "unexpected reply: %.200s", line);
+    return false;
 }
 
-static int parse_device_list(const char *arg, char names[][128], int maxn)
-{
-    if (!arg) return 0;
-    int count = 0; const char *p = arg; const char *start = p;
-    while (*p && count < maxn) {
-        if (*p == ',') {
-            int len = (int)(p - start);
-            if (len > 0) {
-                if (len > 127) len = 127;
-                memcpy(names[count], start, (size_t)len);
-                names[count][len] = '\0';
-                count++;
-            }
-            start = p + 1;
+// Read what the socket has (waiting for data if `block`) and handle the
+// complete lines. Returns false on an error; cl->closed is set at EOF.
+static bool client_read(client_t *cl, bool block) {
+    for (;;) {
+        if (cl->cap - cl->len < 65536) {
+            size_t cap = cl->cap ? cl->cap * 2 : 1 << 20;
+            char *nb = realloc(cl->buf, cap);
+            if (!nb) { snprintf(cl->err, sizeof(cl->err), "out of memory"); return false; }
+            cl->buf = nb; cl->cap = cap;
         }
-        p++;
-    }
-    if (start && *start && count < maxn) {
-        int len = (int)strlen(start);
-        if (len > 0) {
-            if (len > 127) len = 127;
-            memcpy(names[count], start, (size_t)len);
-            names[count][len] = '\0';
-            count++;
+        ssize_t r = recv(cl->fd, cl->buf + cl->len, cl->cap - cl->len, block ? 0 : MSG_DONTWAIT);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+        if (r <= 0) { cl->closed = true; return true; }
+        cl->len += (size_t)r;
+        char *line = cl->buf, *nl;
+        while ((nl = memchr(line, '\n', cl->len - (size_t)(line - cl->buf)))) {
+            *nl = '\0';
+            if (!client_line(cl, line)) return false;
+            line = nl + 1;
         }
+        cl->len -= (size_t)(line - cl->buf);
+        memmove(cl->buf, line, cl->len);
+        if (block) return true;
     }
-    return count;
 }
 
-static int run_multi_mode(char devs[][128], int ndev, opts_t *opt)
+static int run_connect(const char *path, opts_t *opt)
 {
-    initscr(); cbreak(); noecho(); nodelay(stdscr, FALSE); keypad(stdscr, TRUE); curs_set(0); timeout((int)(opt->interval * 1000));
-    bool use_colors = false;
-    if (has_colors()) {
-        start_color(); use_colors = true; use_default_colors();
-        int bg = (opt->bg_mode == 1 ? -1 : COLOR_BLACK);
-        int fg_text = (opt->bg_mode == 1 ? -1 : COLOR_WHITE);
-        int fg_border = (opt->bg_mode == 1 ? -1 : COLOR_WHITE);
-        init_pair(1, COLOR_CYAN, bg); init_pair(2, COLOR_RED, bg);
-        init_pair(10, fg_text, bg); init_pair(11, bg, bg); init_pair(12, bg, bg); init_pair(13, fg_border, bg);
+    struct sockaddr_un sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    snprintf(sa.sun_path, sizeof(sa.sun_path), "%s", path);
+    client_t cl = { .fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0), .retention = opt->retention };
+    if (cl.fd < 0 || connect(cl.fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+        fprintf(stderr, "Cannot connect to %s: %s\n", path, strerror(errno));
+        if (cl.fd >= 0) close(cl.fd);
+        return 1;
     }
-    mon_dev_t *md = calloc(ndev, sizeof(mon_dev_t));
-    for (int i = 0; i < ndev; ++i) {
-        snprintf(md[i].name, sizeof(md[i].name), "%s", devs[i]);
-        if (!resolve_counters(devs[i], 1, &md[i].ctrs)) continue;
-        md[i].rate_gbps = parse_rate_gbps(md[i].ctrs.rate);
-        read_u64_file(md[i].ctrs.tx_data, &md[i].prev_tx_data);
-        read_u64_file(md[i].ctrs.rx_data, &md[i].prev_rx_data);
-        read_u64_file(md[i].ctrs.tx_pkts, &md[i].prev_tx_pkts);
-        read_u64_file(md[i].ctrs.rx_pkts, &md[i].prev_rx_pkts);
-        md[i].hist_len = 0; md[i].tx_Bps = md[i].rx_Bps = md[i].tx_pps = md[i].rx_pps = 0.0; md[i].win = NULL;
+    static const char hello[] = "PORTS\n";
+    bool ok = send(cl.fd, hello, sizeof(hello) - 1, MSG_NOSIGNAL) == (ssize_t)(sizeof(hello) - 1);
+    while (ok && cl.stage < 1 && !cl.closed) ok = client_read(&cl, true);
+    if (ok && cl.stage == 1 && !windows_fit(cl.interval)) {
+        for (int i = 0; i < cl.n; ++i) mon_dev_close(&cl.md[i]);
+        free(cl.md); free(cl.buf); close(cl.fd);
+        return 2;
     }
-    double start_time = now_monotonic();
-    double prev_t = now_monotonic();
-    enum { VIEW_PLOT=0, VIEW_DATA=1, VIEW_INFO=2 };
-    int view = VIEW_PLOT; bool paused = false;
-    for (;;) {
-        int ch = getch();
-        bool fast_switch = false;
-        if (ch != ERR) {
-            if (ch == 'q' || ch == 'Q') break;
-            if (ch == 'u' || ch == 'U') opt->units = (opt->units == UNITS_BITS) ? UNITS_BYTES : UNITS_BITS;
-            if (ch == 'p' || ch == 'P') paused = !paused;
-            if (ch == 'd' || ch == 'D') { view = (view == VIEW_DATA) ? VIEW_PLOT : VIEW_DATA; fast_switch = true; }
-            if (ch == 'i' || ch == 'I') { view = (view == VIEW_INFO) ? VIEW_PLOT : VIEW_INFO; fast_switch = true; }
+    if (ok && cl.stage == 1) {
+        // only the history one screen width can show: the daemon's whole
+        // retention for every port can run to gigabytes
+        struct winsize ws;
+        int cols = ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col ? ws.ws_col : 80;
+        char req[96];
+        int len = snprintf(req, sizeof(req), "HISTORY * -%.3f\nSUBSCRIBE\n", cols * cl.interval * g_view.zoom);
+        ok = send(cl.fd, req, (size_t)len, MSG_NOSIGNAL) == len;
+    }
+    while (ok && cl.stage < 2 && !cl.closed) ok = client_read(&cl, true);
+    if (!ok || cl.stage < 2) {
+        fprintf(stderr, "%s: %s\n", path, cl.err[0] ? cl.err : "connection closed by ibmond");
+        for (int i = 0; i < cl.n; ++i) mon_dev_close(&cl.md[i]);
+        free(cl.md); free(cl.buf); free(cl.old); close(cl.fd);
+        return 1;
+    }
+
+    signal(SIGINT, on_sigint);
+    signal(SIGPIPE, SIG_IGN);
+    initscr(); cbreak(); noecho(); keypad(stdscr, TRUE); curs_set(0); timeout(0);
+    bool use_colors = init_colors(opt);
+    int view = cl.n > TABLE_AUTO_PORTS ? VIEW_TABLE : VIEW_PLOT; bool paused = false;
+    frame_sched_t fs; frame_init(&fs, opt->fps, cl.interval);
+    grid_t grid = {0};
+    while (!g_stop) {
+        struct pollfd pf[2] = { { .fd = STDIN_FILENO, .events = POLLIN }, { .fd = cl.fd, .events = POLLIN } };
+        poll(pf, cl.closed ? 1 : 2, frame_wait_ms(&fs, now_monotonic(), 1000));
+        if (!cl.closed && (pf[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+            if (!client_read(&cl, false)) break;
+            frame_touch(&fs, false);
         }
-        double nowt = now_monotonic(); double dt = nowt - prev_t; if (dt <= 0) dt = 1e-9;
-        if (!fast_switch && !paused) {
-            for (int i = 0; i < ndev; ++i) {
-                if (!md[i].ctrs.tx_data) continue;
-                uint64_t c_txB=0,c_rxB=0,c_txp=0,c_rxp=0;
-                if (!read_u64_file(md[i].ctrs.tx_data,&c_txB)) continue;
-                if (!read_u64_file(md[i].ctrs.rx_data,&c_rxB)) continue;
-                if (!read_u64_file(md[i].ctrs.tx_pkts,&c_txp)) continue;
-                if (!read_u64_file(md[i].ctrs.rx_pkts,&c_rxp)) continue;
-                uint64_t d_txB = (c_txB >= md[i].prev_tx_data) ? (c_txB - md[i].prev_tx_data) : (c_txB + (UINT64_MAX - md[i].prev_tx_data) + 1);
-                uint64_t d_rxB = (c_rxB >= md[i].prev_rx_data) ? (c_rxB - md[i].prev_rx_data) : (c_rxB + (UINT64_MAX - md[i].prev_rx_data) + 1);
-                uint64_t d_txp = (c_txp >= md[i].prev_tx_pkts) ? (c_txp - md[i].prev_tx_pkts) : (c_txp + (UINT64_MAX - md[i].prev_tx_pkts) + 1);
-                uint64_t d_rxp = (c_rxp >= md[i].prev_rx_pkts) ? (c_rxp - md[i].prev_rx_pkts) : (c_rxp + (UINT64_MAX - md[i].prev_rx_pkts) + 1);
-                if (md[i].ctrs.data_is_words) { d_txB *= 4; d_rxB *= 4; }
-                md[i].tx_Bps = (double)d_txB / dt; md[i].rx_Bps = (double)d_rxB / dt;
-                md[i].tx_pps = (double)d_txp / dt; md[i].rx_pps = (double)d_rxp / dt;
-                md[i].prev_tx_data = c_txB; md[i].prev_rx_data = c_rxB; md[i].prev_tx_pkts=c_txp; md[i].prev_rx_pkts=c_rxp;
-                if (md[i].hist_len < 4096) { md[i].rx_hist[md[i].hist_len]=md[i].rx_Bps; md[i].tx_hist[md[i].hist_len]=md[i].tx_Bps; md[i].hist_len++; }
-                else { memmove(md[i].rx_hist, md[i].rx_hist+1, sizeof(double)*4095); memmove(md[i].tx_hist, md[i].tx_hist+1, sizeof(double)*4095); md[i].rx_hist[4095]=md[i].rx_Bps; md[i].tx_hist[4095]=md[i].tx_Bps; }
+        bool quit = false;
+        for (int ch; !quit && (ch = getch()) != ERR; ) {
+            frame_touch(&fs, true);
+            if (handle_view_key(ch) || (view == VIEW_TABLE && handle_table_key(ch))) continue;
+            switch (ch) {
+                case 'q': case 'Q': quit = true; break;
+                case 'u': case 'U': opt->units = (opt->units == UNITS_BITS) ? UNITS_BYTES : UNITS_BITS; break;
+                case 'p': case 'P': paused = !paused; break;
+                case 'm': case 'M': g_smooth.metric = (metric_t)((g_smooth.metric + 1) % 3); break;
+                case 'd': case 'D': view = (view == VIEW_DATA) ? VIEW_PLOT : VIEW_DATA; break;
+                case 'i': case 'I': view = (view == VIEW_INFO) ? VIEW_PLOT : VIEW_INFO; break;
+                case 'b': case 'B': view = (view == VIEW_BURST) ? VIEW_PLOT : VIEW_BURST; break;
+                case 't': case 'T': view = (view == VIEW_TABLE) ? VIEW_PLOT : VIEW_TABLE; break;
+                case KEY_RESIZE: for (int i = 0; i < cl.n; ++i) chart_reset(&cl.md[i]); break; // screen was cleared
             }
-            prev_t = nowt;
         }
-        // Header (avoid full-screen erase to reduce flicker)
-        int maxy = getmaxy(stdscr), maxx = getmaxx(stdscr);
+        if (quit) break;
+        if (!client_fetch_older(&cl, getmaxx(stdscr))) break;
+        // paused: the stream is still applied; only the screen is frozen
+        if (!frame_due(&fs, now_monotonic()) || paused) continue;
+        int maxx = getmaxx(stdscr);
         mvhline(0, 0, ' ', maxx);
         if (use_colors) attron(COLOR_PAIR(10));
-        const char *mode_str = (view==VIEW_PLOT?"PLOT":(view==VIEW_DATA?"DATA":"INFO"));
-        mvprintw(0,2," ibmon - multi-device (%d) [%s] [q:quit u:units p:pause d:data i:info] ", ndev, mode_str);
+        mvprintw(0, 2, " ibmon - %s (%d) [%s] [%s]%s [q:quit u:units p:pause m:metric d:data i:info b:bursts t:table </>:scroll -/+:zoom l:live] ",
+                 path, cl.n, view_name(view), metric_name(g_smooth.metric), cl.closed ? " [DISCONNECTED]" : "");
         if (use_colors) attroff(COLOR_PAIR(10));
-        int hdr_h = 1;
-        // Grid
-        int cols = (int)ceil(sqrt((double)ndev)); if (cols < 1) cols = 1; int rows = (ndev + cols - 1)/cols;
-        int cell_h = (maxy - hdr_h) / rows; if (cell_h < 6) cell_h = 6;
-        int cell_w = (maxx) / cols; if (cell_w < 20) cell_w = 20;
-        for (int i = 0; i < ndev; ++i) {
-            int r = i / cols, c = i % cols;
-            int y = hdr_h + r * cell_h; int h = (r == rows-1) ? (maxy - y) : cell_h;
-            int x = c * cell_w; int w = (c == cols-1) ? (maxx - x) : cell_w;
-            if (!md[i].win) md[i].win = newwin(h, w, y, x);
-            else { int ch, cw; getmaxyx(md[i].win, ch, cw); if (ch != h || cw != w) { delwin(md[i].win); md[i].win = newwin(h, w, y, x);} }
-            if (view == VIEW_PLOT)
-                draw_device_pane(md[i].win, md[i].name, &md[i], opt->units, use_colors, false);
-            else if (view == VIEW_DATA)
-                draw_device_data_pane(md[i].win, md[i].name, &md[i], use_colors);
-            else
-                draw_device_info_pane(md[i].win, md[i].name, use_colors);
-        }
+        draw_multi_grid(&grid, cl.md, cl.n, view, opt, use_colors, 1);
         doupdate();
-        if (opt->duration > 0 && (now_monotonic() - start_time) >= opt->duration) break;
     }
-    for (int i=0;i<ndev;++i){ if (md[i].win) delwin(md[i].win); free_counters(&md[i].ctrs);} free(md);
+    grid_free(&grid);
     endwin();
-    return 0;
+    if (cl.err[0]) fprintf(stderr, "%s: %s\n", path, cl.err);
+    windows_capped_warn();
+    for (int i = 0; i < cl.n; ++i) mon_dev_close(&cl.md[i]);
+    free(cl.md); free(cl.buf); free(cl.old); close(cl.fd);
+    return cl.err[0] ? 1 : 0;
 }
 
 static void usage(const char *prog) {
     fprintf(stderr,
         "Usage: %s -d DEVICE [-p PORT] [-i INTERVAL] [-u bits|bytes] [--csv PATH] [--csv-append] [--csv-headers] [--duration SECONDS]\n"
+        "          [--retention DURATION] [--summary PATH] [--pctl-window DURATION]\n"
+        "          [--metric raw|ewma|window] [--csv-metric raw|ewma|window] [--ewma-tau SECONDS] [--avg-window DURATION]\n"
+        "          [--burst-frac F] [--burst-avg-frac F] [--burst-short DURATION] [--burst-long DURATION] [--burst-log PATH]\n"
+        "          [--event-log PATH] [--fps N] [--plot ascii|block|braille]\n"
+        "          [--headless [--format ndjson]] [--binlog PATH] [--csv-rotate DURATION|SIZE] [--csv-sync]\n"
+        "          [--csv-layout long|wide] [--listen [HOST:]PORT] [--shm NAME]\n"
+        "          [--statsd [HOST][:PORT] [--statsd-prefix P] [--statsd-tags] [--statsd-mtu BYTES]]\n"
+        "          [--arrow PATH [--arrow-batch TICKS]] [--influx PATH|-|tcp://HOST:PORT|unix:PATH [--influx-measurement M]]\n"
+        "       %s --replay LOG [--speed N[x]] [-u bits|bytes] [--metric ...] [--burst-* ...]\n"
+        "       %s --serve SOCKET [-d DEVICES] [-i INTERVAL] [--retention DURATION] [sinks ...]   (same as ibmond)\n"
+        "       %s --connect SOCKET [-u bits|bytes] [--metric ...] [--burst-* ...]\n"
         "\n"
         "Monitor InfiniBand bandwidth and packets via sysfs.\n",
-        prog);
+        prog, prog, prog, prog);
 }
 
 int main(int argc, char **argv) {
@@ -633,6 +4945,15 @@ int main(int argc, char **argv) {
     opt.interval = 1.0;
     opt.units = UNITS_BITS;
     opt.bg_mode = 0;
+    opt.retention = 7 * 86400.0;
+    opt.statsd_prefix = "ibmon";
+    opt.statsd_mtu = 1432;
+    opt.replay_speed = 1.0;
+    opt.arrow_batch = 60;
+    opt.influx_measurement = "ibmon";
+    // installed as ibmond (a link to ibmon): run as the sampling daemon
+    const char *base = strrchr(argv[0], '/');
+    if (strcmp(base ? base + 1 : argv[0], "ibmond") == 0) opt.serve_path = ibmond_default_sock();
 
     static struct option long_opts[] = {
         {"device", required_argument, 0, 'd'},
@@ -644,9 +4965,45 @@ int main(int argc, char **argv) {
         {"csv-append", no_argument, 0, 1001},
         {"csv-headers", no_argument, 0, 1002},
         {"duration", required_argument, 0, 1003},
+        {"retention", required_argument, 0, 1005},
+        {"summary", required_argument, 0, 1006},
+        {"pctl-window", required_argument, 0, 1007},
+        {"metric", required_argument, 0, 1008},
+        {"csv-metric", required_argument, 0, 1009},
+        {"ewma-tau", required_argument, 0, 1010},
+        {"avg-window", required_argument, 0, 1011},
+        {"burst-frac", required_argument, 0, 1012},
+        {"burst-avg-frac", required_argument, 0, 1013},
+        {"burst-short", required_argument, 0, 1014},
+        {"burst-long", required_argument, 0, 1015},
+        {"burst-log", required_argument, 0, 1016},
+        {"headless", no_argument, 0, 1017},
+        {"format", required_argument, 0, 1018},
+        {"binlog", required_argument, 0, 1019},
+        {"csv-rotate", required_argument, 0, 1020},
+        {"csv-sync", no_argument, 0, 1021},
+        {"csv-layout", required_argument, 0, 1022},
+        {"listen", required_argument, 0, 1023},
+        {"shm", required_argument, 0, 1024},
+        {"statsd", required_argument, 0, 1025},
+        {"statsd-prefix", required_argument, 0, 1026},
+        {"statsd-tags", no_argument, 0, 1027},
+        {"statsd-mtu", required_argument, 0, 1028},
+        {"replay", required_argument, 0, 1029},
+        {"speed", required_argument, 0, 1030},
+        {"serve", required_argument, 0, 1031},
+        {"connect", required_argument, 0, 1032},
+        {"arrow", required_argument, 0, 1033},
+        {"arrow-batch", required_argument, 0, 1034},
+        {"influx", required_argument, 0, 1035},
+        {"influx-measurement", required_argument, 0, 1036},
+        {"event-log", required_argument, 0, 1037},
+        {"fps", required_argument, 0, 1038},
+        {"plot", required_argument, 0, 1039},
         {0,0,0,0}
     };
     int c;
+    bool csv_metric_set = false;
     while ((c = getopt_long(argc, argv, "d:p:i:u:", long_opts, NULL)) != -1) {
         switch (c) {
             case 'd': opt.device = optarg; break;
@@ -666,18 +5023,149 @@ int main(int argc, char **argv) {
                 else if (strcasecmp(optarg, "terminal") == 0) opt.bg_mode = 1;
                 else { fprintf(stderr, "Invalid --bg: %s (use black|terminal)\n", optarg); return 2; }
                 break;
+            case 1005:
+                opt.retention = parse_duration(optarg);
+                if (opt.retention < 0) { fprintf(stderr, "Invalid --retention: %s\n", optarg); return 2; }
+                break;
+            case 1006: opt.summary_path = optarg; break;
+            case 1007:
+                opt.pctl_window = parse_duration(optarg);
+                if (opt.pctl_window < 0) { fprintf(stderr, "Invalid --pctl-window: %s\n", optarg); return 2; }
+                break;
+            case 1008:
+                if (!parse_metric(optarg, &g_smooth.metric)) { fprintf(stderr, "Invalid --metric: %s (use raw|ewma|window)\n", optarg); return 2; }
+                if (!csv_metric_set) opt.csv_metric = g_smooth.metric;
+                break;
+            case 1009:
+                if (!parse_metric(optarg, &opt.csv_metric)) { fprintf(stderr, "Invalid --csv-metric: %s (use raw|ewma|window)\n", optarg); return 2; }
+                csv_metric_set = true;
+                break;
+            case 1010:
+                g_smooth.ewma_tau = parse_duration(optarg);
+                if (g_smooth.ewma_tau < 0) { fprintf(stderr, "Invalid --ewma-tau: %s\n", optarg); return 2; }
+                break;
+            case 1011:
+                g_smooth.window_s = parse_duration(optarg);
+                if (g_smooth.window_s <= 0) { fprintf(stderr, "Invalid --avg-window: %s\n", optarg); return 2; }
+                break;
+            case 1012:
+                g_burst.frac = strcmp(optarg, "0") == 0 ? 0.0 : parse_fraction(optarg); // 0: detection off
+                if (g_burst.frac < 0) { fprintf(stderr, "Invalid --burst-frac: %s (use 0 < F <= 1, or 0 to disable)\n", optarg); return 2; }
+                break;
+            case 1013:
+                g_burst.avg_frac = parse_fraction(optarg);
+                if (g_burst.avg_frac <= 0) { fprintf(stderr, "Invalid --burst-avg-frac: %s (use 0 < F <= 1)\n", optarg); return 2; }
+                break;
+            case 1014:
+                g_burst.short_s = parse_duration(optarg);
+                if (g_burst.short_s < 0) { fprintf(stderr, "Invalid --burst-short: %s\n", optarg); return 2; }
+                break;
+            case 1015:
+                g_burst.long_s = parse_duration(optarg);
+                if (g_burst.long_s <= 0) { fprintf(stderr, "Invalid --burst-long: %s\n", optarg); return 2; }
+                break;
+            case 1016: opt.burst_log_path = optarg; break;
+            case 1017: opt.headless = true; break;
+            case 1019: opt.binlog_path = optarg; break;
+            case 1020:
+                if (!parse_rotate(optarg, &opt.csv_rotate_secs, &opt.csv_rotate_bytes)) { fprintf(stderr, "Invalid --csv-rotate: %s (e.g. 1h, 30m, 500M, 2G)\n", optarg); return 2; }
+                break;
+            case 1021: opt.csv_sync = true; break;
+            case 1023: opt.listen = optarg; break;
+            case 1024: opt.shm_name = optarg; break;
+            case 1025: opt.statsd_addr = optarg; break;
+            case 1026: opt.statsd_prefix = optarg; break;
+            case 1027: opt.statsd_tags = true; break;
+            case 1028: {
+                long v = strtol(optarg, NULL, 10);
+                if (v < 512 || v > 65507) { fprintf(stderr, "--statsd-mtu must be 512..65507\n"); return 2; }
+                opt.statsd_mtu = (size_t)v;
+                break;
+            }
+            case 1029: opt.replay_path = optarg; break;
+            case 1030: {
+                char *end;
+                opt.replay_speed = strtod(optarg, &end);
+                if (*end == 'x' || *end == 'X') end++;
+                if (*end || !(opt.replay_speed > 0)) { fprintf(stderr, "Invalid --speed: %s (e.g. 10x, 0.5)\n", optarg); return 2; }
+                break;
+            }
+            case 1031: opt.serve_path = optarg; break;
+            case 1032: opt.connect_path = optarg; break;
+            case 1033: opt.arrow_path = optarg; break;
+            case 1035: opt.influx_dest = optarg; break;
+            case 1036: opt.influx_measurement = optarg; break;
+            case 1037: opt.event_log_path = optarg; break;
+            case 1038:
+                opt.fps = atof(optarg);
+                if (!(opt.fps > 0)) { fprintf(stderr, "--fps must be > 0\n"); return 2; }
+                break;
+            case 1039:
+                if (strcasecmp(optarg, "ascii") == 0) g_plot = PLOT_ASCII;
+                else if (strcasecmp(optarg, "block") == 0) g_plot = PLOT_BLOCK;
+                else if (strcasecmp(optarg, "braille") == 0) g_plot = PLOT_BRAILLE;
+                else { fprintf(stderr, "Invalid --plot: %s (use ascii|block|braille)\n", optarg); return 2; }
+                break;
+            case 1034:
+                opt.arrow_batch = atoi(optarg);
+                if (opt.arrow_batch <= 0) { fprintf(stderr, "--arrow-batch must be > 0\n"); return 2; }
+                break;
+            case 1022:
+                if (strcasecmp(optarg, "long") == 0) opt.csv_layout = CSV_LONG;
+                else if (strcasecmp(optarg, "wide") == 0) opt.csv_layout = CSV_WIDE;
+                else { fprintf(stderr, "Invalid --csv-layout: %s (use long|wide)\n", optarg); return 2; }
+                break;
+            case 1018:
+                if (strcasecmp(optarg, "ndjson") != 0) { fprintf(stderr, "Invalid --format: %s (use ndjson)\n", optarg); return 2; }
+                opt.format = optarg;
+                break;
             default: usage(argv[0]); return 2;
         }
     }
 
+    // stdout carries the TUI or the --headless records; only the daemon leaves it free
+    if (opt.influx_dest && strcmp(opt.influx_dest, "-") == 0 && !opt.serve_path) {
+        fprintf(stderr, "--influx -: stdout is taken by the %s; use a file or socket, or run with --serve\n",
+                opt.headless ? "--headless records" : "screen");
+        return 2;
+    }
+
+    if (g_plot != PLOT_ASCII) {
+#ifdef IBMON_WIDE
+        // LC_CTYPE only: numbers in the logs and exports keep their '.'
+        setlocale(LC_CTYPE, "");
+        if (strcmp(nl_langinfo(CODESET), "UTF-8") != 0) {
+            fprintf(stderr, "--plot needs a UTF-8 locale; using ascii\n");
+            g_plot = PLOT_ASCII;
+        }
+#else
+        fprintf(stderr, "--plot needs ibmon built with ncursesw; using ascii\n");
+        g_plot = PLOT_ASCII;
+#endif
+    }
+
+    if (opt.replay_path) return run_replay(opt.replay_path, &opt);
+    if (opt.connect_path) return run_connect(opt.connect_path, &opt);
+    if (!windows_fit(opt.interval)) return 2;
+
     // Multi-device handling: parse list or enumerate ACTIVE devices when -d omitted
-    char dev_names[64][128]; int dev_count = 0;
-    if (opt.device) dev_count = parse_device_list(opt.device, dev_names, 64);
+    char (*dev_names)[128] = NULL; int dev_count = 0;
+    if (opt.device) dev_count = parse_device_list(opt.device, &dev_names);
     if (!opt.device || dev_count == 0) {
-        dev_count = enumerate_active_devices(dev_names, 64);
+        dev_count = enumerate_active_devices(&dev_names);
+    }
+    if (opt.headless || opt.serve_path) {
+        if (dev_count == 0) { fprintf(stderr, "No ACTIVE InfiniBand devices found and no -d specified.\n"); return 2; }
+        if (opt.port <= 0) { fprintf(stderr, "--port must be > 0\n"); return 2; }
+        if (opt.interval <= 0) { fprintf(stderr, "--interval must be > 0\n"); return 2; }
+        int rc = run_headless(dev_names, dev_count, &opt);
+        free(dev_names);
+        return rc;
     }
     if (dev_count > 1) {
-        return run_multi_mode(dev_names, dev_count, &opt);
+        int rc = run_multi_mode(dev_names, dev_count, &opt);
+        free(dev_names);
+        return rc;
     }
     if (!opt.device) {
         if (dev_count == 1) {
@@ -687,32 +5175,37 @@ int main(int argc, char **argv) {
             return 2;
         }
     }
+    free(dev_names);
     if (opt.port <= 0) { fprintf(stderr, "--port must be > 0\n"); return 2; }
     if (opt.interval <= 0) { fprintf(stderr, "--interval must be > 0\n"); return 2; }
 
     signal(SIGINT, on_sigint);
     signal(SIGWINCH, on_sigwinch);
 
-    counters_t ctrs;
-    if (!resolve_counters(opt.device, opt.port, &ctrs)) {
+    mon_dev_t *dev = (mon_dev_t *)calloc(1, sizeof(mon_dev_t));
+    if (!dev) { fprintf(stderr, "Out of memory\n"); return 1; }
+    if (!mon_dev_open(dev, opt.device, opt.port, opt.retention)) {
+        mon_dev_close(dev); free(dev);
         fprintf(stderr, "Failed to locate expected counters under %s/%s/ports/%d/counters\n",
                 SYSFS_IB_BASE, opt.device, opt.port);
         return 1;
     }
+    if (!mon_dev_plot(dev)) { mon_dev_close(dev); free(dev); fprintf(stderr, "Out of memory\n"); return 1; }
 
-    // CSV setup
-    FILE *csv = NULL;
-    if (opt.csv_path) {
-        const char *mode = opt.csv_append ? "a" : "w";
-        csv = fopen(opt.csv_path, mode);
-        if (!csv) {
-            fprintf(stderr, "Failed to open CSV path: %s\n", opt.csv_path);
-        } else if (!opt.csv_append || opt.csv_headers) {
-            fprintf(csv, "time_s,rx_Bps,tx_Bps,rx_pps,tx_pps\n");
-            fflush(csv);
-        }
+    // CSV, binary log and exporter (CSV rows are handed to the writer thread)
+    sinks_t sinks;
+    if (!sinks_open(&sinks, &opt, dev, 1, true)) {
+        sinks_close(&sinks);
+        mon_dev_close(dev); free(dev);
+        return 1;
     }
 
+    bool sum_json = false;
+    FILE *sum = opt.summary_path ? summary_open(opt.summary_path, &sum_json) : NULL;
+    double win_start = now_monotonic();
+    FILE *blog = opt.burst_log_path ? burst_log_open(opt.burst_log_path) : NULL;
+    uint64_t blog_written = 0;
+
     initscr();
     cbreak();
     noecho();
@@ -739,28 +5232,18 @@ int main(int argc, char **argv) {
     bool paused = false;
     bool data_mode = false; // 'd' toggles data page
     bool info_mode = false; // 'i' toggles info page
-    double rate_gbps = parse_rate_gbps(ctrs.rate);
-
-    uint64_t p_txB=0, p_rxB=0, p_txp=0, p_rxp=0;
-    uint64_t raw_tx_data=0, raw_rx_data=0, raw_tx_pkts=0, raw_rx_pkts=0;
-    if (!read_u64_file(ctrs.tx_data, &p_txB) ||
-        !read_u64_file(ctrs.rx_data, &p_rxB) ||
-        !read_u64_file(ctrs.tx_pkts, &p_txp) ||
-        !read_u64_file(ctrs.rx_pkts, &p_rxp)) {
+    bool burst_mode = false; // 'b' toggles microburst log page
+
+    if (!mon_dev_prime(dev)) {
         endwin();
         fprintf(stderr, "Error: failed to read initial counters.\n");
-        free_counters(&ctrs);
+        sinks_close(&sinks);
+        mon_dev_close(dev); free(dev);
         return 1;
     }
-    raw_tx_data = p_txB; raw_rx_data = p_rxB; raw_tx_pkts = p_txp; raw_rx_pkts = p_rxp;
-    double prev_t = now_monotonic();
+    sinks_prime(&sinks, dev, now_monotonic(), now_realtime());
     bool first_draw = true;
-
-    // history for graph
-    enum { HIST_CAP = 4096 };
-    static double rx_hist[HIST_CAP];
-    static double tx_hist[HIST_CAP];
-    int hist_len = 0; // number of valid samples
+    frame_sched_t fs; frame_init(&fs, opt.fps, opt.interval);
 
     // windows
     WINDOW *win_hdr = NULL, *win_rx = NULL, *win_tx = NULL, *win_other = NULL, *win_info = NULL;
@@ -771,66 +5254,47 @@ int main(int argc, char **argv) {
     double start_time = now_monotonic();
     for (; !g_stop; ) {
         double loop_start = now_monotonic();
+        if (opt.duration > 0 && (loop_start - start_time) >= opt.duration) break;
 
         if (g_resized) {
             g_resized = 0;
             endwin();
             refresh();
             prev_maxy = -1; prev_maxx = -1; // force window recreate
+            chart_reset(dev);
+            frame_touch(&fs, true);
         }
 
         int ch = getch();
         bool fast_switch = false;
-        if (ch != ERR) {
+        if (ch != ERR) frame_touch(&fs, true);
+        if (ch != ERR && !handle_view_key(ch)) {
             if (ch == 'q' || ch == 'Q') break;
             else if (ch == 'p' || ch == 'P') paused = !paused;
             else if (ch == 'u' || ch == 'U') opt.units = (opt.units == UNITS_BITS) ? UNITS_BYTES : UNITS_BITS;
-            else if (ch == 'd' || ch == 'D') { data_mode = !data_mode; info_mode = false; fast_switch = true; }
-            else if (ch == 'i' || ch == 'I') { info_mode = !info_mode; data_mode = false; fast_switch = true; }
+            else if (ch == 'm' || ch == 'M') g_smooth.metric = (metric_t)((g_smooth.metric + 1) % 3);
+            else if (ch == 'd' || ch == 'D') { data_mode = !data_mode; info_mode = burst_mode = false; fast_switch = true; }
+            else if (ch == 'i' || ch == 'I') { info_mode = !info_mode; data_mode = burst_mode = false; fast_switch = true; }
+            else if (ch == 'b' || ch == 'B') { burst_mode = !burst_mode; data_mode = info_mode = false; fast_switch = true; }
         }
 
-        static double tx_Bps=0, rx_Bps=0, tx_pps=0, rx_pps=0;
         if (!paused && !fast_switch) {
-            uint64_t c_txB=0, c_rxB=0, c_txp=0, c_rxp=0;
-            bool ok = read_u64_file(ctrs.tx_data, &c_txB)
-                   && read_u64_file(ctrs.rx_data, &c_rxB)
-                   && read_u64_file(ctrs.tx_pkts, &c_txp)
-                   && read_u64_file(ctrs.rx_pkts, &c_rxp);
             double now = now_monotonic();
-            double dt = now - prev_t; if (dt <= 0) dt = 1e-9;
-            if (ok) {
-                uint64_t d_txB = (c_txB >= p_txB) ? (c_txB - p_txB) : (c_txB + (UINT64_MAX - p_txB) + 1);
-                uint64_t d_rxB = (c_rxB >= p_rxB) ? (c_rxB - p_rxB) : (c_rxB + (UINT64_MAX - p_rxB) + 1);
-                uint64_t d_txp = (c_txp >= p_txp) ? (c_txp - p_txp) : (c_txp + (UINT64_MAX - p_txp) + 1);
-                uint64_t d_rxp = (c_rxp >= p_rxp) ? (c_rxp - p_rxp) : (c_rxp + (UINT64_MAX - p_rxp) + 1);
-
-                if (ctrs.data_is_words) { d_txB *= 4; d_rxB *= 4; }
-                tx_Bps = (double)d_txB / dt; rx_Bps = (double)d_rxB / dt;
-                tx_pps = (double)d_txp / dt; rx_pps = (double)d_rxp / dt;
-
-                p_txB = c_txB; p_rxB = c_rxB; p_txp = c_txp; p_rxp = c_rxp; prev_t = now;
-                raw_tx_data = c_txB; raw_rx_data = c_rxB; raw_tx_pkts = c_txp; raw_rx_pkts = c_rxp;
-            }
-
+            mon_dev_sample(dev, now);
             // append to history regardless so the graph scrolls
-            if (hist_len < HIST_CAP) {
-                rx_hist[hist_len] = rx_Bps;
-                tx_hist[hist_len] = tx_Bps;
-                hist_len++;
-            } else {
-                memmove(rx_hist, rx_hist+1, sizeof(double)*(HIST_CAP-1));
-                memmove(tx_hist, tx_hist+1, sizeof(double)*(HIST_CAP-1));
-                rx_hist[HIST_CAP-1] = rx_Bps;
-                tx_hist[HIST_CAP-1] = tx_Bps;
-            }
-
-            // CSV log in bytes per second (even if same values)
-            if (csv) {
-                fprintf(csv, "%.6f,%.0f,%.0f,%.0f,%.0f\n", now, rx_Bps, tx_Bps, rx_pps, tx_pps);
-                fflush(csv);
+            mon_dev_record(dev, now);
+            frame_touch(&fs, false);
+            // CSV log in bytes per second (even if same values), binary log, exporter
+            sinks_tick(&sinks, &opt, dev, 1, now, now_realtime());
+            if (opt.pctl_window > 0 && now - win_start >= opt.pctl_window) {
+                summary_window(sum, sum_json, dev, 1, now_realtime());
+                win_start = now;
             }
+            if (blog) burst_log_flush(blog, &blog_written);
         }
 
+        if (!frame_due(&fs, now_monotonic())) continue; // getch() paces the loop
+
         // Layout: header + panels
         int maxy, maxx; getmaxyx(stdscr, maxy, maxx);
         int hdr_h = 4;
@@ -839,7 +5303,8 @@ int main(int argc, char **argv) {
             win_hdr = newwin(hdr_h, maxx, 0, 0);
             prev_maxy = maxy; prev_maxx = maxx;
         }
-        if (info_mode) {
+        if (info_mode || burst_mode || data_mode) chart_reset(dev); // the plot windows go or show counters
+        if (info_mode || burst_mode) {
             // single info window
             if (win_rx) { delwin(win_rx); win_rx = NULL; }
             if (win_tx) { delwin(win_tx); win_tx = NULL; }
@@ -857,14 +5322,14 @@ int main(int argc, char **argv) {
             // remove other box if present
             if (win_other) { delwin(win_other); win_other = NULL; }
             if (win_info) { delwin(win_info); win_info = NULL; }
-            // recreate RX/TX if size changed
+            // recreate RX/TX if size changed; a new window starts with a full redraw
             int ch, cw;
             if (!win_rx) {
-                win_rx = newwin(rx_h, maxx, hdr_h, 0);
-            } else { getmaxyx(win_rx, ch, cw); if (ch != rx_h || cw != maxx) { delwin(win_rx); win_rx = newwin(rx_h, maxx, hdr_h, 0); } }
+                win_rx = newwin(rx_h, maxx, hdr_h, 0); dev->chart[0].valid = false;
+            } else { getmaxyx(win_rx, ch, cw); if (ch != rx_h || cw != maxx) { delwin(win_rx); win_rx = newwin(rx_h, maxx, hdr_h, 0); dev->chart[0].valid = false; } }
             if (!win_tx) {
-                win_tx = newwin(tx_h, maxx, hdr_h + rx_h, 0);
-            } else { getmaxyx(win_tx, ch, cw); if (ch != tx_h || cw != maxx) { delwin(win_tx); win_tx = newwin(tx_h, maxx, hdr_h + rx_h, 0); } }
+                win_tx = newwin(tx_h, maxx, hdr_h + rx_h, 0); dev->chart[1].valid = false;
+            } else { getmaxyx(win_tx, ch, cw); if (ch != tx_h || cw != maxx) { delwin(win_tx); win_tx = newwin(tx_h, maxx, hdr_h + rx_h, 0); dev->chart[1].valid = false; } }
         } else {
             // three stacked windows: RX, TX, OTHER
             int remaining = maxy - hdr_h;
@@ -904,17 +5369,25 @@ int main(int argc, char **argv) {
         }
         mvwprintw(win_hdr, 1, 2, "%s port %d  [q:quit p:pause u:units]",
                   opt.device, opt.port);
-        mvwprintw(win_hdr, 2, 2, "Interval: %.0f ms   Units: %s",
-                  opt.interval*1000.0, (opt.units == UNITS_BITS) ? "bits" : "bytes");
-        if (ctrs.link_layer) mvwprintw(win_hdr, 1, maxx/2, "Link: %s", ctrs.link_layer);
-        if (ctrs.rate) mvwprintw(win_hdr, 2, maxx/2, "Rate: %s", ctrs.rate);
+        mvwprintw(win_hdr, 2, 2, "Interval: %.0f ms   Units: %s   Metric: %s",
+                  opt.interval*1000.0, (opt.units == UNITS_BITS) ? "bits" : "bytes", metric_name(g_smooth.metric));
+        if (maxx/2 + 56 < maxx)
+            mvwprintw(win_hdr, 1, maxx/2 + 24, "History: %.1f KB", (double)hstore_bytes(&dev->hs) / 1024.0);
+        if (dev->ctrs.link_layer) mvwprintw(win_hdr, 1, maxx/2, "Link: %s", dev->ctrs.link_layer);
+        if (dev->ctrs.rate) mvwprintw(win_hdr, 2, maxx/2, "Rate: %s", dev->ctrs.rate);
+        uint64_t csv_drops = sinks.csv ? csvw_dropped(sinks.csv) : 0;
+        if (csv_drops && maxx/2 + 56 < maxx)
+            mvwprintw(win_hdr, 2, maxx/2 + 24, "CSV dropped: %" PRIu64, csv_drops);
         if (paused) mvwprintw(win_hdr, 1, maxx-12, "[PAUSED]");
         if (data_mode) mvwprintw(win_hdr, 0, 32, "[DATA]");
         if (info_mode) mvwprintw(win_hdr, 0, 40, "[INFO]");
+        if (burst_mode) mvwprintw(win_hdr, 0, 40, "[BURSTS]");
         if (use_colors) wattroff(win_hdr, COLOR_PAIR(10));
         wnoutrefresh(win_hdr);
 
-        if (info_mode) {
+        if (burst_mode) {
+            draw_burst_list(win_info, "Microbursts", NULL, 0, opt.units, use_colors);
+        } else if (info_mode) {
             // refresh gid list once per second
             double nowt = now_monotonic();
             if ((nowt - last_gid_refresh) > 1.0 || gid_list == NULL) {
@@ -943,8 +5416,18 @@ int main(int argc, char **argv) {
             wnoutrefresh(win_info);
         } else if (!data_mode) {
             // Draw RX/TX graph panels
-            draw_panel_win(win_rx, "RX", rx_Bps, rx_pps, rx_hist, hist_len, opt.units, rate_gbps, use_colors, false);
-            draw_panel_win(win_tx, "TX", tx_Bps, tx_pps, tx_hist, hist_len, opt.units, rate_gbps, use_colors, false);
+            plot_state_t *ps = dev->plot; // the single port is always plotted
+            char tag[48], title[64]; int n; const double *mean; uint64_t end;
+            double r[4]; mon_dev_rates(dev, g_smooth.metric, r);
+            const char *mtag = g_smooth.metric == METRIC_RAW ? "" : (g_smooth.metric == METRIC_EWMA ? " ewma" : " avg");
+            const double *h = panel_series(dev, 0, maxx * plot_per[g_plot], &n, &mean, &end, tag, sizeof(tag));
+            snprintf(title, sizeof(title), "RX%s%s", mtag, tag);
+            draw_panel_win(win_rx, title, r[0], r[2], &dev->rx_pct, h, mean, n, view_is_live() ? &ps->rx_max : NULL,
+                           &dev->chart[0], end, opt.units, dev->rate_gbps, use_colors, false);
+            h = panel_series(dev, 1, maxx * plot_per[g_plot], &n, &mean, &end, tag, sizeof(tag));
+            snprintf(title, sizeof(title), "TX%s%s", mtag, tag);
+            draw_panel_win(win_tx, title, r[1], r[3], &dev->tx_pct, h, mean, n, view_is_live() ? &ps->tx_max : NULL,
+                           &dev->chart[1], end, opt.units, dev->rate_gbps, use_colors, false);
         } else {
             // Draw raw counters panels
             // RX panel
@@ -959,16 +5442,16 @@ int main(int argc, char **argv) {
                 wattron(win_rx, COLOR_PAIR(10));
             }
             mvwprintw(win_rx, 0, 2, " RX Raw Counters ");
-            mvwprintw(win_rx, 1, 2, "port_rcv_data:    %20" PRIu64 " %s", raw_rx_data, ctrs.data_is_words ? "(words)" : "" );
-            mvwprintw(win_rx, 2, 2, "port_rcv_packets: %20" PRIu64, raw_rx_pkts);
-            if (!fast_switch && ctrs.rx_errors) {
-                uint64_t v; if (read_u64_file(ctrs.rx_errors, &v)) mvwprintw(win_rx, 3, 2, "port_rcv_errors: %20" PRIu64, v);
+            mvwprintw(win_rx, 1, 2, "port_rcv_data:    %20" PRIu64 " %s", dev->prev_rx_data, dev->ctrs.data_is_words ? "(words)" : "" );
+            mvwprintw(win_rx, 2, 2, "port_rcv_packets: %20" PRIu64, dev->prev_rx_pkts);
+            if (!fast_switch && dev->ctrs.rx_errors) {
+                uint64_t v; if (read_u64_file(dev->ctrs.rx_errors, &v)) mvwprintw(win_rx, 3, 2, "port_rcv_errors: %20" PRIu64, v);
             }
-            if (!fast_switch && ctrs.rx_remote_phy_err) {
-                uint64_t v; if (read_u64_file(ctrs.rx_remote_phy_err, &v)) mvwprintw(win_rx, 4, 2, "rcv_remote_phy:   %20" PRIu64, v);
+            if (!fast_switch && dev->ctrs.rx_remote_phy_err) {
+                uint64_t v; if (read_u64_file(dev->ctrs.rx_remote_phy_err, &v)) mvwprintw(win_rx, 4, 2, "rcv_remote_phy:   %20" PRIu64, v);
             }
-            if (!fast_switch && ctrs.rx_switch_relay_err) {
-                uint64_t v; if (read_u64_file(ctrs.rx_switch_relay_err, &v)) mvwprintw(win_rx, 5, 2, "rcv_switch_relay: %20" PRIu64, v);
+            if (!fast_switch && dev->ctrs.rx_switch_relay_err) {
+                uint64_t v; if (read_u64_file(dev->ctrs.rx_switch_relay_err, &v)) mvwprintw(win_rx, 5, 2, "rcv_switch_relay: %20" PRIu64, v);
             }
             if (use_colors) wattroff(win_rx, COLOR_PAIR(10));
             wnoutrefresh(win_rx);
@@ -985,13 +5468,13 @@ int main(int argc, char **argv) {
                 wattron(win_tx, COLOR_PAIR(10));
             }
             mvwprintw(win_tx, 0, 2, " TX Raw Counters ");
-            mvwprintw(win_tx, 1, 2, "port_xmit_data:   %20" PRIu64 " %s", raw_tx_data, ctrs.data_is_words ? "(words)" : "" );
-            mvwprintw(win_tx, 2, 2, "port_xmit_packets:%20" PRIu64, raw_tx_pkts);
-            if (!fast_switch && ctrs.tx_discards) {
-                uint64_t v; if (read_u64_file(ctrs.tx_discards, &v)) mvwprintw(win_tx, 3, 2, "xmit_discards:    %20" PRIu64, v);
+            mvwprintw(win_tx, 1, 2, "port_xmit_data:   %20" PRIu64 " %s", dev->prev_tx_data, dev->ctrs.data_is_words ? "(words)" : "" );
+            mvwprintw(win_tx, 2, 2, "port_xmit_packets:%20" PRIu64, dev->prev_tx_pkts);
+            if (!fast_switch && dev->ctrs.tx_discards) {
+                uint64_t v; if (read_u64_file(dev->ctrs.tx_discards, &v)) mvwprintw(win_tx, 3, 2, "xmit_discards:    %20" PRIu64, v);
             }
-            if (!fast_switch && ctrs.tx_wait) {
-                uint64_t v; if (read_u64_file(ctrs.tx_wait, &v)) mvwprintw(win_tx, 4, 2, "xmit_wait:        %20" PRIu64, v);
+            if (!fast_switch && dev->ctrs.tx_wait) {
+                uint64_t v; if (read_u64_file(dev->ctrs.tx_wait, &v)) mvwprintw(win_tx, 4, 2, "xmit_wait:        %20" PRIu64, v);
             }
             if (use_colors) wattroff(win_tx, COLOR_PAIR(10));
             wnoutrefresh(win_tx);
@@ -1009,12 +5492,12 @@ int main(int argc, char **argv) {
             }
             mvwprintw(win_other, 0, 2, " Other Counters ");
             int rowo = 1;
-            if (!fast_switch && ctrs.local_phy_errors) { uint64_t v; if (read_u64_file(ctrs.local_phy_errors, &v)) { mvwprintw(win_other, rowo++, 2, "local_phy_errors: %20" PRIu64, v);} }
-            if (!fast_switch && ctrs.symbol_error) { uint64_t v; if (read_u64_file(ctrs.symbol_error, &v)) { mvwprintw(win_other, rowo++, 2, "symbol_error:     %20" PRIu64, v);} }
-            if (!fast_switch && ctrs.link_error_recovery) { uint64_t v; if (read_u64_file(ctrs.link_error_recovery, &v)) { mvwprintw(win_other, rowo++, 2, "link_err_recov:   %20" PRIu64, v);} }
-            if (!fast_switch && ctrs.link_downed) { uint64_t v; if (read_u64_file(ctrs.link_downed, &v)) { mvwprintw(win_other, rowo++, 2, "link_downed:      %20" PRIu64, v);} }
-            if (!fast_switch && ctrs.vl15_dropped) { uint64_t v; if (read_u64_file(ctrs.vl15_dropped, &v)) { mvwprintw(win_other, rowo++, 2, "vl15_dropped:     %20" PRIu64, v);} }
-            if (!fast_switch && ctrs.excessive_buf_overrun) { uint64_t v; if (read_u64_file(ctrs.excessive_buf_overrun, &v)) { mvwprintw(win_other, rowo++, 2, "excess_buf_over:  %20" PRIu64, v);} }
+            if (!fast_switch && dev->ctrs.local_phy_errors) { uint64_t v; if (read_u64_file(dev->ctrs.local_phy_errors, &v)) { mvwprintw(win_other, rowo++, 2, "local_phy_errors: %20" PRIu64, v);} }
+            if (!fast_switch && dev->ctrs.symbol_error) { uint64_t v; if (read_u64_file(dev->ctrs.symbol_error, &v)) { mvwprintw(win_other, rowo++, 2, "symbol_error:     %20" PRIu64, v);} }
+            if (!fast_switch && dev->ctrs.link_error_recovery) { uint64_t v; if (read_u64_file(dev->ctrs.link_error_recovery, &v)) { mvwprintw(win_other, rowo++, 2, "link_err_recov:   %20" PRIu64, v);} }
+            if (!fast_switch && dev->ctrs.link_downed) { uint64_t v; if (read_u64_file(dev->ctrs.link_downed, &v)) { mvwprintw(win_other, rowo++, 2, "link_downed:      %20" PRIu64, v);} }
+            if (!fast_switch && dev->ctrs.vl15_dropped) { uint64_t v; if (read_u64_file(dev->ctrs.vl15_dropped, &v)) { mvwprintw(win_other, rowo++, 2, "vl15_dropped:     %20" PRIu64, v);} }
+            if (!fast_switch && dev->ctrs.excessive_buf_overrun) { uint64_t v; if (read_u64_file(dev->ctrs.excessive_buf_overrun, &v)) { mvwprintw(win_other, rowo++, 2, "excess_buf_over:  %20" PRIu64, v);} }
             if (use_colors) wattroff(win_other, COLOR_PAIR(10));
             wnoutrefresh(win_other);
         }
@@ -1031,10 +5514,6 @@ int main(int argc, char **argv) {
             ts.tv_nsec = (long)((to_sleep - ts.tv_sec) * 1e9);
             nanosleep(&ts, NULL);
         }
-
-        if (opt.duration > 0 && (now_monotonic() - start_time) >= opt.duration) {
-            break;
-        }
     }
 
     if (win_hdr) delwin(win_hdr);
@@ -1043,8 +5522,12 @@ int main(int argc, char **argv) {
     if (win_other) delwin(win_other);
     if (win_info) delwin(win_info);
     endwin();
-    if (csv) fclose(csv);
+    sinks_close(&sinks);
+    burst_finish(dev, 1);
+    if (sum) { summary_window(sum, sum_json, dev, 1, now_realtime()); fclose(sum); }
+    if (blog) { burst_log_flush(blog, &blog_written); fclose(blog); }
     free_gid_list(gid_list, gid_count);
-    free_counters(&ctrs);
+    mon_dev_close(dev);
+    free(dev);
     return 0;
 }
@@ -0,0 +1,116 @@
+// ibmon_shm.h - reader side of the ibmon --shm snapshot segment.
+//
+// ibmon publishes the latest counters and rates of every monitored port in a
+// POSIX shared-memory object (`ibmon --shm /ibmon` -> /dev/shm/ibmon). The
+// layout below is a fixed ABI: a 64-byte header followed by `nports` records
+// of `port_size` bytes. Fields are only ever appended (within the reserved
+// space or by growing port_size), so readers must use header_size and
+// port_size rather than sizeof().
+//
+// The whole snapshot is guarded by a seqlock: `seq` is odd while ibmon is
+// updating it. ibmon_shm_read() copies a consistent snapshot without any
+// system call.
+//
+//     ibmon_shm_t h;
+//     if (ibmon_shm_open("/ibmon", &h) == 0) {
+//         struct ibmon_shm_port ports[64];
+//         int n = ibmon_shm_read(&h, NULL, ports, 64);
+//         ...
+//         ibmon_shm_close(&h);
+//     }
+#ifndef IBMON_SHM_H
+#define IBMON_SHM_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define IBMON_SHM_MAGIC 0x4d48534e4f4d4249ULL // "IBMONSHM"
+#define IBMON_SHM_VERSION 1
+
+struct ibmon_shm_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t nports;
+    uint32_t port_size;       // bytes per port record
+    uint32_t header_size;     // offset of the first port record
+    uint64_t seq;             // seqlock: odd while an update is in progress
+    uint64_t update_real_ns;  // CLOCK_REALTIME of the last update
+    uint64_t update_mono_ns;  // CLOCK_MONOTONIC of the last update
+    uint64_t interval_ns;     // sampling interval
+    uint32_t writer_pid;
+    uint32_t reserved;
+};
+
+struct ibmon_shm_port {
+    char device[64];          // NUL-terminated
+    uint32_t port;
+    uint32_t reserved;
+    double link_Bps;          // link rate in bytes/s, 0 if unknown
+    uint64_t rx_bytes, tx_bytes, rx_pkts, tx_pkts; // cumulative (data in bytes)
+    double rx_Bps, tx_Bps, rx_pps, tx_pps;         // last sampling interval
+    uint64_t sample_real_ns;  // when this port was last sampled, 0 = never
+    uint64_t reserved2;
+};
+
+typedef char ibmon_shm_header_size_check[sizeof(struct ibmon_shm_header) == 64 ? 1 : -1];
+typedef char ibmon_shm_port_size_check[sizeof(struct ibmon_shm_port) == 160 ? 1 : -1];
+
+typedef struct {
+    const unsigned char *base;
+    size_t size;
+} ibmon_shm_t;
+
+// Map the segment read-only. Returns 0 on success, -1 if it does not exist
+// or is not an ibmon segment.
+static inline int ibmon_shm_open(const char *name, ibmon_shm_t *h) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return -1;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(struct ibmon_shm_header))
+        p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return -1;
+    const struct ibmon_shm_header *hdr = (const struct ibmon_shm_header *)p;
+    if (hdr->magic != IBMON_SHM_MAGIC || hdr->version != IBMON_SHM_VERSION) { munmap(p, (size_t)st.st_size); return -1; }
+    h->base = (const unsigned char *)p;
+    h->size = (size_t)st.st_size;
+    return 0;
+}
+
+// Copy a consistent snapshot: the header (if hdr) and up to max port records.
+// Returns the number of ports copied, or -1 if no consistent copy could be
+// taken (the writer died in the middle of an update, or the header describes
+// more data than the mapping holds).
+static inline int ibmon_shm_read(const ibmon_shm_t *h, struct ibmon_shm_header *hdr,
+                                 struct ibmon_shm_port *ports, uint32_t max) {
+    const struct ibmon_shm_header *sh = (const struct ibmon_shm_header *)h->base;
+    for (unsigned tries = 0; tries < 1000000; ++tries) {
+        uint64_t s1 = __atomic_load_n(&sh->seq, __ATOMIC_ACQUIRE);
+        if (s1 & 1) continue; // writer active
+        uint32_t n = sh->nports, psz = sh->port_size, off = sh->header_size;
+        if (n > max) n = max;
+        if (psz > sizeof(struct ibmon_shm_port)) psz = sizeof(struct ibmon_shm_port);
+        if ((size_t)off + (size_t)n * sh->port_size > h->size) return -1;
+        if (hdr) memcpy(hdr, sh, sizeof(*hdr));
+        for (uint32_t i = 0; i < n; ++i) {
+            memset(&ports[i], 0, sizeof(ports[i]));
+            memcpy(&ports[i], h->base + off + (size_t)i * sh->port_size, psz);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&sh->seq, __ATOMIC_RELAXED) == s1) return (int)n;
+    }
+    return -1;
+}
+
+static inline void ibmon_shm_close(ibmon_shm_t *h) {
+    if (h->base) munmap((void *)h->base, h->size);
+    h->base = NULL;
+    h->size = 0;
+}
+
+#endif
@@ -0,0 +1,49 @@
+#!/bin/sh
+# --arrow round trip: record a few seconds of two fake ports, read the stream
+# back with pyarrow and compare every row with the --headless NDJSON records
+# of the same run (counters exactly, rates and times to their printed
+# precision). Batches are smaller than the run, so the batch written at exit
+# is covered too.
+
+. "$(dirname "$0")/lib.sh"
+
+if ! python3 -c 'import pyarrow' 2>/dev/null; then
+    echo "SKIP: arrow-roundtrip (needs python3 with pyarrow)"
+    exit 0
+fi
+
+fake_sysfs 2
+build_ibmon
+feed
+"$T/ibmon" --headless -i 0.1 --duration 3 --arrow "$T/run.arrows" --arrow-batch 7 >"$T/run.ndjson" ||
+    fail "ibmon exited with $?"
+
+python3 - "$T/run.arrows" "$T/run.ndjson" <<'EOF' || fail "arrow-roundtrip"
+import json, sys
+import pyarrow as pa, pyarrow.ipc as ipc
+
+t = ipc.open_stream(sys.argv[1]).read_all()
+t = t.set_column(0, "time", t.column("time").cast(pa.int64()))
+a = t.to_pylist()
+with open(sys.argv[2]) as f:
+    j = [r for r in map(json.loads, f) if r.get("type") == "sample"]
+
+if not j:
+    sys.exit("no samples recorded")
+if len(a) != len(j):
+    sys.exit("%d arrow rows, %d samples" % (len(a), len(j)))
+for i, (x, y) in enumerate(zip(a, j)):
+    w = 4 if y["data_words"] else 1
+    want = {"device": y["device"], "port": y["port"],
+            "rx_bytes": y["rx_data"] * w, "tx_bytes": y["tx_data"] * w,
+            "rx_pkts": y["rx_pkts"], "tx_pkts": y["tx_pkts"]}
+    for k, v in want.items():
+        if x[k] != v:
+            sys.exit("row %d: %s = %r, expected %r" % (i, k, x[k], v))
+    for k in ("rx_Bps", "tx_Bps", "rx_pps", "tx_pps"):
+        if abs(x[k] - y[k]) > 0.051:
+            sys.exit("row %d: %s = %r, expected %r" % (i, k, x[k], y[k]))
+    if abs(x["time"] / 1e9 - y["t"]) > 2e-6 or abs(x["mono_ns"] / 1e9 - y["mono"]) > 2e-6:
+        sys.exit("row %d: time %d/%d, expected %.6f/%.6f" % (i, x["time"], x["mono_ns"], y["t"], y["mono"]))
+print("PASS: arrow-roundtrip (%d rows in %d batches)" % (len(a), t.column("time").num_chunks))
+EOF
@@ -0,0 +1,78 @@
+#!/bin/sh
+# --event-log: change a fake port's state, rate and error counters while
+# ibmon runs and check that each change is logged once, with its old and new
+# value, in the CSV log, the JSON log and the --headless NDJSON stream. A
+# counter that goes down (a reset) is not an event.
+
+. "$(dirname "$0")/lib.sh"
+
+if ! command -v python3 >/dev/null; then
+    echo "SKIP: event-log (needs python3)"
+    exit 0
+fi
+
+# set DEV FILE VALUE: replace a sysfs file whole, as the feeder does
+set_file() {
+    echo "$3" >"$T/sysfs/$1/ports/1/$2.new"
+    mv "$T/sysfs/$1/ports/1/$2.new" "$T/sysfs/$1/ports/1/$2"
+}
+
+fake_sysfs 2
+set_file mlx5_0 counters/excessive_buffer_overrun_errors 9
+build_ibmon
+feed
+
+run() {
+    "$T/ibmon" --headless -i 0.1 --duration 2.5 --event-log "$1" >"$2" &
+    pid=$!
+    sleep 0.8
+    set_file mlx5_0 counters/symbol_error 5
+    set_file mlx5_0 counters/excessive_buffer_overrun_errors 2
+    set_file mlx5_1 counters/link_downed 1
+    set_file mlx5_1 state DOWN
+    set_file mlx5_1 rate "25 Gb/sec (1X EDR)"
+    sleep 0.6
+    set_file mlx5_0 counters/symbol_error 7
+    wait "$pid" || fail "ibmon exited with $?"
+    # back to the baseline for the next run
+    for d in mlx5_0 mlx5_1; do
+        for c in symbol_error link_downed; do set_file $d counters/$c 0; done
+        set_file $d state ACTIVE
+        set_file $d rate "100 Gb/sec (4X EDR)"
+    done
+    set_file mlx5_0 counters/excessive_buffer_overrun_errors 9
+}
+
+run "$T/events.csv" "$T/csv.ndjson"
+run "$T/events.json" "$T/json.ndjson"
+
+python3 - "$T/events.csv" "$T/events.json" "$T/csv.ndjson" "$T/json.ndjson" <<'EOF' || fail "event-log"
+import csv, json, sys
+want = sorted([
+    ("mlx5_0", "symbol_error", "0", "5"),
+    ("mlx5_0", "symbol_error", "5", "7"),
+    ("mlx5_1", "link_downed", "0", "1"),
+    ("mlx5_1", "state", "ACTIVE", "DOWN"),
+    ("mlx5_1", "rate", "100 Gb/sec (4X EDR)", "25 Gb/sec (1X EDR)"),
+])
+
+def check(name, rows):
+    got = sorted((r["device"], r["event"], r["from"], r["to"]) for r in rows)
+    if got != want:
+        sys.exit("%s: events %s, expected %s" % (name, got, want))
+    for r in rows:
+        if int(r["port"]) != 1 or float(r["mono"]) <= 0 or float(r["t"]) < 1e9:
+            sys.exit("%s: bad event %s" % (name, r))
+
+with open(sys.argv[1]) as f:
+    rows = list(csv.DictReader(f))
+if rows and list(rows[0]) != ["time_s", "mono_s", "device", "port", "event", "from", "to"]:
+    sys.exit("events.csv: header %s" % list(rows[0]))
+check("events.csv", [dict(r, t=r["time_s"], mono=r["mono_s"]) for r in rows])
+with open(sys.argv[2]) as f:
+    check("events.json", [json.loads(l) for l in f])
+for path in sys.argv[3:]:
+    with open(path) as f:
+        check(path.rsplit("/", 1)[-1], [r for r in map(json.loads, f) if r.get("type") == "event"])
+print("PASS: event-log (%d events in CSV, JSON and NDJSON)" % len(want))
+EOF
@@ -0,0 +1,134 @@
+#!/bin/sh
+# --influx to sockets: a local listener receives the line protocol over TCP
+# and over a Unix socket, and every line must match a --headless NDJSON sample
+# of the same run. Over TCP the listener drops the first connection and then
+# keeps its accept queue full for a while, so the reconnect (retried every
+# 5 s) takes a SYN retransmission, about a second, to complete; no tick may
+# wait for it. Over the Unix socket every sample must arrive, the last tick's lines
+# included (flushed at exit).
+
+. "$(dirname "$0")/lib.sh"
+
+if ! command -v python3 >/dev/null; then
+    echo "SKIP: influx (needs python3)"
+    exit 0
+fi
+
+# listen MODE ADDR DROP_S HOLD_S CONNS: accept CONNS connections, one after
+# the other, and write what each sends to $T/influx.N; the first is closed
+# after DROP_S seconds (0: kept until ibmon closes it), then the accept queue
+# is held full for HOLD_S seconds
+listen() {
+    python3 - "$@" <<'EOF' &
+import os, socket, sys, time
+mode, addr, drop, hold, conns = sys.argv[1], sys.argv[2], float(sys.argv[3]), float(sys.argv[4]), int(sys.argv[5])
+if mode == "tcp":
+    l = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    l.bind(("127.0.0.1", 0))
+    with open(addr + ".tmp", "w") as f:
+        f.write(str(l.getsockname()[1]))
+    os.rename(addr + ".tmp", addr)
+else:
+    l = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    l.bind(addr)
+l.listen(1)
+for n in range(1, conns + 1):
+    c, _ = l.accept()
+    end = time.monotonic() + drop if n == 1 and drop > 0 else None
+    with open(os.path.join(os.path.dirname(addr), "influx.%d" % n), "wb") as out:
+        while True:
+            if end:
+                c.settimeout(max(end - time.monotonic(), 0.001))
+            try:
+                d = c.recv(65536)
+            except socket.timeout:
+                break
+            if not d:
+                break
+            out.write(d)
+    c.close()
+    if n == 1 and hold > 0:
+        # a backlog of 1 holds 2 connections; new SYNs are dropped meanwhile
+        fill = [socket.create_connection(l.getsockname()) for _ in range(2)]
+        time.sleep(hold)
+        for _ in fill:
+            l.accept()[0].close()
+        for f in fill:
+            f.close()
+EOF
+    LISTEN=$!
+    BG="$BG $LISTEN"
+}
+
+# the listener is done once ibmon closed its last connection
+listen_wait() {
+    for _ in $(seq 100); do kill -0 "$LISTEN" 2>/dev/null || break; sleep 0.02; done
+    kill "$LISTEN" 2>/dev/null || true
+    wait "$LISTEN" 2>/dev/null || true
+}
+
+# check NDJSON FILE...: every line of the files is a sample of the run
+check() {
+    python3 - "$@" <<'EOF'
+import json, sys
+samples = set()
+ticks = []
+with open(sys.argv[1]) as f:
+    for r in map(json.loads, f):
+        if r.get("type") != "sample":
+            continue
+        w = 4 if r["data_words"] else 1
+        samples.add((r["device"], str(r["port"]), r["rx_data"] * w, r["tx_data"] * w, r["rx_pkts"], r["tx_pkts"]))
+        if not ticks or ticks[-1] != r["mono"]:
+            ticks.append(r["mono"])
+gap = max(b - a for a, b in zip(ticks, ticks[1:]))
+if gap >= 0.18:
+    sys.exit("a tick was delayed: %.3f s between samples" % gap)
+counts = []
+for path in sys.argv[2:]:
+    n = 0
+    with open(path) as f:
+        for line in f:
+            tags, fields, ts = line.rstrip("\n").split(" ")
+            meas, dev, port = tags.split(",")
+            v = dict(kv.split("=") for kv in fields.split(","))
+            key = (dev[len("device="):], port[len("port="):],
+                   int(v["rx_bytes"][:-1]), int(v["tx_bytes"][:-1]), int(v["rx_pkts"][:-1]), int(v["tx_pkts"][:-1]))
+            if meas != "ibmon" or key not in samples:
+                sys.exit("%s: line matches no sample: %s" % (path, line.strip()))
+            n += 1
+    if n == 0:
+        sys.exit("%s: no lines" % path)
+    counts.append(n)
+print(len(samples), *counts)
+EOF
+}
+
+fake_sysfs 2
+build_ibmon
+feed
+
+# TCP: dropped after 0.5 s, retried about 5 s later while the queue is still
+# full for 0.5 s, so the reconnect completes on a later tick of the 8 s run
+listen tcp "$T/port" 0.5 5.7 2
+for _ in $(seq 100); do [ -f "$T/port" ] && break; sleep 0.02; done
+[ -f "$T/port" ] || fail "influx listener did not start"
+"$T/ibmon" --headless -i 0.1 --duration 8 --influx "tcp://127.0.0.1:$(cat "$T/port")" >"$T/tcp.ndjson" 2>"$T/tcp.err" ||
+    fail "ibmon exited with $? ($(cat "$T/tcp.err"))"
+listen_wait
+grep -q "1 reconnect" "$T/tcp.err" || fail "influx: no reconnect reported ($(cat "$T/tcp.err"))"
+[ -s "$T/influx.2" ] || fail "influx: nothing received after the reconnect"
+tcp=$(check "$T/tcp.ndjson" "$T/influx.1" "$T/influx.2") || fail "influx over tcp"
+
+# Unix socket: kept open, so every sample arrives
+rm -f "$T"/influx.*
+listen unix "$T/influx.sock" 0 0 1
+for _ in $(seq 100); do [ -S "$T/influx.sock" ] && break; sleep 0.02; done
+"$T/ibmon" --headless -i 0.1 --duration 2 --influx "unix:$T/influx.sock" >"$T/unix.ndjson" || fail "ibmon exited with $?"
+listen_wait
+unix=$(check "$T/unix.ndjson" "$T/influx.1") || fail "influx over unix"
+set -- $unix
+[ "$1" = "$2" ] || fail "influx over unix: $2 lines for $1 samples"
+
+set -- $tcp
+echo "PASS: influx (tcp: $2 + $3 lines after a reconnect, unix: all $1 samples)"
@@ -0,0 +1,59 @@
+# Shared setup for the `make check` scripts: a scratch directory with a fake
+# sysfs tree, an ibmon built to read it instead of /sys/class/infiniband, and
+# a feeder that keeps its counters moving. Sourced, not run.
+
+set -eu
+
+T=$(mktemp -d "${TMPDIR:-/tmp}/ibmon-check.XXXXXX")
+BG=         # background helpers, stopped on exit
+cleanup() {
+    for p in $BG; do kill "$p" 2>/dev/null || true; done
+    rm -rf "$T"
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+fail() { echo "FAIL: $*" >&2; exit 1; }
+
+# fake_sysfs N: ports mlx5_0..mlx5_{N-1}, port 1, 100 Gb/s, all counters 0
+fake_sysfs() {
+    i=0
+    while [ "$i" -lt "$1" ]; do
+        p="$T/sysfs/mlx5_$i/ports/1"
+        mkdir -p "$p/counters"
+        echo ACTIVE >"$p/state"
+        echo InfiniBand >"$p/link_layer"
+        echo "100 Gb/sec (4X EDR)" >"$p/rate"
+        for c in port_xmit_data port_rcv_data port_xmit_packets port_rcv_packets port_rcv_errors \
+                 port_xmit_discards port_xmit_wait symbol_error link_downed excessive_buffer_overrun_errors; do
+            echo 0 >"$p/counters/$c"
+        done
+        i=$((i + 1))
+    done
+}
+
+# build_ibmon: $T/ibmon reading $T/sysfs, with the flags make used
+build_ibmon() {
+    wide=
+    case "${LIBS:-}" in *ncursesw*) wide=-DIBMON_WIDE ;; esac
+    ${CC:-cc} ${CFLAGS:--O2} $wide -DSYSFS_IB_BASE="\"$T/sysfs\"" -pthread -o "$T/ibmon" ibmon.c \
+        ${LIBS:--lncurses -lm} -lrt
+}
+
+# feed: advance the data and packet counters of every port every 50 ms;
+# each file is replaced whole so ibmon never reads a partial value
+feed() {
+    (
+        n=0
+        while :; do
+            n=$((n + 1))
+            for c in "$T"/sysfs/*/ports/1/counters/port_*_data "$T"/sysfs/*/ports/1/counters/port_*_packets; do
+                v=$(cat "$c")
+                echo $((v + (n * 7919 + ${#c} * 104729) % 3000000)) >"$c.new"
+                mv "$c.new" "$c"
+            done
+            sleep 0.05
+        done
+    ) &
+    BG="$BG $!"
+}
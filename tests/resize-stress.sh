@@ -0,0 +1,56 @@
+#!/bin/sh
+# Resize stress: run the multi-device screen on a pseudo-terminal (script(1))
+# sampling at 100 ms, change the terminal size every 20 ms while it runs (each
+# change delivers a SIGWINCH) and check in its --csv that no tick was lost.
+# Sampling keeps its cadence, so a late tick only shortens the next gap; a
+# lost one leaves a gap of about two intervals. Gaps from 1.8 intervals up
+# are counted as lost ticks, which leaves room for scheduler jitter.
+
+. "$(dirname "$0")/lib.sh"
+
+if ! command -v script >/dev/null || ! command -v stty >/dev/null; then
+    echo "SKIP: resize-stress (needs script and stty)"
+    exit 0
+fi
+
+fake_sysfs 4
+build_ibmon
+feed
+TERM=xterm script -qec "$T/ibmon -i 0.1 --duration 4 --csv $T/run.csv" /dev/null </dev/null >/dev/null 2>&1 &
+SCRIPT=$!
+
+# the screen's terminal, once ibmon has started on it
+pty=
+for _ in $(seq 100); do
+    pid=$(pgrep -n -f "^$T/ibmon " || true)
+    if [ -n "$pid" ]; then pty=$(readlink "/proc/$pid/fd/0" || true); fi
+    case "$pty" in /dev/pts/*) break ;; esac
+    sleep 0.02
+done
+case "$pty" in /dev/pts/*) ;; *) fail "ibmon did not start on a terminal" ;; esac
+
+sleep 0.5
+resizes=0
+while kill -0 "$pid" 2>/dev/null && [ "$resizes" -lt 120 ]; do
+    resizes=$((resizes + 1))
+    stty -F "$pty" rows $((20 + resizes % 30)) cols $((60 + resizes * 7 % 140)) 2>/dev/null || break
+    sleep 0.02
+done
+wait "$SCRIPT" || fail "ibmon exited with $?"
+[ "$resizes" -ge 50 ] || fail "only $resizes resizes before ibmon exited"
+
+awk -F, -v resizes="$resizes" '
+    NR == 1 || $1 == last { next }
+    {
+        if (last != "") {
+            d = $1 - last
+            if (d > gap) gap = d
+            if (d >= 0.18) lost += int(d / 0.1 + 0.5) - 1
+        }
+        last = $1; ticks++
+    }
+    END {
+        if (ticks < 30) { printf "FAIL: resize-stress: %d ticks in 4 s\n", ticks; exit 1 }
+        if (lost) { printf "FAIL: resize-stress: %d ticks lost (largest gap %.3f s)\n", lost, gap; exit 1 }
+        printf "PASS: resize-stress (%d resizes, %d ticks, largest gap %.3f s)\n", resizes, ticks, gap
+    }' "$T/run.csv"
@@ -0,0 +1,98 @@
+#!/bin/sh
+# --statsd: a local UDP receiver collects the datagrams of a 16-port run,
+# plain names and then DogStatsD tags, with a 512-byte --statsd-mtu so every
+# tick is split. No datagram may exceed the MTU or split a line, every port
+# must get its four gauges per sample, and the values must be the rates of
+# the --headless NDJSON records of the same run.
+
+. "$(dirname "$0")/lib.sh"
+
+if ! command -v python3 >/dev/null; then
+    echo "SKIP: statsd (needs python3)"
+    exit 0
+fi
+
+# receive OUT: write each datagram received on a UDP port as one JSON string
+# per line to OUT; the port goes to OUT.port, and it stops 1 s after the last
+receive() {
+    python3 - "$1" <<'EOF' &
+import json, os, socket, sys
+out = sys.argv[1]
+s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+s.bind(("127.0.0.1", 0))
+s.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 22)
+with open(out + ".tmp", "w") as f:
+    f.write(str(s.getsockname()[1]))
+os.rename(out + ".tmp", out + ".port")
+with open(out, "w") as f:
+    while True:
+        try:
+            d = s.recv(65536)
+        except socket.timeout:
+            break
+        f.write(json.dumps(d.decode()) + "\n")
+        s.settimeout(1.0)
+EOF
+    RECV=$!
+    BG="$BG $RECV"
+    for _ in $(seq 100); do [ -f "$1.port" ] && break; sleep 0.02; done
+    [ -f "$1.port" ] || fail "statsd receiver did not start"
+}
+
+# check NDJSON DATAGRAMS TAGS
+check() {
+    python3 - "$@" <<'EOF'
+import json, re, sys
+ndjson, dgrams, tags = sys.argv[1], sys.argv[2], sys.argv[3] == "1"
+want = {}
+with open(ndjson) as f:
+    for r in map(json.loads, f):
+        if r.get("type") != "sample":
+            continue
+        for m, k in (("rx_bytes_per_second", "rx_Bps"), ("tx_bytes_per_second", "tx_Bps"),
+                     ("rx_packets_per_second", "rx_pps"), ("tx_packets_per_second", "tx_pps")):
+            want.setdefault((r["device"], r["port"], m), []).append(r[k])
+plain = re.compile(r"ibmon\.(.+)\.port(\d+)\.(\w+):(\d+)\|g$")
+tagged = re.compile(r"ibmon\.(\w+):(\d+)\|g\|#device:(.+),port:(\d+)$")
+got = {}
+n = 0
+with open(dgrams) as f:
+    for d in map(json.loads, f):
+        n += 1
+        if len(d) > 512:
+            sys.exit("datagram of %d bytes" % len(d))
+        for line in d.split("\n"):
+            m = (tagged if tags else plain).match(line)
+            if not m:
+                sys.exit("bad line: %r" % line)
+            dev, port, metric, v = (m[3], m[4], m[1], m[2]) if tags else m.groups()
+            got.setdefault((dev, int(port), metric), []).append(int(v))
+if set(got) != set(want):
+    sys.exit("gauges %s, expected %s" % (sorted(got), sorted(want)))
+for k, w in want.items():
+    g = got[k]
+    if len(g) != len(w):
+        sys.exit("%s: %d values for %d samples" % (k, len(g), len(w)))
+    for a, b in zip(g, w):
+        if abs(a - b) > 1:
+            sys.exit("%s: %d, expected %.1f" % (k, a, b))
+print(n, len(want) * len(next(iter(want.values()))))
+EOF
+}
+
+fake_sysfs 16
+build_ibmon
+feed
+
+for tags in 0 1; do
+    receive "$T/dgrams.$tags"
+    flags=
+    if [ "$tags" = 1 ]; then flags=--statsd-tags; fi
+    "$T/ibmon" --headless -i 0.1 --duration 1 --statsd "127.0.0.1:$(cat "$T/dgrams.$tags.port")" --statsd-mtu 512 $flags \
+        >"$T/run.$tags.ndjson" || fail "ibmon exited with $?"
+    wait "$RECV" || true
+    r=$(check "$T/run.$tags.ndjson" "$T/dgrams.$tags" "$tags") || fail "statsd (tags=$tags)"
+    set -- $r
+    if [ "$tags" = 0 ]; then plain="$2 gauges in $1 datagrams"; else tagged="$2 gauges in $1 datagrams"; fi
+done
+echo "PASS: statsd (plain: $plain, tagged: $tagged)"